@@ -0,0 +1,5240 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <list>
+#include <tuple>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <climits>
+#include <sstream>
+#include <iomanip>
+#include <array>
+#include <functional>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <filesystem>
+#include <cerrno>
+#include <cstring>
+#include <cctype>
+#include <stdexcept>
+#include <cstdlib>
+#include <deque>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <memory_resource>
+
+// httplib's listen backlog is fixed at compile time (5 by default); the
+// runtime ServerConfig::listenBacklog is applied on top of it where the OS
+// allows re-listening.
+#ifndef CPPHTTPLIB_LISTEN_BACKLOG
+#define CPPHTTPLIB_LISTEN_BACKLOG 1024
+#endif
+
+#include "nlohmann/json.hpp"
+#include "httplib.h"
+
+#include "To_Do_API_Metrics.h"
+#include "To_Do_API_Log.h"
+#include "To_Do_API_Config.h"
+#include "To_Do_API_Epoch.h"
+#include "To_Do_API_Compression.h"
+#include "To_Do_API_Reactor.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <share.h>
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using json = nlohmann::json;
+using namespace httplib;
+
+using TaskBody = std::shared_ptr<const std::string>;
+
+enum class TaskStatus : uint8_t { Todo, InProgress, Done };
+
+// Wire names, indexed by TaskStatus.
+const std::array<const char*, 3> TASK_STATUSES = { "todo", "in_progress", "done" };
+
+// Position of `status` in TASK_STATUSES, or -1 for an unknown status.
+inline int statusIndex(const std::string& status) {
+    for (size_t i = 0; i < TASK_STATUSES.size(); ++i) {
+        if (status == TASK_STATUSES[i]) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+inline TaskStatus statusFromString(const std::string& status) {
+    int index = statusIndex(status);
+    return index < 0 ? TaskStatus::Todo : static_cast<TaskStatus>(index);
+}
+
+inline const char* statusToString(TaskStatus status) {
+    return TASK_STATUSES[static_cast<size_t>(status)];
+}
+
+// Task JSON members; bit i of a field mask selects TASK_FIELDS[i].
+const std::array<const char*, 7> TASK_FIELDS = { "id", "title", "description", "status", "create_time", "update_time", "version" };
+
+constexpr unsigned ALL_TASK_FIELDS = (1u << 7) - 1;
+
+// Reads a comma-separated ?fields= list into a field mask.
+inline bool parseTaskFields(const std::string& list, unsigned& fields) {
+    fields = 0;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = std::min(list.find(',', start), list.size());
+        std::string name = list.substr(start, end - start);
+        size_t i = 0;
+        while (i < TASK_FIELDS.size() && name != TASK_FIELDS[i]) ++i;
+        if (i == TASK_FIELDS.size()) {
+            return false;
+        }
+        fields |= 1u << i;
+        start = end + 1;
+    }
+    return true;
+}
+
+inline bool toLocalTime(std::time_t t, std::tm& out) {
+#ifdef _WIN32
+    return localtime_s(&out, &t) == 0;
+#else
+    return localtime_r(&t, &out) != nullptr;
+#endif
+}
+
+// Renders epoch seconds as local "YYYY-MM-DD HH:MM:SS" without streams or
+// locales. Each thread remembers the last second it formatted and the local
+// hour around it, so repeated calls are a copy and calls within the same hour
+// only rewrite the minute and second digits; localtime runs once per hour.
+// Caching whole hours keeps DST transitions, which happen on hour
+// boundaries, correct.
+class TimestampFormatter {
+public:
+    static constexpr size_t LENGTH = 19;
+
+    static void format(int64_t epochSeconds, char* out) {
+        thread_local Cache cache;
+        if (epochSeconds == cache.second) {
+            std::memcpy(out, cache.text, LENGTH);
+            return;
+        }
+        if (epochSeconds < cache.hourStart || epochSeconds >= cache.hourStart + 3600) {
+            std::tm tm{};
+            if (!toLocalTime(static_cast<std::time_t>(epochSeconds), tm)) {
+                std::memcpy(out, "1970-01-01 00:00:00", LENGTH);
+                return;
+            }
+            writeDigits(cache.text, tm.tm_year + 1900, 4);
+            cache.text[4] = '-';
+            writeDigits(cache.text + 5, tm.tm_mon + 1, 2);
+            cache.text[7] = '-';
+            writeDigits(cache.text + 8, tm.tm_mday, 2);
+            cache.text[10] = ' ';
+            writeDigits(cache.text + 11, tm.tm_hour, 2);
+            cache.text[13] = ':';
+            cache.text[16] = ':';
+            cache.hourStart = epochSeconds - (tm.tm_min * 60 + tm.tm_sec);
+        }
+        int64_t inHour = epochSeconds - cache.hourStart;
+        writeDigits(cache.text + 14, static_cast<int>(inHour / 60), 2);
+        writeDigits(cache.text + 17, static_cast<int>(inHour % 60), 2);
+        cache.second = epochSeconds;
+        std::memcpy(out, cache.text, LENGTH);
+    }
+
+    static std::string format(int64_t epochSeconds) {
+        char text[LENGTH];
+        format(epochSeconds, text);
+        return std::string(text, LENGTH);
+    }
+
+private:
+    struct Cache {
+        int64_t second = INT64_MIN;
+        int64_t hourStart = INT64_MIN / 2;
+        char text[LENGTH] = {};
+    };
+
+    static void writeDigits(char* out, int value, int width) {
+        for (int i = width - 1; i >= 0; --i) {
+            out[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+    }
+};
+
+inline std::string formatTime(int64_t epochSeconds) {
+    return TimestampFormatter::format(epochSeconds);
+}
+
+// Reads epoch seconds or a local "YYYY-MM-DD HH:MM:SS" as written by
+// formatTime.
+inline bool parseTime(const std::string& text, int64_t& epochSeconds) {
+    if (!text.empty() && text.size() <= 18 && std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        epochSeconds = std::stoll(text);
+        return true;
+    }
+    if (text.size() != TimestampFormatter::LENGTH) {
+        return false;
+    }
+    const char* layout = "dddd-dd-dd dd:dd:dd";
+    for (size_t i = 0; i < text.size(); ++i) {
+        bool digit = text[i] >= '0' && text[i] <= '9';
+        if (layout[i] == 'd' ? !digit : text[i] != layout[i]) return false;
+    }
+    auto field = [&](size_t at, size_t width) { return std::stoi(text.substr(at, width)); };
+    std::tm tm{};
+    tm.tm_year = field(0, 4) - 1900;
+    tm.tm_mon = field(5, 2) - 1;
+    tm.tm_mday = field(8, 2);
+    tm.tm_hour = field(11, 2);
+    tm.tm_min = field(14, 2);
+    tm.tm_sec = field(17, 2);
+    tm.tm_isdst = -1;
+    std::time_t t = std::mktime(&tm);
+    if (t == static_cast<std::time_t>(-1)) {
+        return false;
+    }
+    epochSeconds = static_cast<int64_t>(t);
+    return true;
+}
+
+// Fields of a task request body that were present. Built by TaskBodyParser
+// for single-task requests and by fromJson for batch operations.
+struct TaskPatch {
+    std::optional<std::string> title;
+    std::optional<std::string> description;
+    std::optional<TaskStatus> status;
+
+    bool empty() const {
+        return !title && !description && !status;
+    }
+
+    // Expects a body that already passed validation (string fields, valid status).
+    static TaskPatch fromJson(const json& j) {
+        TaskPatch patch;
+        if (j.contains("title")) patch.title = j["title"].get<std::string>();
+        if (j.contains("description")) patch.description = j["description"].get<std::string>();
+        if (j.contains("status")) patch.status = statusFromString(j["status"].get<std::string>());
+        return patch;
+    }
+};
+
+// One-pass parser for task request bodies. It reads title, description and
+// status straight from the body into a TaskPatch without building a json
+// DOM; other members are validated and skipped. The accepted JSON is the
+// same as json::parse accepts (including UTF-8 validation), so a body that
+// parses here can always be serialized again.
+class TaskBodyParser {
+public:
+    enum class Result { Ok, Syntax, FieldType, InvalidStatus };
+
+    // On FieldType `detail` names the field, on Syntax it describes the error.
+    static Result parse(std::string_view text, TaskPatch& patch, std::string& detail) {
+        TaskBodyParser parser(text);
+        return parser.parseBody(patch, detail);
+    }
+
+private:
+    static constexpr int MAX_DEPTH = 256;
+
+    const char* pos;
+    const char* end;
+    const char* begin;
+    std::string error;
+
+    explicit TaskBodyParser(std::string_view text)
+        : pos(text.data()), end(text.data() + text.size()), begin(text.data()) {
+    }
+
+    Result parseBody(TaskPatch& patch, std::string& detail) {
+        skipSpace();
+        if (pos < end && *pos != '{') {
+            // Valid JSON that is not an object carries no task fields.
+            if (!skipValue(0) || !atEnd()) return syntax(detail);
+            return Result::Ok;
+        }
+        if (!expect('{')) return syntax(detail);
+
+        skipSpace();
+        if (pos < end && *pos == '}') {
+            ++pos;
+            return atEnd() ? Result::Ok : syntax(detail);
+        }
+
+        Result result = Result::Ok;
+        std::string key;
+        for (;;) {
+            key.clear();
+            skipSpace();
+            if (!parseString(&key)) return syntax(detail);
+            skipSpace();
+            if (!expect(':')) return syntax(detail);
+            skipSpace();
+
+            std::string* target = nullptr;
+            std::string statusText;
+            if (key == "title") target = &patch.title.emplace();
+            else if (key == "description") target = &patch.description.emplace();
+            else if (key == "status") target = &statusText;
+
+            if (target) {
+                if (pos < end && *pos == '"') {
+                    target->clear();
+                    if (!parseString(target)) return syntax(detail);
+                    if (target == &statusText) {
+                        int index = statusIndex(statusText);
+                        if (index < 0) {
+                            if (result == Result::Ok) result = Result::InvalidStatus;
+                        }
+                        else {
+                            patch.status = static_cast<TaskStatus>(index);
+                        }
+                    }
+                }
+                else {
+                    if (!skipValue(0)) return syntax(detail);
+                    if (result == Result::Ok) {
+                        result = Result::FieldType;
+                        detail = key;
+                    }
+                }
+            }
+            else if (!skipValue(0)) {
+                return syntax(detail);
+            }
+
+            skipSpace();
+            if (pos < end && *pos == ',') {
+                ++pos;
+                continue;
+            }
+            if (!expect('}')) return syntax(detail);
+            break;
+        }
+        if (!atEnd()) return syntax(detail);
+        return result;
+    }
+
+    Result syntax(std::string& detail) {
+        detail = (error.empty() ? std::string("unexpected input") : error)
+            + " at offset " + std::to_string(pos - begin);
+        return Result::Syntax;
+    }
+
+    bool fail(const char* message) {
+        if (error.empty()) error = message;
+        return false;
+    }
+
+    void skipSpace() {
+        while (pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t')) ++pos;
+    }
+
+    bool atEnd() {
+        skipSpace();
+        return pos == end || fail("unexpected trailing characters");
+    }
+
+    bool expect(char c) {
+        if (pos < end && *pos == c) {
+            ++pos;
+            return true;
+        }
+        return fail(pos < end ? "unexpected character" : "unexpected end of input");
+    }
+
+    // Appends the decoded string to `out` unless it is null (validation only).
+    bool parseString(std::string* out) {
+        if (!expect('"')) return false;
+        for (;;) {
+            const char* run = pos;
+            while (pos < end && *pos != '"' && *pos != '\\' && static_cast<unsigned char>(*pos) >= 0x20
+                && static_cast<unsigned char>(*pos) < 0x80) {
+                ++pos;
+            }
+            if (out) out->append(run, pos);
+            if (pos >= end) return fail("unterminated string");
+
+            unsigned char c = static_cast<unsigned char>(*pos);
+            if (c == '"') {
+                ++pos;
+                return true;
+            }
+            if (c < 0x20) return fail("control character in string");
+            if (c == '\\') {
+                if (!parseEscape(out)) return false;
+            }
+            else if (!parseUtf8(out)) {
+                return false;
+            }
+        }
+    }
+
+    bool parseEscape(std::string* out) {
+        if (++pos >= end) return fail("unterminated string");
+        char c = *pos++;
+        char decoded;
+        switch (c) {
+        case '"': decoded = '"'; break;
+        case '\\': decoded = '\\'; break;
+        case '/': decoded = '/'; break;
+        case 'b': decoded = '\b'; break;
+        case 'f': decoded = '\f'; break;
+        case 'n': decoded = '\n'; break;
+        case 'r': decoded = '\r'; break;
+        case 't': decoded = '\t'; break;
+        case 'u': {
+            uint32_t code;
+            if (!parseHex(code)) return false;
+            if (code >= 0xDC00 && code <= 0xDFFF) return fail("unpaired surrogate");
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                uint32_t low;
+                if (end - pos < 2 || pos[0] != '\\' || pos[1] != 'u') return fail("unpaired surrogate");
+                pos += 2;
+                if (!parseHex(low)) return false;
+                if (low < 0xDC00 || low > 0xDFFF) return fail("unpaired surrogate");
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            }
+            if (out) appendUtf8(*out, code);
+            return true;
+        }
+        default:
+            return fail("invalid escape");
+        }
+        if (out) out->push_back(decoded);
+        return true;
+    }
+
+    bool parseHex(uint32_t& code) {
+        if (end - pos < 4) return fail("invalid \\u escape");
+        code = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = *pos++;
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f') code |= static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') code |= static_cast<uint32_t>(c - 'A' + 10);
+            else return fail("invalid \\u escape");
+        }
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out.push_back(static_cast<char>(code));
+        }
+        else if (code < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+        else if (code < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+        else {
+            out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+    }
+
+    // Copies one well-formed multi-byte UTF-8 sequence (no overlongs or surrogates).
+    bool parseUtf8(std::string* out) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(pos);
+        size_t available = static_cast<size_t>(end - pos);
+        size_t length;
+        unsigned char low = 0x80, high = 0xBF;
+        if (p[0] >= 0xC2 && p[0] <= 0xDF) length = 2;
+        else if (p[0] >= 0xE0 && p[0] <= 0xEF) {
+            length = 3;
+            if (p[0] == 0xE0) low = 0xA0;
+            if (p[0] == 0xED) high = 0x9F;
+        }
+        else if (p[0] >= 0xF0 && p[0] <= 0xF4) {
+            length = 4;
+            if (p[0] == 0xF0) low = 0x90;
+            if (p[0] == 0xF4) high = 0x8F;
+        }
+        else return fail("invalid UTF-8");
+        if (available < length || p[1] < low || p[1] > high) return fail("invalid UTF-8");
+        for (size_t i = 2; i < length; ++i) {
+            if (p[i] < 0x80 || p[i] > 0xBF) return fail("invalid UTF-8");
+        }
+        if (out) out->append(pos, length);
+        pos += length;
+        return true;
+    }
+
+    bool skipValue(int depth) {
+        if (depth > MAX_DEPTH) return fail("nesting too deep");
+        skipSpace();
+        if (pos >= end) return fail("unexpected end of input");
+        switch (*pos) {
+        case '"':
+            return parseString(nullptr);
+        case '{':
+        case '[': {
+            char close = *pos == '{' ? '}' : ']';
+            bool object = close == '}';
+            ++pos;
+            skipSpace();
+            if (pos < end && *pos == close) {
+                ++pos;
+                return true;
+            }
+            for (;;) {
+                skipSpace();
+                if (object) {
+                    if (!parseString(nullptr)) return false;
+                    skipSpace();
+                    if (!expect(':')) return false;
+                }
+                if (!skipValue(depth + 1)) return false;
+                skipSpace();
+                if (pos < end && *pos == ',') {
+                    ++pos;
+                    continue;
+                }
+                return expect(close);
+            }
+        }
+        case 't': return literal("true");
+        case 'f': return literal("false");
+        case 'n': return literal("null");
+        default: return skipNumber();
+        }
+    }
+
+    bool literal(std::string_view word) {
+        if (static_cast<size_t>(end - pos) < word.size() || std::string_view(pos, word.size()) != word) {
+            return fail("invalid literal");
+        }
+        pos += word.size();
+        return true;
+    }
+
+    bool skipDigits() {
+        const char* start = pos;
+        while (pos < end && *pos >= '0' && *pos <= '9') ++pos;
+        return pos > start || fail("invalid number");
+    }
+
+    bool skipNumber() {
+        if (pos < end && *pos == '-') ++pos;
+        if (pos < end && *pos == '0') ++pos;
+        else if (!skipDigits()) return false;
+        if (pos < end && *pos == '.') {
+            ++pos;
+            if (!skipDigits()) return false;
+        }
+        if (pos < end && (*pos == 'e' || *pos == 'E')) {
+            ++pos;
+            if (pos < end && (*pos == '+' || *pos == '-')) ++pos;
+            if (!skipDigits()) return false;
+        }
+        return true;
+    }
+};
+
+class Task {
+public:
+    int id;
+    std::string title;
+    std::string description;
+    TaskStatus status;
+    int64_t create_time;
+    int64_t update_time;
+    // Starts at 1 and is bumped by every update or patch; exposed as the ETag.
+    uint64_t version;
+    TaskBody body;
+
+    Task() : id(0), status(TaskStatus::Todo), create_time(0), update_time(0), version(1) {}
+
+    Task(int id, const std::string& title, const std::string& description, TaskStatus status)
+        : id(id), title(title), description(description), status(status), version(1) {
+        setTime();
+    }
+
+    Task(int id, const std::string& title, const std::string& description, const std::string& status)
+        : Task(id, title, description, statusFromString(status)) {
+    }
+
+    void setTime() {
+        create_time = static_cast<int64_t>(std::time(nullptr));
+        update_time = create_time;
+        invalidateBody();
+    }
+
+    void updateTime() {
+        update_time = static_cast<int64_t>(std::time(nullptr));
+        invalidateBody();
+    }
+
+    void invalidateBody() {
+        body.reset();
+    }
+
+    const TaskBody& serialized() {
+        if (!body) {
+            body = std::make_shared<const std::string>(toJson().dump());
+        }
+        return body;
+    }
+
+    // Only the members selected by `fields` are formatted at all.
+    json toJson(unsigned fields = ALL_TASK_FIELDS) const {
+        try {
+            if (fields == ALL_TASK_FIELDS) {
+                return json{
+                    {"id", id},
+                    {"title", title},
+                    {"description", description},
+                    {"status", statusToString(status)},
+                    {"create_time", formatTime(create_time)},
+                    {"update_time", formatTime(update_time)},
+                    {"version", version}
+                };
+            }
+            json out = json::object();
+            if (fields & 1u << 0) out["id"] = id;
+            if (fields & 1u << 1) out["title"] = title;
+            if (fields & 1u << 2) out["description"] = description;
+            if (fields & 1u << 3) out["status"] = statusToString(status);
+            if (fields & 1u << 4) out["create_time"] = formatTime(create_time);
+            if (fields & 1u << 5) out["update_time"] = formatTime(update_time);
+            if (fields & 1u << 6) out["version"] = version;
+            return out;
+        }
+        catch (const std::exception& e) {
+            logError("error in Task::toJson: ", e.what());
+            return json{ {"error", "Failed to serialize task"} };
+        }
+    }
+
+    static Task fromPatch(TaskPatch&& patch) {
+        Task task;
+        if (patch.title) task.title = std::move(*patch.title);
+        if (patch.description) task.description = std::move(*patch.description);
+        if (patch.status) task.status = *patch.status;
+        return task;
+    }
+
+    static Task fromJson(const json& j) {
+        Task task;
+        if (j.contains("title")) task.title = j["title"];
+        if (j.contains("description")) task.description = j["description"];
+        if (j.contains("status")) task.status = statusFromString(j["status"].get<std::string>());
+        return task;
+    }
+};
+
+namespace fileio {
+#ifdef _WIN32
+    inline int openForWrite(const std::string& path, bool truncate) {
+        int fd = -1;
+        int flags = _O_WRONLY | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : _O_APPEND);
+        _sopen_s(&fd, path.c_str(), flags, _SH_DENYNO, _S_IREAD | _S_IWRITE);
+        return fd;
+    }
+
+    inline bool writeAll(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            int written = _write(fd, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+            if (written <= 0) return false;
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    inline bool sync(int fd) {
+        return _commit(fd) == 0;
+    }
+
+    inline void closeFile(int fd) {
+        _close(fd);
+    }
+
+    inline void syncDirectory(const std::string&) {
+    }
+#else
+    inline int openForWrite(const std::string& path, bool truncate) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : O_APPEND);
+        return ::open(path.c_str(), flags, 0644);
+    }
+
+    inline bool writeAll(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    inline bool sync(int fd) {
+#ifdef __APPLE__
+        return ::fsync(fd) == 0;
+#else
+        return ::fdatasync(fd) == 0;
+#endif
+    }
+
+    inline void closeFile(int fd) {
+        ::close(fd);
+    }
+
+    inline void syncDirectory(const std::string& dir) {
+        int fd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+#endif
+}
+
+// Read-only view of a whole file, used to load snapshots without copying them.
+class MappedFile {
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) return;
+        bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (bytes) length = static_cast<size_t>(size.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* mapped = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                bytes = static_cast<const char*>(mapped);
+                length = static_cast<size_t>(st.st_size);
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (bytes) ::munmap(const_cast<char*>(bytes), length);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+};
+
+inline uint32_t crc32(const char* data, size_t size, uint32_t crc = 0) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Little-endian encoding shared by the write-ahead log and snapshots.
+namespace binary {
+    inline void putU8(std::string& out, uint8_t value) {
+        out += static_cast<char>(value);
+    }
+
+    inline void putU32(std::string& out, uint32_t value) {
+        for (int i = 0; i < 4; ++i) out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+
+    inline void putU64(std::string& out, uint64_t value) {
+        for (int i = 0; i < 8; ++i) out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+
+    inline void putString(std::string& out, const std::string& value) {
+        putU32(out, static_cast<uint32_t>(value.size()));
+        out += value;
+    }
+
+    struct Reader {
+        const char* pos;
+        const char* end;
+        bool ok = true;
+
+        Reader(const char* data, size_t size) : pos(data), end(data + size) {}
+
+        bool has(size_t n) {
+            if (static_cast<size_t>(end - pos) < n) ok = false;
+            return ok;
+        }
+
+        uint8_t u8() {
+            if (!has(1)) return 0;
+            return static_cast<uint8_t>(*pos++);
+        }
+
+        uint32_t u32() {
+            if (!has(4)) return 0;
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i) value |= static_cast<uint32_t>(static_cast<uint8_t>(*pos++)) << (8 * i);
+            return value;
+        }
+
+        uint64_t u64() {
+            if (!has(8)) return 0;
+            uint64_t value = 0;
+            for (int i = 0; i < 8; ++i) value |= static_cast<uint64_t>(static_cast<uint8_t>(*pos++)) << (8 * i);
+            return value;
+        }
+
+        std::string str() {
+            uint32_t size = u32();
+            if (!has(size)) return std::string();
+            std::string value(pos, size);
+            pos += size;
+            return value;
+        }
+    };
+
+    inline void putTask(std::string& out, const Task& task) {
+        putU32(out, static_cast<uint32_t>(task.id));
+        putString(out, task.title);
+        putString(out, task.description);
+        putU8(out, static_cast<uint8_t>(task.status));
+        putU64(out, static_cast<uint64_t>(task.create_time));
+        putU64(out, static_cast<uint64_t>(task.update_time));
+        putU64(out, task.version);
+    }
+
+    inline Task getTask(Reader& in) {
+        Task task;
+        task.id = static_cast<int>(in.u32());
+        task.title = in.str();
+        task.description = in.str();
+        uint8_t status = in.u8();
+        if (status >= TASK_STATUSES.size()) in.ok = false;
+        task.status = static_cast<TaskStatus>(status < TASK_STATUSES.size() ? status : 0);
+        task.create_time = static_cast<int64_t>(in.u64());
+        task.update_time = static_cast<int64_t>(in.u64());
+        task.version = in.u64();
+        return task;
+    }
+}
+
+// A few background threads shared by many persistent storages (the tenants),
+// so each of them costs no threads of its own. Jobs are callbacks registered
+// under their owner: schedule() runs one soon, and periodic jobs also run
+// about once a second. A job never runs on two threads at once; remove()
+// waits for a running call, after which the owner may go away. Every job
+// must be removed before the workers are destroyed.
+class SharedWorkers {
+public:
+    static constexpr std::chrono::seconds TICK{ 1 };
+
+    explicit SharedWorkers(size_t threadCount) : nextTick(std::chrono::steady_clock::now() + TICK) {
+        for (size_t i = 0; i < std::max<size_t>(threadCount, 1); ++i) {
+            threads.emplace_back([this] { run(); });
+        }
+    }
+
+    ~SharedWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) thread.join();
+    }
+
+    SharedWorkers(const SharedWorkers&) = delete;
+    SharedWorkers& operator=(const SharedWorkers&) = delete;
+
+    void add(const void* owner, std::function<void()> job, bool periodic = false) {
+        std::lock_guard<std::mutex> lock(mtx);
+        Job& entry = jobs[owner];
+        entry.run = std::move(job);
+        entry.periodic = periodic;
+    }
+
+    void schedule(const void* owner) {
+        std::lock_guard<std::mutex> lock(mtx);
+        scheduleLocked(owner);
+    }
+
+    void remove(const void* owner) {
+        std::unique_lock<std::mutex> lock(mtx);
+        auto it = jobs.find(owner);
+        if (it == jobs.end()) {
+            return;
+        }
+        idle.wait(lock, [&] { return !it->second.running; });
+        queue.erase(std::remove(queue.begin(), queue.end(), owner), queue.end());
+        jobs.erase(it);
+    }
+
+private:
+    struct Job {
+        std::function<void()> run;
+        bool periodic = false;
+        bool queued = false;
+        bool running = false;
+        // Scheduled again while running: queued once the call returns.
+        bool rerun = false;
+    };
+
+    std::mutex mtx;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::map<const void*, Job> jobs;
+    std::deque<const void*> queue;
+    std::chrono::steady_clock::time_point nextTick;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    void scheduleLocked(const void* owner) {
+        auto it = jobs.find(owner);
+        if (it == jobs.end()) {
+            return;
+        }
+        Job& job = it->second;
+        if (job.running) {
+            job.rerun = true;
+        }
+        else if (!job.queued) {
+            job.queued = true;
+            queue.push_back(owner);
+            wake.notify_one();
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!stopping) {
+            if (queue.empty()) {
+                auto now = std::chrono::steady_clock::now();
+                if (now < nextTick) {
+                    wake.wait_until(lock, nextTick);
+                    continue;
+                }
+                nextTick = now + TICK;
+                for (const auto& entry : jobs) {
+                    if (entry.second.periodic) scheduleLocked(entry.first);
+                }
+                continue;
+            }
+            const void* owner = queue.front();
+            queue.pop_front();
+            // remove() waits while running is set, so the entry outlives the call.
+            Job& job = jobs.at(owner);
+            job.queued = false;
+            job.running = true;
+            lock.unlock();
+            job.run();
+            lock.lock();
+            job.running = false;
+            if (job.rerun) {
+                job.rerun = false;
+                scheduleLocked(owner);
+            }
+            idle.notify_all();
+        }
+    }
+};
+
+// Append-only write-ahead log of task mutations, split into segments named
+// after their first sequence number. A segment starts with "TODOWAL\0" and a
+// u32 format version, followed by records
+// [u32 payload size][u32 crc][payload], payload = [u64 seq][u8 op][task].
+// Writers append under their shard lock and then wait in waitDurable();
+// a single flusher writes and fsyncs whatever accumulated since the previous
+// fsync, so concurrent writers share one sync (group commit). The flusher is
+// a thread of the journal's own, or a job on `workers` when given.
+class TaskJournal {
+public:
+    enum class Op : uint8_t { Create = 1, Update = 2, Patch = 3, Delete = 4 };
+
+    TaskJournal(const std::string& dir, uint64_t lastSeq, SharedWorkers* workers = nullptr)
+        : dir(dir), lastSeq(lastSeq), durableSeq(lastSeq), workers(workers) {
+        openSegment(lastSeq + 1);
+        if (workers) {
+            workers->add(this, [this] { flush(); });
+        }
+        else {
+            flusher = std::thread([this] { flushLoop(); });
+        }
+    }
+
+    ~TaskJournal() {
+        if (workers) {
+            workers->remove(this);
+            flush();
+        }
+        else {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stopping = true;
+            }
+            pendingCv.notify_all();
+            flusher.join();
+        }
+        if (fd >= 0) fileio::closeFile(fd);
+    }
+
+    TaskJournal(const TaskJournal&) = delete;
+    TaskJournal& operator=(const TaskJournal&) = delete;
+
+    uint64_t append(Op op, const Task& task) {
+        std::string payload;
+        binary::putU8(payload, static_cast<uint8_t>(op));
+        binary::putTask(payload, task);
+        return appendPayload(payload);
+    }
+
+    uint64_t appendDelete(int id) {
+        std::string payload;
+        binary::putU8(payload, static_cast<uint8_t>(Op::Delete));
+        binary::putU32(payload, static_cast<uint32_t>(id));
+        return appendPayload(payload);
+    }
+
+    bool waitDurable(uint64_t seq) {
+        std::unique_lock<std::mutex> lock(mtx);
+        durableCv.wait(lock, [&] { return durableSeq >= seq || failed; });
+        return durableSeq >= seq;
+    }
+
+    // Closes the current segment after the records appended so far and
+    // returns the last sequence number it holds. Later records go to a new
+    // segment, so every segment at or below the returned seq can be dropped
+    // once a snapshot covering it is durable.
+    uint64_t cutSegment() {
+        std::unique_lock<std::mutex> lock(mtx);
+        uint64_t cut = lastSeq;
+        if (cut + 1 != segmentStart) {
+            beforeCut += pending;
+            pending.clear();
+            cutRequested = true;
+            cutSeq = cut;
+            wakeFlusher();
+            durableCv.wait(lock, [&] { return segmentStart > cut || failed; });
+        }
+        return cut;
+    }
+
+    void removeSegmentsThrough(uint64_t seq) {
+        for (const auto& segment : listSegments(dir)) {
+            if (segment.first <= seq && segment.first != segmentStart) {
+                std::error_code ec;
+                std::filesystem::remove(segment.second, ec);
+            }
+        }
+    }
+
+    uint64_t lastSequence() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return lastSeq;
+    }
+
+    static std::vector<std::pair<uint64_t, std::string>> listSegments(const std::string& dir) {
+        std::vector<std::pair<uint64_t, std::string>> result;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+            std::string name = entry.path().filename().string();
+            if (name.size() > 8 && name.compare(0, 4, "wal-") == 0 && name.compare(name.size() - 4, 4, ".log") == 0) {
+                try {
+                    result.emplace_back(std::stoull(name.substr(4, name.size() - 8)), entry.path().string());
+                }
+                catch (const std::exception&) {
+                }
+            }
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    // Feeds every intact record with seq > afterSeq to `apply`, in order, and
+    // returns the highest sequence number seen. A torn or corrupt record ends
+    // its segment, which is what an interrupted append looks like.
+    static uint64_t replay(const std::string& dir, uint64_t afterSeq,
+        const std::function<void(Op, Task&&)>& apply) {
+        uint64_t maxSeq = afterSeq;
+        for (const auto& segment : listSegments(dir)) {
+            MappedFile file(segment.second);
+            if (file.size() == 0) continue;
+            binary::Reader in(file.data(), file.size());
+            if (file.size() < HEADER_SIZE || std::memcmp(file.data(), MAGIC, sizeof(MAGIC)) != 0) {
+                throw std::runtime_error("Unrecognized WAL segment " + segment.second);
+            }
+            in.pos += sizeof(MAGIC);
+            if (in.u32() != FORMAT_VERSION) {
+                throw std::runtime_error("Unsupported WAL format version in " + segment.second);
+            }
+            while (in.pos < in.end) {
+                uint32_t size = in.u32();
+                uint32_t crc = in.u32();
+                if (!in.ok || !in.has(size) || crc32(in.pos, size) != crc) {
+                    if (in.pos < in.end) {
+                        logWarn("WAL: truncated or corrupt record in ", segment.second);
+                    }
+                    break;
+                }
+                binary::Reader record(in.pos, size);
+                in.pos += size;
+
+                uint64_t seq = record.u64();
+                Op op = static_cast<Op>(record.u8());
+                Task task;
+                if (op == Op::Delete) {
+                    task.id = static_cast<int>(record.u32());
+                }
+                else {
+                    task = binary::getTask(record);
+                }
+                if (!record.ok || seq <= afterSeq) continue;
+                apply(op, std::move(task));
+                maxSeq = std::max(maxSeq, seq);
+            }
+        }
+        return maxSeq;
+    }
+
+private:
+    static constexpr uint32_t FORMAT_VERSION = 3;
+    static constexpr char MAGIC[8] = { 'T', 'O', 'D', 'O', 'W', 'A', 'L', '\0' };
+    static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 4;
+
+    std::string dir;
+    std::mutex mtx;
+    std::condition_variable pendingCv;
+    std::condition_variable durableCv;
+    std::string pending;
+    std::string beforeCut;
+    bool cutRequested = false;
+    uint64_t cutSeq = 0;
+    uint64_t lastSeq;
+    uint64_t durableSeq;
+    uint64_t segmentStart = 0;
+    bool failed = false;
+    bool stopping = false;
+    int fd = -1;
+    SharedWorkers* workers;
+    std::thread flusher;
+
+    uint64_t appendPayload(const std::string& payload) {
+        std::lock_guard<std::mutex> lock(mtx);
+        uint64_t seq = ++lastSeq;
+        std::string record;
+        binary::putU64(record, seq);
+        record += payload;
+        binary::putU32(pending, static_cast<uint32_t>(record.size()));
+        binary::putU32(pending, crc32(record.data(), record.size()));
+        pending += record;
+        wakeFlusher();
+        return seq;
+    }
+
+    // Called with mtx held.
+    void wakeFlusher() {
+        if (workers) workers->schedule(this);
+        else pendingCv.notify_one();
+    }
+
+    static std::string segmentName(const std::string& dir, uint64_t firstSeq) {
+        std::ostringstream oss;
+        oss << "wal-" << std::setw(20) << std::setfill('0') << firstSeq << ".log";
+        return (std::filesystem::path(dir) / oss.str()).string();
+    }
+
+    // Returns the descriptor of a new, empty segment with its header synced, or -1.
+    int createSegment(uint64_t firstSeq) {
+        int segment = fileio::openForWrite(segmentName(dir, firstSeq), true);
+        if (segment < 0) {
+            return -1;
+        }
+        std::string header(MAGIC, sizeof(MAGIC));
+        binary::putU32(header, FORMAT_VERSION);
+        if (!fileio::writeAll(segment, header.data(), header.size()) || !fileio::sync(segment)) {
+            fileio::closeFile(segment);
+            return -1;
+        }
+        fileio::syncDirectory(dir);
+        return segment;
+    }
+
+    void openSegment(uint64_t firstSeq) {
+        fd = createSegment(firstSeq);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open WAL segment in " + dir);
+        }
+        segmentStart = firstSeq;
+    }
+
+    void flushLoop() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            pendingCv.wait(lock, [this] { return stopping || cutRequested || !pending.empty(); });
+            if (stopping && !cutRequested && pending.empty()) break;
+            flushBatch(lock);
+        }
+    }
+
+    // The shared-workers job.
+    void flush() {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (cutRequested || !pending.empty()) {
+            flushBatch(lock);
+        }
+    }
+
+    // Writes (and cuts) what is pending; unlocks `lock` around the I/O.
+    void flushBatch(std::unique_lock<std::mutex>& lock) {
+        bool cut = cutRequested;
+        uint64_t cutAt = cutSeq;
+        uint64_t batchSeq = lastSeq;
+        std::string older;
+        std::string batch;
+        older.swap(beforeCut);
+        batch.swap(pending);
+        cutRequested = false;
+        lock.unlock();
+
+        bool ok = true;
+        uint64_t newStart = 0;
+        if (cut) {
+            ok = fileio::writeAll(fd, older.data(), older.size()) && fileio::sync(fd);
+            fileio::closeFile(fd);
+            fd = createSegment(cutAt + 1);
+            ok = ok && fd >= 0;
+            newStart = cutAt + 1;
+        }
+        if (ok && !batch.empty()) {
+            ok = fileio::writeAll(fd, batch.data(), batch.size()) && fileio::sync(fd);
+        }
+
+        lock.lock();
+        if (cut) segmentStart = newStart;
+        if (ok) {
+            durableSeq = batchSeq;
+        }
+        else {
+            failed = true;
+            logError("WAL: write to ", dir, " failed");
+        }
+        durableCv.notify_all();
+    }
+};
+
+struct PersistenceOptions {
+    std::string dataDir;
+    uint64_t snapshotEveryRecords = 100000;
+    std::chrono::seconds snapshotInterval{ 300 };
+    // Shared threads for the WAL flusher and the snapshot checks; null gives
+    // the storage one thread of its own for each. Snapshots wait for their
+    // WAL cut, so the two must not be the same workers.
+    SharedWorkers* journalWorkers = nullptr;
+    SharedWorkers* snapshotWorkers = nullptr;
+};
+
+inline std::string toJsonArray(const std::vector<TaskBody>& bodies) {
+    size_t size = 2;
+    for (const auto& body : bodies) {
+        size += body->size() + 1;
+    }
+    std::string result;
+    result.reserve(size);
+    result += '[';
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        if (i > 0) result += ',';
+        result += *bodies[i];
+    }
+    result += ']';
+    return result;
+}
+
+// Representations of task payloads. The JSON body cached on every Task is
+// the source; MessagePack and CBOR are produced from the same document.
+enum class WireFormat : uint8_t { Json, MsgPack, Cbor };
+
+const std::array<const char*, 3> WIRE_FORMAT_TYPES = { "application/json", "application/msgpack", "application/cbor" };
+
+// Format named by a Content-Type (or one Accept) value; anything that is not
+// MessagePack or CBOR counts as JSON.
+inline WireFormat wireFormatOf(std::string_view mediaType) {
+    size_t end = mediaType.find(';');
+    mediaType = mediaType.substr(0, end);
+    while (!mediaType.empty() && mediaType.front() == ' ') mediaType.remove_prefix(1);
+    while (!mediaType.empty() && mediaType.back() == ' ') mediaType.remove_suffix(1);
+    if (mediaType == "application/msgpack" || mediaType == "application/x-msgpack" || mediaType == "application/vnd.msgpack") {
+        return WireFormat::MsgPack;
+    }
+    if (mediaType == "application/cbor") {
+        return WireFormat::Cbor;
+    }
+    return WireFormat::Json;
+}
+
+// Response format for an Accept header: the first binary format it lists
+// (unless refused with q=0), JSON otherwise.
+inline WireFormat acceptedWireFormat(std::string_view accept) {
+    size_t start = 0;
+    while (start < accept.size()) {
+        size_t end = accept.find(',', start);
+        if (end == std::string_view::npos) end = accept.size();
+        std::string_view item = accept.substr(start, end - start);
+        start = end + 1;
+        WireFormat format = wireFormatOf(item);
+        size_t q = item.find("q=");
+        if (format != WireFormat::Json && (q == std::string_view::npos || std::strtod(std::string(item.substr(q + 2)).c_str(), nullptr) > 0)) {
+            return format;
+        }
+    }
+    return WireFormat::Json;
+}
+
+inline std::string encodeWireFormat(WireFormat format, const json& document) {
+    std::string out;
+    if (format == WireFormat::MsgPack) json::to_msgpack(document, out);
+    else if (format == WireFormat::Cbor) json::to_cbor(document, out);
+    else out = document.dump();
+    return out;
+}
+
+// Decodes a request body; returns false (with `detail`) on malformed input,
+// including binary strings that are not valid UTF-8 and so could never be
+// serialized back as JSON.
+inline bool decodeWireFormat(WireFormat format, const std::string& body, json& document, std::string& detail) {
+    if (format == WireFormat::Json) {
+        try {
+            document = json::parse(body);
+            return true;
+        }
+        catch (const json::parse_error& e) {
+            detail = e.what();
+            return false;
+        }
+    }
+    try {
+        document = format == WireFormat::MsgPack ? json::from_msgpack(body) : json::from_cbor(body);
+        (void)document.dump();
+        return true;
+    }
+    catch (const json::exception& e) {
+        detail = e.what();
+        return false;
+    }
+}
+
+struct TaskPage {
+    std::vector<TaskBody> bodies;
+    int nextCursor = 0;
+    // update_time of the nextCursor task, for pages in update_time order.
+    int64_t nextTime = 0;
+};
+
+// Filters and order of a listing beyond ?status=.
+struct TaskQuery {
+    enum class Order : uint8_t { Id, UpdateTime, UpdateTimeDesc };
+
+    int status = -1;
+    int64_t updatedSince = INT64_MIN;   // update_time >= updatedSince
+    int64_t createdBefore = INT64_MAX;  // create_time < createdBefore
+    Order order = Order::Id;
+    unsigned fields = ALL_TASK_FIELDS;
+
+    // Whether the query only pages through ids, optionally by status.
+    bool byIdOnly() const {
+        return order == Order::Id && updatedSince == INT64_MIN && createdBefore == INT64_MAX;
+    }
+
+    bool matches(const Task& task) const {
+        return (status < 0 || static_cast<int>(task.status) == status)
+            && task.update_time >= updatedSince && task.create_time < createdBefore;
+    }
+};
+
+struct BatchOperation {
+    enum class Kind { Create, Patch, Delete };
+
+    Kind kind = Kind::Create;
+    int id = 0;
+    Task task;
+    TaskPatch fields;
+};
+
+struct BatchResult {
+    int status = 0;
+    int id = 0;
+    TaskBody body;
+};
+
+// Bounded in-memory log of task changes. Sequence numbers start at 1 and only
+// the newest `capacity` events are kept; a reader that falls further behind
+// (or asks for a sequence this process never issued) has to resynchronize
+// from a full listing.
+class ChangeFeed {
+public:
+    enum class Kind : uint8_t { Create, Update, Delete };
+
+    struct Event {
+        uint64_t seq = 0;
+        Kind kind = Kind::Create;
+        int id = 0;
+        TaskBody body;
+        // Epoch seconds of the task, for replication; the body has them only
+        // as local time strings.
+        int64_t createTime = 0;
+        int64_t updateTime = 0;
+    };
+
+    static constexpr size_t DEFAULT_CAPACITY = 65536;
+
+    // The ring holds the last `capacity` events; it grows as events arrive,
+    // so a quiet feed costs next to nothing.
+    explicit ChangeFeed(size_t capacity = DEFAULT_CAPACITY) : capacity(std::max<size_t>(capacity, 1)) {}
+
+    // Called with the task's shard lock held, so events of one task are
+    // published in the order they were applied.
+    void publish(Kind kind, int id, TaskBody body, int64_t createTime = 0, int64_t updateTime = 0) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            uint64_t seq = ++lastSeq;
+            if (ring.size() < capacity) {
+                if (ring.size() == ring.capacity()) {
+                    ring.reserve(std::min(capacity, std::max<size_t>(64, 2 * ring.size())));
+                }
+                ring.emplace_back();
+            }
+            Event& event = ring[(seq - 1) % capacity];
+            event.seq = seq;
+            event.kind = kind;
+            event.id = id;
+            event.body = std::move(body);
+            event.createTime = createTime;
+            event.updateTime = updateTime;
+        }
+        cv.notify_all();
+    }
+
+    uint64_t lastSequence() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return lastSeq;
+    }
+
+    uint64_t oldestSequence() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return oldest();
+    }
+
+    // Appends up to `limit` events with seq > since. Returns false when the
+    // events right after `since` are no longer (or were never) in the ring.
+    bool read(uint64_t since, size_t limit, std::vector<Event>& out) const {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (since > lastSeq || since + 1 < oldest()) {
+            return false;
+        }
+        for (uint64_t seq = since + 1; seq <= lastSeq && limit > 0; ++seq, --limit) {
+            out.push_back(ring[(seq - 1) % capacity]);
+        }
+        return true;
+    }
+
+    // Waits until an event after `since` exists, the timeout passes or the
+    // feed is closed. Returns true when there is something to read.
+    bool wait(uint64_t since, std::chrono::milliseconds timeout) const {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait_for(lock, timeout, [&] { return closed || lastSeq != since; });
+        return lastSeq != since;
+    }
+
+    // Wakes every waiter; used on shutdown so no request thread stays parked.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+
+    bool isClosed() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return closed;
+    }
+
+    // Memory of the ring itself; the bodies it holds are mostly shared with
+    // stored tasks.
+    size_t memoryBytes() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return ring.capacity() * sizeof(Event);
+    }
+
+    // withTimes adds the epoch seconds, which replication records need to
+    // restore a task exactly whatever the follower's time zone.
+    static std::string toJson(const Event& event, bool withTimes = false) {
+        static const char* kinds[] = { "create", "update", "delete" };
+        std::string out = "{\"seq\":" + std::to_string(event.seq) + ",\"op\":\""
+            + kinds[static_cast<size_t>(event.kind)] + "\",\"id\":" + std::to_string(event.id);
+        if (withTimes) {
+            out += ",\"create_time\":" + std::to_string(event.createTime)
+                + ",\"update_time\":" + std::to_string(event.updateTime);
+        }
+        if (event.body) {
+            out += ",\"task\":";
+            out += *event.body;
+        }
+        out += '}';
+        return out;
+    }
+
+private:
+    size_t capacity;
+    std::vector<Event> ring;
+    uint64_t lastSeq = 0;
+    bool closed = false;
+    mutable std::mutex mtx;
+    mutable std::condition_variable cv;
+
+    uint64_t oldest() const {
+        return lastSeq < capacity ? 1 : lastSeq - capacity + 1;
+    }
+};
+
+// Search terms of a text: maximal runs of ASCII letters and digits (lowered)
+// or non-ASCII UTF-8 bytes, at most MAX_TERM_LENGTH bytes each, sorted and
+// without duplicates.
+inline std::vector<std::string> searchTerms(std::string_view text) {
+    const size_t MAX_TERM_LENGTH = 64;
+    std::vector<std::string> terms;
+    std::string term;
+    auto finish = [&] {
+        if (!term.empty()) terms.push_back(std::move(term));
+        term.clear();
+    };
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (std::isalnum(byte) || byte >= 0x80) {
+            if (term.size() < MAX_TERM_LENGTH) term += static_cast<char>(byte < 0x80 ? std::tolower(byte) : byte);
+        }
+        else {
+            finish();
+        }
+    }
+    finish();
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    return terms;
+}
+
+// Primary id -> Task index of one TaskStorage shard. Writers always hold the
+// shard's exclusive lock. Readers hold its shared lock, unless lockFreeReads()
+// is true: then they only pin an EpochGuard and may run alongside writers.
+class TaskIndex {
+public:
+    using Visitor = bool (*)(void* context, const Task& task);
+
+    virtual ~TaskIndex() = default;
+
+    virtual bool lockFreeReads() const { return false; }
+
+    virtual const Task* find(int id) const = 0;
+
+    // Calls `visit` for every task with id > afterId in ascending id order,
+    // until it returns false.
+    virtual void scan(int afterId, Visitor visit, void* context) const = 0;
+
+    virtual size_t size() const = 0;
+
+    // Adds the task or replaces the one with the same id.
+    virtual void insert(Task&& task) = 0;
+
+    // Returns the task for the writer to change in place, or nullptr. The
+    // change becomes visible to readers at commitUpdate; the pointer stays
+    // valid until the next write to this index.
+    virtual Task* beginUpdate(int id) = 0;
+
+    virtual void commitUpdate(int /*id*/) {}
+
+    virtual bool erase(int id) = 0;
+
+    template <class Fn>
+    void forEach(int afterId, Fn&& fn) const {
+        using Callable = std::remove_reference_t<Fn>;
+        scan(afterId, [](void* context, const Task& task) { return (*static_cast<Callable*>(context))(task); },
+            const_cast<void*>(static_cast<const void*>(&fn)));
+    }
+};
+
+// Ordered map guarded by the shard lock; the default backend. A pooled map
+// takes its nodes from a pool owned by the index instead of the global heap:
+// nodes freed by a delete are reused by the next create of the shard, and,
+// as every allocation happens under the shard's exclusive lock, the pool
+// needs no synchronization of its own. Short titles and descriptions live
+// inside the node (small-string buffer) and come from the pool with it.
+class MapTaskIndex : public TaskIndex {
+public:
+    explicit MapTaskIndex(bool pooled = false)
+        : pool(pooled ? std::make_unique<std::pmr::unsynchronized_pool_resource>() : nullptr),
+          tasks(pool ? static_cast<std::pmr::memory_resource*>(pool.get()) : std::pmr::new_delete_resource()) {}
+
+    const Task* find(int id) const override {
+        auto it = tasks.find(id);
+        return it == tasks.end() ? nullptr : &it->second;
+    }
+
+    void scan(int afterId, Visitor visit, void* context) const override {
+        for (auto it = tasks.upper_bound(afterId); it != tasks.end(); ++it) {
+            if (!visit(context, it->second)) return;
+        }
+    }
+
+    size_t size() const override {
+        return tasks.size();
+    }
+
+    void insert(Task&& task) override {
+        auto it = tasks.lower_bound(task.id);
+        if (it != tasks.end() && it->first == task.id) {
+            it->second = std::move(task);
+        }
+        else {
+            int id = task.id;
+            tasks.emplace_hint(it, id, std::move(task));
+        }
+    }
+
+    Task* beginUpdate(int id) override {
+        auto it = tasks.find(id);
+        return it == tasks.end() ? nullptr : &it->second;
+    }
+
+    bool erase(int id) override {
+        return tasks.erase(id) > 0;
+    }
+
+private:
+    std::unique_ptr<std::pmr::unsynchronized_pool_resource> pool;
+    std::pmr::map<int, Task> tasks;
+};
+
+// Slab index guarded by the shard lock. Ids are handed out densely by
+// TaskStorage::nextId, so a task lives inline at slot id / stride of a paged
+// array and a bitmap marks the occupied slots: lookups are one shift and two
+// loads, scans walk the bitmap a word at a time, and pages are added without
+// moving the tasks already stored.
+class FlatTaskIndex : public TaskIndex {
+public:
+    static constexpr size_t PAGE_BITS = 12;
+    static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_BITS;
+
+    explicit FlatTaskIndex(size_t stride) : stride(stride == 0 ? 1 : stride) {}
+
+    const Task* find(int id) const override {
+        if (id <= 0) return nullptr;
+        size_t local = static_cast<size_t>(id) / stride;
+        return occupied(local) ? &at(local) : nullptr;
+    }
+
+    void scan(int afterId, Visitor visit, void* context) const override {
+        size_t local = afterId > 0 ? static_cast<size_t>(afterId) / stride : 0;
+        for (size_t word = local / 64; word < live.size(); ++word) {
+            uint64_t bits = live[word];
+            if (word == local / 64) {
+                bits &= ~uint64_t(0) << (local % 64);
+            }
+            while (bits) {
+                const Task& task = at(word * 64 + lowestBit(bits));
+                bits &= bits - 1;
+                if (task.id > afterId && !visit(context, task)) return;
+            }
+        }
+    }
+
+    size_t size() const override {
+        return count;
+    }
+
+    void insert(Task&& task) override {
+        size_t local = static_cast<size_t>(task.id) / stride;
+        while (local >= pages.size() * PAGE_SIZE) {
+            pages.push_back(std::make_unique<Task[]>(PAGE_SIZE));
+            live.resize(pages.size() * PAGE_SIZE / 64, 0);
+        }
+        if (!occupied(local)) {
+            live[local / 64] |= uint64_t(1) << (local % 64);
+            ++count;
+        }
+        at(local) = std::move(task);
+    }
+
+    Task* beginUpdate(int id) override {
+        return const_cast<Task*>(find(id));
+    }
+
+    bool erase(int id) override {
+        if (!find(id)) return false;
+        size_t local = static_cast<size_t>(id) / stride;
+        live[local / 64] &= ~(uint64_t(1) << (local % 64));
+        at(local) = Task();
+        --count;
+        return true;
+    }
+
+private:
+    size_t stride;
+    std::vector<std::unique_ptr<Task[]>> pages;
+    std::vector<uint64_t> live;
+    size_t count = 0;
+
+    bool occupied(size_t local) const {
+        return local / 64 < live.size() && (live[local / 64] >> (local % 64) & 1) != 0;
+    }
+
+    Task& at(size_t local) const {
+        return pages[local >> PAGE_BITS][local & (PAGE_SIZE - 1)];
+    }
+
+    static size_t lowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return index;
+#else
+        return static_cast<size_t>(__builtin_ctzll(bits));
+#endif
+    }
+};
+
+// Read-copy-update index. Every task is an immutable node published through
+// an atomic pointer in a slot table indexed by id / stride (shard ids are
+// congruent modulo the shard count, so slots are dense and in id order).
+// Writers copy a node, change the copy and swap it in; replaced nodes and
+// outgrown slot directories are freed through epoch-based reclamation.
+// Lookups and ordered scans therefore never wait, not even for a writer of
+// the same shard.
+class RcuTaskIndex : public TaskIndex {
+public:
+    static constexpr size_t CHUNK_BITS = 10;
+    static constexpr size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+
+    explicit RcuTaskIndex(size_t stride) : stride(stride == 0 ? 1 : stride), directory(new Directory(16)) {}
+
+    ~RcuTaskIndex() override {
+        Directory* dir = directory.load();
+        for (auto& slot : dir->chunks) {
+            Chunk* chunk = slot.load();
+            if (!chunk) continue;
+            for (auto& task : chunk->tasks) delete task.load();
+            delete chunk;
+        }
+        delete dir;
+    }
+
+    bool lockFreeReads() const override { return true; }
+
+    const Task* find(int id) const override {
+        if (id <= 0) return nullptr;
+        size_t local = static_cast<size_t>(id) / stride;
+        const Chunk* chunk = chunkAt(local >> CHUNK_BITS);
+        return chunk ? chunk->tasks[local & (CHUNK_SIZE - 1)].load(std::memory_order_acquire) : nullptr;
+    }
+
+    void scan(int afterId, Visitor visit, void* context) const override {
+        size_t end = highWater.load(std::memory_order_acquire);
+        size_t local = afterId > 0 ? static_cast<size_t>(afterId) / stride : 0;
+        while (local < end) {
+            const Chunk* chunk = chunkAt(local >> CHUNK_BITS);
+            if (!chunk || chunk->live.load(std::memory_order_acquire) == 0) {
+                local = (local | (CHUNK_SIZE - 1)) + 1;
+                continue;
+            }
+            const Task* task = chunk->tasks[local & (CHUNK_SIZE - 1)].load(std::memory_order_acquire);
+            if (task && task->id > afterId && !visit(context, *task)) return;
+            ++local;
+        }
+    }
+
+    size_t size() const override {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    void insert(Task&& task) override {
+        size_t local = static_cast<size_t>(task.id) / stride;
+        std::atomic<const Task*>& slot = slotFor(local);
+        const Task* old = slot.exchange(new Task(std::move(task)), std::memory_order_acq_rel);
+        if (old) {
+            retiredTasks.retire(old);
+        }
+        else {
+            chunkAt(local >> CHUNK_BITS)->live.fetch_add(1, std::memory_order_release);
+            count.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (local >= highWater.load(std::memory_order_relaxed)) {
+            highWater.store(local + 1, std::memory_order_release);
+        }
+    }
+
+    Task* beginUpdate(int id) override {
+        const Task* current = find(id);
+        if (!current) return nullptr;
+        pending = std::make_unique<Task>(*current);
+        return pending.get();
+    }
+
+    void commitUpdate(int id) override {
+        if (!pending) return;
+        size_t local = static_cast<size_t>(id) / stride;
+        const Task* old = slotFor(local).exchange(pending.release(), std::memory_order_acq_rel);
+        if (old) retiredTasks.retire(old);
+    }
+
+    bool erase(int id) override {
+        if (!find(id)) return false;
+        size_t local = static_cast<size_t>(id) / stride;
+        const Task* old = slotFor(local).exchange(nullptr, std::memory_order_acq_rel);
+        chunkAt(local >> CHUNK_BITS)->live.fetch_sub(1, std::memory_order_release);
+        count.fetch_sub(1, std::memory_order_relaxed);
+        retiredTasks.retire(old);
+        return true;
+    }
+
+private:
+    struct Chunk {
+        std::array<std::atomic<const Task*>, CHUNK_SIZE> tasks{};
+        std::atomic<size_t> live{ 0 };
+    };
+
+    // Chunks are never freed before the index; only directories are replaced.
+    struct Directory {
+        explicit Directory(size_t capacity) : chunks(capacity) {}
+        std::vector<std::atomic<Chunk*>> chunks;
+    };
+
+    size_t stride;
+    std::atomic<Directory*> directory;
+    std::atomic<size_t> highWater{ 0 };
+    std::atomic<size_t> count{ 0 };
+    std::unique_ptr<Task> pending;
+    RetireList<Task> retiredTasks;
+    RetireList<Directory> retiredDirectories;
+
+    const Chunk* chunkAt(size_t index) const {
+        const Directory* dir = directory.load(std::memory_order_acquire);
+        return index < dir->chunks.size() ? dir->chunks[index].load(std::memory_order_acquire) : nullptr;
+    }
+
+    Chunk* chunkAt(size_t index) {
+        return const_cast<Chunk*>(static_cast<const RcuTaskIndex*>(this)->chunkAt(index));
+    }
+
+    // Writer side: grows the directory and allocates the chunk as needed.
+    std::atomic<const Task*>& slotFor(size_t local) {
+        size_t index = local >> CHUNK_BITS;
+        Directory* dir = directory.load(std::memory_order_relaxed);
+        if (index >= dir->chunks.size()) {
+            auto grown = new Directory(std::max(dir->chunks.size() * 2, index + 1));
+            for (size_t i = 0; i < dir->chunks.size(); ++i) {
+                grown->chunks[i].store(dir->chunks[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            directory.store(grown, std::memory_order_release);
+            retiredDirectories.retire(dir);
+            dir = grown;
+        }
+        Chunk* chunk = dir->chunks[index].load(std::memory_order_relaxed);
+        if (!chunk) {
+            chunk = new Chunk();
+            dir->chunks[index].store(chunk, std::memory_order_release);
+        }
+        return chunk->tasks[local & (CHUNK_SIZE - 1)];
+    }
+};
+
+class TaskStorage {
+private:
+    struct Shard {
+        std::unique_ptr<TaskIndex> tasks;
+        std::array<std::set<int>, TASK_STATUSES.size()> byStatus;
+        // Inverted index: search term -> ascending ids of tasks whose title
+        // or description contains it.
+        std::unordered_map<std::string, std::vector<int>> terms;
+        std::set<std::pair<int64_t, int>> byCreateTime;
+        std::set<std::pair<int64_t, int>> byUpdateTime;
+        mutable std::shared_mutex mtx;
+    };
+
+    // Shard locks report wait and hold times to Metrics.
+    using ReadLock = TimedLock<std::shared_lock<std::shared_mutex>, Metrics::LockMode::Read>;
+    using WriteLock = TimedLock<std::unique_lock<std::shared_mutex>, Metrics::LockMode::Write>;
+
+    // Read access to a shard: an epoch pin for lock-free indexes, the shared
+    // lock otherwise.
+    class ShardReader {
+    public:
+        explicit ShardReader(const Shard& shard) {
+            if (shard.tasks->lockFreeReads()) epoch.emplace();
+            else lock.emplace(shard.mtx);
+        }
+
+    private:
+        std::optional<EpochGuard> epoch;
+        std::optional<ReadLock> lock;
+    };
+
+    StorageBackend backend;
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<int> nextId{ 1 };
+    std::array<std::atomic<size_t>, TASK_STATUSES.size()> statusCounts{};
+    // Sum of footprintOf() over all stored tasks.
+    std::atomic<size_t> taskBytes{ 0 };
+    // Bumped inside the shard lock by every change, once the change is visible
+    // to readers (after insert, erase or commitUpdate) and before the lock is
+    // released, so a lock-free reader never sees a version ahead of the data.
+    std::atomic<uint64_t> storageVersion{ 0 };
+    ChangeFeed feed;
+
+    static constexpr uint32_t SNAPSHOT_VERSION = 3;
+
+    PersistenceOptions persistence;
+    std::unique_ptr<TaskJournal> journal;
+    std::thread snapshotThread;
+    std::mutex snapshotMtx;
+    std::condition_variable snapshotCv;
+    bool stopSnapshots = false;
+    uint64_t snapshotSeq = 0;
+    std::chrono::steady_clock::time_point lastSnapshot;
+
+    Shard& shardFor(int id) const {
+        return *shards[static_cast<size_t>(id) % shards.size()];
+    }
+
+    // The cached body, or a projection of `fields` serialized for this call.
+    static TaskBody bodyOf(const Task& task, unsigned fields = ALL_TASK_FIELDS) {
+        if (task.body && fields == ALL_TASK_FIELDS) {
+            return task.body;
+        }
+        return std::make_shared<const std::string>(task.toJson(fields).dump());
+    }
+
+    // Orders entries collected from every shard and keeps the first `limit`.
+    TaskPage pageOf(std::vector<std::pair<int, TaskBody>>& entries, size_t limit) const {
+        if (shards.size() > 1) {
+            std::sort(entries.begin(), entries.end(),
+                [](const auto& a, const auto& b) { return a.first < b.first; });
+        }
+
+        TaskPage page;
+        if (entries.size() > limit) {
+            entries.resize(limit);
+            page.nextCursor = entries.empty() ? 0 : entries.back().first;
+        }
+        page.bodies = sortedBodies(entries, false);
+        return page;
+    }
+
+    static std::vector<TaskBody> sortedBodies(std::vector<std::pair<int, TaskBody>>& entries, bool sort) {
+        if (sort) {
+            std::sort(entries.begin(), entries.end(),
+                [](const auto& a, const auto& b) { return a.first < b.first; });
+        }
+        std::vector<TaskBody> bodies;
+        bodies.reserve(entries.size());
+        for (auto& entry : entries) {
+            bodies.push_back(std::move(entry.second));
+        }
+        return bodies;
+    }
+
+    // Secondary indexes are maintained under the owning shard's exclusive lock;
+    // readers of lock-free shards cannot use them and filter a scan instead.
+    void indexTask(Shard& shard, const Task& task) {
+        indexStatus(shard, task);
+        indexText(shard, task);
+        shard.byCreateTime.emplace(task.create_time, task.id);
+        shard.byUpdateTime.emplace(task.update_time, task.id);
+    }
+
+    void unindexTask(Shard& shard, const Task& task) {
+        unindexStatus(shard, task);
+        unindexText(shard, task);
+        shard.byCreateTime.erase({ task.create_time, task.id });
+        shard.byUpdateTime.erase({ task.update_time, task.id });
+    }
+
+    void indexStatus(Shard& shard, const Task& task) {
+        size_t slot = static_cast<size_t>(task.status);
+        shard.byStatus[slot].insert(task.id);
+        ++statusCounts[slot];
+    }
+
+    void unindexStatus(Shard& shard, const Task& task) {
+        size_t slot = static_cast<size_t>(task.status);
+        if (shard.byStatus[slot].erase(task.id) > 0) {
+            --statusCounts[slot];
+        }
+    }
+
+    static std::vector<std::string> termsOf(const Task& task) {
+        return searchTerms(task.title + ' ' + task.description);
+    }
+
+    // Ids are handed out in increasing order, so a create appends to the end
+    // of each posting list; only updates of older tasks insert in the middle.
+    void indexText(Shard& shard, const Task& task) {
+        for (auto& term : termsOf(task)) {
+            auto& ids = shard.terms[std::move(term)];
+            auto pos = std::lower_bound(ids.begin(), ids.end(), task.id);
+            if (pos == ids.end() || *pos != task.id) {
+                ids.insert(pos, task.id);
+            }
+        }
+    }
+
+    void unindexText(Shard& shard, const Task& task) {
+        for (const auto& term : termsOf(task)) {
+            auto it = shard.terms.find(term);
+            if (it == shard.terms.end()) continue;
+            auto& ids = it->second;
+            auto pos = std::lower_bound(ids.begin(), ids.end(), task.id);
+            if (pos != ids.end() && *pos == task.id) {
+                ids.erase(pos);
+            }
+            if (ids.empty()) {
+                shard.terms.erase(it);
+            }
+        }
+    }
+
+    // Appends up to `limit` (id, body) pairs of tasks with id > afterId that
+    // contain every term, intersecting the shard's posting lists from the
+    // shortest one. Needs the shard lock even for lock-free backends.
+    void collectMatches(const Shard& shard, const std::vector<std::string>& terms, int afterId, size_t limit,
+        int status, std::vector<std::pair<int, TaskBody>>& entries) const {
+        std::vector<const std::vector<int>*> lists;
+        for (const auto& term : terms) {
+            auto it = shard.terms.find(term);
+            if (it == shard.terms.end()) return;
+            lists.push_back(&it->second);
+        }
+        std::sort(lists.begin(), lists.end(), [](const auto* a, const auto* b) { return a->size() < b->size(); });
+
+        std::vector<std::vector<int>::const_iterator> positions;
+        for (const auto* list : lists) positions.push_back(list->begin());
+        size_t taken = 0;
+        const auto& shortest = *lists[0];
+        for (auto it = std::upper_bound(shortest.begin(), shortest.end(), afterId); it != shortest.end() && taken < limit; ++it) {
+            bool everywhere = true;
+            for (size_t i = 1; i < lists.size() && everywhere; ++i) {
+                positions[i] = std::lower_bound(positions[i], lists[i]->end(), *it);
+                everywhere = positions[i] != lists[i]->end() && *positions[i] == *it;
+            }
+            if (!everywhere) continue;
+            const Task* task = shard.tasks->find(*it);
+            if (task && (status < 0 || static_cast<int>(task->status) == status)) {
+                entries.emplace_back(*it, bodyOf(*task));
+                ++taken;
+            }
+        }
+    }
+
+    // Appends up to `limit` (update_time, id, body) entries of one shard for
+    // queryTasks, walking the time index that bounds the query. Id-ordered
+    // queries cannot stop early on a time index, so the shard's matches are
+    // sorted by id and trimmed instead.
+    void collectQuery(const Shard& shard, const TaskQuery& query, int64_t afterTime, int afterId, size_t limit,
+        std::vector<std::tuple<int64_t, int, TaskBody>>& entries) const {
+        auto add = [&](int id) {
+            const Task* task = shard.tasks->find(id);
+            if (!task || !query.matches(*task)) return false;
+            entries.emplace_back(task->update_time, id, bodyOf(*task, query.fields));
+            return true;
+        };
+        const auto& byUpdate = shard.byUpdateTime;
+        auto since = byUpdate.lower_bound({ query.updatedSince, INT_MIN });
+        size_t taken = 0;
+
+        if (query.order == TaskQuery::Order::UpdateTime) {
+            auto it = since;
+            if (afterId != 0 && afterTime >= query.updatedSince) {
+                it = byUpdate.upper_bound({ afterTime, afterId });
+            }
+            for (; it != byUpdate.end() && taken < limit; ++it) {
+                if (add(it->second)) ++taken;
+            }
+            return;
+        }
+        if (query.order == TaskQuery::Order::UpdateTimeDesc) {
+            auto it = afterId == 0 ? byUpdate.end() : byUpdate.lower_bound({ afterTime, afterId });
+            while (it != byUpdate.begin() && taken < limit) {
+                --it;
+                if (it->first < query.updatedSince) break;
+                if (add(it->second)) ++taken;
+            }
+            return;
+        }
+
+        size_t first = entries.size();
+        if (query.updatedSince != INT64_MIN) {
+            for (auto it = since; it != byUpdate.end(); ++it) {
+                if (it->second > afterId) add(it->second);
+            }
+        }
+        else {
+            auto end = shard.byCreateTime.lower_bound({ query.createdBefore, INT_MIN });
+            for (auto it = shard.byCreateTime.begin(); it != end; ++it) {
+                if (it->second > afterId) add(it->second);
+            }
+        }
+        auto byId = [](const auto& a, const auto& b) { return std::get<1>(a) < std::get<1>(b); };
+        if (entries.size() - first > limit) {
+            std::nth_element(entries.begin() + first, entries.begin() + first + limit, entries.end(), byId);
+            entries.resize(first + limit);
+        }
+    }
+
+    // Approximate memory held by a stored task: the object, its strings and
+    // its cached body (shared with in-flight responses, counted once here).
+    // Sizes rather than capacities, so a copy made for an update is charged
+    // exactly what the original was.
+    static size_t footprintOf(const Task& task) {
+        return sizeof(Task) + task.title.size() + task.description.size()
+            + (task.body ? sizeof(std::string) + task.body->size() : 0);
+    }
+
+    void storeTask(Shard& shard, Task&& task) {
+        if (const Task* old = shard.tasks->find(task.id)) {
+            unindexTask(shard, *old);
+            taskBytes -= footprintOf(*old);
+        }
+        indexTask(shard, task);
+        taskBytes += footprintOf(task);
+        shard.tasks->insert(std::move(task));
+        ++storageVersion;
+    }
+
+    // Precondition of a conditional write, checked under the shard's write
+    // lock so no other writer can slip in between check and change.
+    static bool versionMatches(const Shard& shard, int id, uint64_t expectedVersion, uint64_t* version) {
+        if (expectedVersion == 0) {
+            return true;
+        }
+        const Task* task = shard.tasks->find(id);
+        if (task && task->version != expectedVersion) {
+            if (version) *version = task->version;
+            return false;
+        }
+        return true;
+    }
+
+    bool eraseTask(Shard& shard, int id) {
+        const Task* task = shard.tasks->find(id);
+        if (!task) {
+            return false;
+        }
+        unindexTask(shard, *task);
+        taskBytes -= footprintOf(*task);
+        shard.tasks->erase(id);
+        ++storageVersion;
+        return true;
+    }
+
+    // Appends up to `limit` (id, body) pairs with id > afterId from one shard,
+    // walking the status index instead of the whole shard when status >= 0
+    // and the shard is read under its lock.
+    void collect(const Shard& shard, int afterId, size_t limit, int status,
+        std::vector<std::pair<int, TaskBody>>& entries, unsigned fields = ALL_TASK_FIELDS) const {
+        if (limit == 0) {
+            return;
+        }
+        size_t taken = 0;
+        if (status < 0 || shard.tasks->lockFreeReads()) {
+            shard.tasks->forEach(afterId, [&](const Task& task) {
+                if (status >= 0 && static_cast<int>(task.status) != status) {
+                    return true;
+                }
+                entries.emplace_back(task.id, bodyOf(task, fields));
+                return ++taken < limit;
+            });
+            return;
+        }
+        const auto& ids = shard.byStatus[status];
+        for (auto it = ids.upper_bound(afterId); it != ids.end() && taken < limit; ++it, ++taken) {
+            if (const Task* task = shard.tasks->find(*it)) {
+                entries.emplace_back(*it, bodyOf(*task, fields));
+            }
+        }
+    }
+
+    // Swaps the new strings in, leaving the old ones in `updates` so they are
+    // freed by the caller once the shard lock is released.
+    void applyPatch(Shard& shard, Task& task, TaskPatch& updates) {
+        taskBytes -= footprintOf(task);
+        bool textChanged = updates.title || updates.description;
+        if (textChanged) {
+            unindexText(shard, task);
+        }
+        if (updates.title) {
+            task.title.swap(*updates.title);
+        }
+        if (updates.description) {
+            task.description.swap(*updates.description);
+        }
+        if (textChanged) {
+            indexText(shard, task);
+        }
+        if (updates.status) {
+            unindexStatus(shard, task);
+            task.status = *updates.status;
+            indexStatus(shard, task);
+        }
+        ++task.version;
+        shard.byUpdateTime.erase({ task.update_time, task.id });
+        task.updateTime();
+        shard.byUpdateTime.emplace(task.update_time, task.id);
+        task.serialized();
+        taskBytes += footprintOf(task);
+    }
+
+    uint64_t journalWrite(TaskJournal::Op op, const Task& task) {
+        return journal ? journal->append(op, task) : 0;
+    }
+
+    // Blocks until the change is on disk; the shard lock must already be released
+    // so that other writers can join the same fsync.
+    void commit(uint64_t seq) {
+        if (seq != 0 && !journal->waitDurable(seq)) {
+            throw std::runtime_error("Failed to persist task change");
+        }
+    }
+
+    void restoreTask(Task&& task) {
+        int id = task.id;
+        int next = nextId.load();
+        while (next <= id && !nextId.compare_exchange_weak(next, id + 1)) {
+        }
+        task.invalidateBody();
+        task.serialized();
+        Shard& shard = shardFor(id);
+        WriteLock lock(shard.mtx);
+        storeTask(shard, std::move(task));
+    }
+
+    std::string snapshotPath() const {
+        return (std::filesystem::path(persistence.dataDir) / "tasks.snapshot").string();
+    }
+
+    // Snapshot layout: "TODOSNAP", u32 version, u64 seq, then [u8 1][task] per
+    // task, [u8 0][u32 nextId] and a crc32 of everything before it.
+    uint64_t loadSnapshot() {
+        MappedFile file(snapshotPath());
+        if (!file.data()) {
+            return 0;
+        }
+        const size_t headerSize = 8 + 4 + 8;
+        if (file.size() < headerSize + 4 + 1 + 4 || std::memcmp(file.data(), "TODOSNAP", 8) != 0) {
+            throw std::runtime_error("Invalid snapshot file " + snapshotPath());
+        }
+        binary::Reader trailer(file.data() + file.size() - 4, 4);
+        if (crc32(file.data(), file.size() - 4) != trailer.u32()) {
+            throw std::runtime_error("Corrupt snapshot file " + snapshotPath());
+        }
+
+        binary::Reader in(file.data() + 8, file.size() - 8 - 4);
+        if (in.u32() != SNAPSHOT_VERSION) {
+            throw std::runtime_error("Unsupported snapshot version in " + snapshotPath());
+        }
+        uint64_t seq = in.u64();
+        while (in.ok && in.u8() == 1) {
+            restoreTask(binary::getTask(in));
+        }
+        int next = static_cast<int>(in.u32());
+        if (!in.ok) {
+            throw std::runtime_error("Truncated snapshot file " + snapshotPath());
+        }
+        if (next > nextId.load()) {
+            nextId = next;
+        }
+        return seq;
+    }
+
+    // Fuzzy checkpoint: the WAL is cut first and shards are copied afterwards,
+    // one at a time, so the snapshot may already contain changes past the cut.
+    // Replaying the records after the cut is still correct because every
+    // record carries the full task state.
+    void writeSnapshot() {
+        uint64_t cut = journal->cutSegment();
+        std::string tmpPath = snapshotPath() + ".tmp";
+        int fd = fileio::openForWrite(tmpPath, true);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot create " + tmpPath);
+        }
+
+        bool ok = true;
+        uint32_t crc = 0;
+        std::string buffer("TODOSNAP");
+        binary::putU32(buffer, SNAPSHOT_VERSION);
+        binary::putU64(buffer, cut);
+        auto flush = [&] {
+            crc = crc32(buffer.data(), buffer.size(), crc);
+            ok = ok && fileio::writeAll(fd, buffer.data(), buffer.size());
+            buffer.clear();
+        };
+
+        for (const auto& shard : shards) {
+            {
+                ShardReader reader(*shard);
+                shard->tasks->forEach(0, [&](const Task& task) {
+                    binary::putU8(buffer, 1);
+                    binary::putTask(buffer, task);
+                    return true;
+                });
+            }
+            flush();
+        }
+        binary::putU8(buffer, 0);
+        binary::putU32(buffer, static_cast<uint32_t>(nextId.load()));
+        flush();
+        binary::putU32(buffer, crc);
+        ok = ok && fileio::writeAll(fd, buffer.data(), buffer.size()) && fileio::sync(fd);
+        fileio::closeFile(fd);
+
+        std::error_code ec;
+        if (!ok) {
+            std::filesystem::remove(tmpPath, ec);
+            throw std::runtime_error("Failed to write " + tmpPath);
+        }
+        std::filesystem::rename(tmpPath, snapshotPath());
+        fileio::syncDirectory(persistence.dataDir);
+
+        journal->removeSegmentsThrough(cut);
+        snapshotSeq = cut;
+    }
+
+    // Run about once a second, by snapshotLoop or as a shared-workers job.
+    void snapshotIfDue() {
+        auto now = std::chrono::steady_clock::now();
+        uint64_t records = journal->lastSequence() - snapshotSeq;
+        bool due = records >= persistence.snapshotEveryRecords
+            || (records > 0 && now - lastSnapshot >= persistence.snapshotInterval);
+        if (!due) return;
+
+        try {
+            writeSnapshot();
+        }
+        catch (const std::exception& e) {
+            logError("error in TaskStorage::writeSnapshot: ", e.what());
+        }
+        lastSnapshot = now;
+    }
+
+    void snapshotLoop() {
+        std::unique_lock<std::mutex> lock(snapshotMtx);
+        while (!stopSnapshots) {
+            snapshotCv.wait_for(lock, std::chrono::seconds(1));
+            if (stopSnapshots) break;
+
+            lock.unlock();
+            snapshotIfDue();
+            lock.lock();
+        }
+    }
+
+public:
+    explicit TaskStorage(size_t shardCount = 1, StorageBackend backend = StorageBackend::Map,
+        size_t feedCapacity = ChangeFeed::DEFAULT_CAPACITY) : backend(backend), feed(feedCapacity) {
+        if (shardCount == 0) shardCount = 1;
+        for (size_t i = 0; i < shardCount; ++i) {
+            auto shard = std::make_unique<Shard>();
+            if (backend == StorageBackend::Rcu) {
+                shard->tasks = std::make_unique<RcuTaskIndex>(shardCount);
+            }
+            else if (backend == StorageBackend::Flat) {
+                shard->tasks = std::make_unique<FlatTaskIndex>(shardCount);
+            }
+            else {
+                shard->tasks = std::make_unique<MapTaskIndex>(backend == StorageBackend::Arena);
+            }
+            shards.push_back(std::move(shard));
+        }
+    }
+
+    ~TaskStorage() {
+        feed.close();
+        if (journal && persistence.snapshotWorkers) {
+            persistence.snapshotWorkers->remove(this);
+        }
+        if (snapshotThread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(snapshotMtx);
+                stopSnapshots = true;
+            }
+            snapshotCv.notify_all();
+            snapshotThread.join();
+        }
+        journal.reset();
+    }
+
+    TaskStorage(const TaskStorage&) = delete;
+    TaskStorage& operator=(const TaskStorage&) = delete;
+
+    // Loads the latest snapshot from options.dataDir, replays the WAL tail on
+    // top of it and journals every later change. Must be called before the
+    // storage is shared between threads.
+    void enablePersistence(const PersistenceOptions& options) {
+        persistence = options;
+        std::filesystem::create_directories(persistence.dataDir);
+
+        snapshotSeq = loadSnapshot();
+        uint64_t lastSeq = TaskJournal::replay(persistence.dataDir, snapshotSeq,
+            [this](TaskJournal::Op op, Task&& task) {
+                if (op == TaskJournal::Op::Delete) {
+                    eraseTask(shardFor(task.id), task.id);
+                }
+                else {
+                    restoreTask(std::move(task));
+                }
+            });
+
+        journal = std::make_unique<TaskJournal>(persistence.dataDir, lastSeq, persistence.journalWorkers);
+        lastSnapshot = std::chrono::steady_clock::now();
+        if (persistence.snapshotWorkers) {
+            persistence.snapshotWorkers->add(this, [this] { snapshotIfDue(); }, true);
+        }
+        else {
+            snapshotThread = std::thread([this] { snapshotLoop(); });
+        }
+    }
+
+    bool isPersistent() const {
+        return journal != nullptr;
+    }
+
+    size_t shardCount() const {
+        return shards.size();
+    }
+
+    // Copies up to `limit` done tasks of one shard last updated before
+    // `cutoff`, oldest first after the (update_time, id) `cursor`, which it
+    // advances. The shard lock is held for at most 4 * limit index entries;
+    // false once the shard has no older entries left.
+    bool collectExpired(size_t shardIndex, int64_t cutoff, std::pair<int64_t, int>& cursor, size_t limit,
+        std::vector<Task>& out) const {
+        const Shard& shard = *shards[shardIndex];
+        // byUpdateTime is only safe under the lock, whatever the backend.
+        ReadLock lock(shard.mtx);
+        auto it = shard.byUpdateTime.upper_bound(cursor);
+        for (size_t examined = 0; it != shard.byUpdateTime.end() && it->first < cutoff
+            && out.size() < limit && examined < 4 * limit; ++it, ++examined) {
+            cursor = *it;
+            const Task* task = shard.tasks->find(it->second);
+            if (task && task->status == TaskStatus::Done) {
+                out.push_back(*task);
+            }
+        }
+        return it != shard.byUpdateTime.end() && it->first < cutoff;
+    }
+
+    // Deletes the tasks of `expired` still at their collected version and
+    // hands the deleted ones to `archive` before the deletes are made
+    // durable, so a task changed since it was collected is neither deleted
+    // nor archived. When `archive` fails the tasks are put back as they were.
+    // Returns how many stay deleted. After a crash between the archive and
+    // the WAL sync a task may be archived twice, never lost.
+    size_t deleteExpired(const std::vector<Task>& expired, const std::function<bool(std::vector<Task>&)>& archive) {
+        std::vector<Task> deleted;
+        uint64_t seq = 0;
+        for (const Task& task : expired) {
+            Shard& shard = shardFor(task.id);
+            WriteLock lock(shard.mtx);
+            if (!versionMatches(shard, task.id, task.version, nullptr) || !eraseTask(shard, task.id)) {
+                continue;
+            }
+            if (journal) {
+                seq = std::max(seq, journal->appendDelete(task.id));
+            }
+            feed.publish(ChangeFeed::Kind::Delete, task.id, nullptr);
+            deleted.push_back(task);
+        }
+        if (!deleted.empty() && !archive(deleted)) {
+            for (Task& task : deleted) {
+                Shard& shard = shardFor(task.id);
+                WriteLock lock(shard.mtx);
+                TaskBody body = task.serialized();
+                seq = std::max(seq, journalWrite(TaskJournal::Op::Update, task));
+                int64_t createTime = task.create_time;
+                int64_t updateTime = task.update_time;
+                int id = task.id;
+                storeTask(shard, std::move(task));
+                feed.publish(ChangeFeed::Kind::Create, id, body, createTime, updateTime);
+            }
+            deleted.clear();
+        }
+        commit(seq);
+        return deleted.size();
+    }
+
+    // Follower side of replication: stores `task` exactly as the primary
+    // has it (id, version, times and body) or deletes it, and republishes the
+    // change to this storage's feed. Not journaled; a follower resyncs instead.
+    void applyReplicated(ChangeFeed::Kind kind, Task&& task) {
+        int id = task.id;
+        Shard& shard = shardFor(id);
+        if (kind == ChangeFeed::Kind::Delete) {
+            WriteLock lock(shard.mtx);
+            if (eraseTask(shard, id)) {
+                feed.publish(ChangeFeed::Kind::Delete, id, nullptr);
+            }
+            return;
+        }
+        int next = nextId.load();
+        while (next <= id && !nextId.compare_exchange_weak(next, id + 1)) {
+        }
+        task.serialized();
+        TaskBody body = task.body;
+        int64_t createTime = task.create_time;
+        int64_t updateTime = task.update_time;
+        WriteLock lock(shard.mtx);
+        bool existed = shard.tasks->find(id) != nullptr;
+        storeTask(shard, std::move(task));
+        feed.publish(existed ? ChangeFeed::Kind::Update : ChangeFeed::Kind::Create, id, body, createTime, updateTime);
+    }
+
+    // Makes the storage hold exactly `tasks`, as from a primary's snapshot.
+    void resetReplicated(std::vector<Task>&& tasks) {
+        std::set<int> keep;
+        for (const auto& task : tasks) keep.insert(task.id);
+        for (auto& shard : shards) {
+            WriteLock lock(shard->mtx);
+            std::vector<int> gone;
+            shard->tasks->forEach(0, [&](const Task& task) {
+                if (!keep.count(task.id)) gone.push_back(task.id);
+                return true;
+            });
+            for (int id : gone) {
+                eraseTask(*shard, id);
+                feed.publish(ChangeFeed::Kind::Delete, id, nullptr);
+            }
+        }
+        for (auto& task : tasks) {
+            applyReplicated(ChangeFeed::Kind::Update, std::move(task));
+        }
+    }
+
+    StorageBackend storageBackend() const {
+        return backend;
+    }
+
+    Task createTask(Task newTask) {
+        newTask.id = nextId++;
+        newTask.version = 1;
+        newTask.setTime();
+        newTask.serialized();
+        Task stored = newTask;
+
+        uint64_t seq;
+        {
+            Shard& shard = shardFor(newTask.id);
+            WriteLock lock(shard.mtx);
+            seq = journalWrite(TaskJournal::Op::Create, newTask);
+            // Published once stored, as a lock-free reader that saw the event
+            // must also find the task.
+            storeTask(shard, std::move(stored));
+            feed.publish(ChangeFeed::Kind::Create, newTask.id, newTask.body, newTask.create_time, newTask.update_time);
+        }
+        commit(seq);
+        return newTask;
+    }
+
+    std::vector<Task> getAllTasks() const {
+        std::vector<Task> result;
+        for (const auto& shard : shards) {
+            ShardReader reader(*shard);
+            shard->tasks->forEach(0, [&](const Task& task) {
+                result.push_back(task);
+                return true;
+            });
+        }
+        if (shards.size() > 1) {
+            std::sort(result.begin(), result.end(),
+                [](const Task& a, const Task& b) { return a.id < b.id; });
+        }
+        return result;
+    }
+
+    Task getTask(int id) const {
+        const Shard& shard = shardFor(id);
+        ShardReader reader(shard);
+        if (const Task* task = shard.tasks->find(id)) {
+            return *task;
+        }
+        return Task(); 
+    }
+
+    // Cached body of the task, or nullptr; `version` receives the version of
+    // that same body.
+    TaskBody getTaskJson(int id, uint64_t* version = nullptr, unsigned fields = ALL_TASK_FIELDS) const {
+        const Shard& shard = shardFor(id);
+        ShardReader reader(shard);
+        const Task* task = shard.tasks->find(id);
+        if (!task) {
+            return nullptr;
+        }
+        if (version) {
+            *version = task->version;
+        }
+        return bodyOf(*task, fields);
+    }
+
+    // All tasks, or only those with the given status index, as a JSON array.
+    std::string getAllTasksJson(int status = -1) const {
+        std::vector<std::pair<int, TaskBody>> entries;
+        for (const auto& shard : shards) {
+            ShardReader reader(*shard);
+            collect(*shard, 0, SIZE_MAX, status, entries);
+        }
+        return toJsonArray(sortedBodies(entries, shards.size() > 1));
+    }
+
+    // Up to `limit` tasks with id > afterId, in id order. Each shard is locked
+    // (or, for lock-free backends, pinned) only while its next limit + 1
+    // entries are collected.
+    TaskPage getTasksPage(int afterId, size_t limit, int status = -1, unsigned fields = ALL_TASK_FIELDS) const {
+        std::vector<std::pair<int, TaskBody>> entries;
+        for (const auto& shard : shards) {
+            ShardReader reader(*shard);
+            collect(*shard, afterId, limit == SIZE_MAX ? limit : limit + 1, status, entries, fields);
+        }
+        return pageOf(entries, limit);
+    }
+
+    // Up to `limit` tasks with id > afterId whose title or description
+    // contains every search term of `query`, in id order; nextCursor is set
+    // when more matches follow.
+    TaskPage searchTasks(const std::string& query, int afterId, size_t limit, int status = -1) const {
+        std::vector<std::string> terms = searchTerms(query);
+        std::vector<std::pair<int, TaskBody>> entries;
+        if (!terms.empty()) {
+            for (const auto& shard : shards) {
+                ReadLock lock(shard->mtx);
+                collectMatches(*shard, terms, afterId, limit == SIZE_MAX ? limit : limit + 1, status, entries);
+            }
+        }
+        return pageOf(entries, limit);
+    }
+
+    // Up to `limit` tasks matching `query` that follow the cursor (afterTime,
+    // afterId) in the query's order; afterId 0 starts from the beginning and
+    // afterTime only matters for the update_time orders.
+    TaskPage queryTasks(const TaskQuery& query, int64_t afterTime, int afterId, size_t limit) const {
+        if (query.byIdOnly()) {
+            return getTasksPage(afterId, limit, query.status, query.fields);
+        }
+        size_t wanted = limit == SIZE_MAX ? limit : limit + 1;
+        std::vector<std::tuple<int64_t, int, TaskBody>> entries;
+        for (const auto& shard : shards) {
+            ReadLock lock(shard->mtx);
+            collectQuery(*shard, query, afterTime, afterId, wanted, entries);
+        }
+
+        auto key = [&](const auto& entry) {
+            int64_t time = query.order == TaskQuery::Order::Id ? 0 : std::get<0>(entry);
+            return std::make_pair(time, std::get<1>(entry));
+        };
+        if (query.order == TaskQuery::Order::UpdateTimeDesc) {
+            std::sort(entries.begin(), entries.end(), [&](const auto& a, const auto& b) { return key(a) > key(b); });
+        }
+        else {
+            std::sort(entries.begin(), entries.end(), [&](const auto& a, const auto& b) { return key(a) < key(b); });
+        }
+
+        TaskPage page;
+        if (entries.size() > limit) {
+            entries.resize(limit);
+            if (!entries.empty()) {
+                page.nextTime = std::get<0>(entries.back());
+                page.nextCursor = std::get<1>(entries.back());
+            }
+        }
+        page.bodies.reserve(entries.size());
+        for (auto& entry : entries) {
+            page.bodies.push_back(std::move(std::get<2>(entry)));
+        }
+        return page;
+    }
+
+    // Replaces title, description and status. Returns the new cached body
+    // (and its version) taken in the same critical section, or nullptr when
+    // the task does not exist. With an expectedVersion (0: any) the task is
+    // only replaced at that version; otherwise nullptr is returned with the
+    // current version in *version. The replaced strings are swapped into
+    // `updatedTask` and freed after the lock is released.
+    TaskBody updateTask(int id, Task&& updatedTask, uint64_t* version = nullptr, uint64_t expectedVersion = 0) {
+        uint64_t seq;
+        TaskBody body;
+        {
+            Shard& shard = shardFor(id);
+            WriteLock lock(shard.mtx);
+            if (!versionMatches(shard, id, expectedVersion, version)) {
+                return nullptr;
+            }
+            Task* updating = shard.tasks->beginUpdate(id);
+            if (!updating) {
+                return nullptr;
+            }
+            Task& task = *updating;
+            unindexTask(shard, task);
+            taskBytes -= footprintOf(task);
+            task.title.swap(updatedTask.title);
+            task.description.swap(updatedTask.description);
+            task.status = updatedTask.status;
+            task.updateTime();
+            indexTask(shard, task);
+            ++task.version;
+            task.serialized();
+            taskBytes += footprintOf(task);
+            shard.tasks->commitUpdate(id);
+            ++storageVersion;
+            seq = journalWrite(TaskJournal::Op::Update, task);
+            feed.publish(ChangeFeed::Kind::Update, id, task.body, task.create_time, task.update_time);
+            body = task.body;
+            if (version) *version = task.version;
+        }
+        commit(seq);
+        return body;
+    }
+
+    TaskBody updateTask(int id, const Task& updatedTask, uint64_t* version = nullptr) {
+        return updateTask(id, Task(updatedTask), version);
+    }
+
+    // Applies the present fields; same return, precondition and ownership
+    // rules as updateTask.
+    TaskBody patchTask(int id, TaskPatch&& updates, uint64_t* version = nullptr, uint64_t expectedVersion = 0) {
+        uint64_t seq;
+        TaskBody body;
+        {
+            Shard& shard = shardFor(id);
+            WriteLock lock(shard.mtx);
+            if (!versionMatches(shard, id, expectedVersion, version)) {
+                return nullptr;
+            }
+            Task* updating = shard.tasks->beginUpdate(id);
+            if (!updating) {
+                return nullptr;
+            }
+            Task& task = *updating;
+            applyPatch(shard, task, updates);
+            shard.tasks->commitUpdate(id);
+            ++storageVersion;
+            seq = journalWrite(TaskJournal::Op::Patch, task);
+            feed.publish(ChangeFeed::Kind::Update, id, task.body, task.create_time, task.update_time);
+            body = task.body;
+            if (version) *version = task.version;
+        }
+        commit(seq);
+        return body;
+    }
+
+    // Expects validated fields; see TaskBodyParser and TodoAPI::checkJsonPatch.
+    TaskBody patchTask(int id, const json& updates, uint64_t* version = nullptr) {
+        return patchTask(id, TaskPatch::fromJson(updates), version);
+    }
+
+    // False when the task does not exist or, with an expectedVersion (0: any),
+    // is at another version, which is then stored in *version.
+    bool deleteTask(int id, uint64_t expectedVersion = 0, uint64_t* version = nullptr) {
+        uint64_t seq = 0;
+        {
+            Shard& shard = shardFor(id);
+            WriteLock lock(shard.mtx);
+            if (!versionMatches(shard, id, expectedVersion, version) || !eraseTask(shard, id)) {
+                return false;
+            }
+            if (journal) {
+                seq = journal->appendDelete(id);
+            }
+            feed.publish(ChangeFeed::Kind::Delete, id, nullptr);
+        }
+        commit(seq);
+        return true;
+    }
+
+    // Applies already validated operations in order, locking every shard they
+    // touch once (in index order, so concurrent batches cannot deadlock) and
+    // waiting for a single WAL sync at the end. Patch fields must hold strings.
+    std::vector<BatchResult> applyBatch(std::vector<BatchOperation>& ops) {
+        int creates = static_cast<int>(std::count_if(ops.begin(), ops.end(),
+            [](const BatchOperation& op) { return op.kind == BatchOperation::Kind::Create; }));
+        int next = nextId.fetch_add(creates);
+        std::vector<size_t> involved;
+        for (auto& op : ops) {
+            if (op.kind == BatchOperation::Kind::Create) {
+                op.id = next++;
+                op.task.id = op.id;
+                op.task.version = 1;
+                op.task.setTime();
+                op.task.serialized();
+            }
+            if (op.id > 0) {
+                involved.push_back(static_cast<size_t>(op.id) % shards.size());
+            }
+        }
+        std::sort(involved.begin(), involved.end());
+        involved.erase(std::unique(involved.begin(), involved.end()), involved.end());
+
+        std::vector<BatchResult> results(ops.size());
+        uint64_t seq = 0;
+        {
+            std::deque<WriteLock> locks;
+            for (size_t index : involved) {
+                locks.emplace_back(shards[index]->mtx);
+            }
+
+            for (size_t i = 0; i < ops.size(); ++i) {
+                BatchOperation& op = ops[i];
+                BatchResult& result = results[i];
+                result.id = op.id;
+                if (op.id <= 0) {
+                    result.status = 404;
+                    continue;
+                }
+                Shard& shard = shardFor(op.id);
+                switch (op.kind) {
+                case BatchOperation::Kind::Create: {
+                    seq = std::max(seq, journalWrite(TaskJournal::Op::Create, op.task));
+                    result.status = 201;
+                    result.body = op.task.body;
+                    int64_t createTime = op.task.create_time;
+                    int64_t updateTime = op.task.update_time;
+                    storeTask(shard, std::move(op.task));
+                    feed.publish(ChangeFeed::Kind::Create, op.id, result.body, createTime, updateTime);
+                    break;
+                }
+                case BatchOperation::Kind::Patch: {
+                    Task* task = shard.tasks->beginUpdate(op.id);
+                    if (!task) {
+                        result.status = 404;
+                        break;
+                    }
+                    applyPatch(shard, *task, op.fields);
+                    shard.tasks->commitUpdate(op.id);
+                    ++storageVersion;
+                    seq = std::max(seq, journalWrite(TaskJournal::Op::Patch, *task));
+                    result.status = 200;
+                    result.body = task->body;
+                    feed.publish(ChangeFeed::Kind::Update, op.id, task->body, task->create_time, task->update_time);
+                    break;
+                }
+                case BatchOperation::Kind::Delete: {
+                    if (!eraseTask(shard, op.id)) {
+                        result.status = 404;
+                        break;
+                    }
+                    if (journal) {
+                        seq = std::max(seq, journal->appendDelete(op.id));
+                    }
+                    feed.publish(ChangeFeed::Kind::Delete, op.id, nullptr);
+                    result.status = 204;
+                    break;
+                }
+                }
+            }
+        }
+        commit(seq);
+        return results;
+    }
+
+    size_t count() const {
+        size_t total = 0;
+        for (const auto& shard : shards) {
+            ShardReader reader(*shard);
+            total += shard->tasks->size();
+        }
+        return total;
+    }
+
+    size_t countByStatus(int status) const {
+        return statusCounts[status].load();
+    }
+
+    // Approximate bytes held by the stored tasks, without index overhead.
+    // The tasks (see footprintOf) and the change feed's ring.
+    size_t memoryBytes() const {
+        return taskBytes.load() + feed.memoryBytes();
+    }
+
+    // Changes whenever any task is created, changed or deleted. Read it before
+    // collecting a listing: the listing is then at least as new as the version.
+    uint64_t version() const {
+        return storageVersion.load();
+    }
+
+    // Changes applied through this storage since it was created; restored
+    // state is not replayed into the feed.
+    ChangeFeed& changes() {
+        return feed;
+    }
+};
+
+inline bool isStatusValid(const std::string& status) {
+    return status == "todo" || status == "in_progress" || status == "done";
+}
+
+// Fixed-size worker pool whose threads are pinned round-robin to CPU cores.
+// Used instead of httplib's ThreadPool when ServerConfig::pinWorkers is set.
+class PinnedThreadPool : public TaskQueue {
+public:
+    PinnedThreadPool(size_t threadCount, size_t maxQueued) : maxQueued(maxQueued) {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this, core = i % cores] {
+                pinToCore(core);
+                work();
+                });
+        }
+    }
+
+    bool enqueue(std::function<void()> fn) override {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (maxQueued > 0 && jobs.size() >= maxQueued) {
+                return false;
+            }
+            jobs.push_back(std::move(fn));
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    void shutdown() override {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    size_t maxQueued;
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    bool stopping = false;
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    void work() {
+        for (;;) {
+            std::function<void()> fn;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                fn = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            fn();
+        }
+    }
+
+    static void pinToCore(size_t core) {
+#ifdef _WIN32
+        if (core < sizeof(DWORD_PTR) * 8) {
+            SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << core);
+        }
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)core;
+#endif
+    }
+};
+
+// Last full listing per status filter (index 0: unfiltered) of one storage,
+// reused with its compressed forms while the storage version is unchanged.
+class ListingCache {
+public:
+    TaskBody get(const TaskStorage& storage, int status) {
+        uint64_t version = storage.version();
+        Entry& cached = entries[static_cast<size_t>(status + 1)];
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (cached.version == version) {
+                return cached.body;
+            }
+        }
+        auto body = std::make_shared<const std::string>(storage.getAllTasksJson(status));
+        std::lock_guard<std::mutex> lock(mtx);
+        if (cached.version == UINT64_MAX || cached.version < version) {
+            cached.version = version;
+            cached.body = body;
+        }
+        return body;
+    }
+
+private:
+    struct Entry {
+        uint64_t version = UINT64_MAX;
+        TaskBody body;
+    };
+    std::mutex mtx;
+    std::array<Entry, TASK_STATUSES.size() + 1> entries;
+};
+
+// Responses of recent POSTs by Idempotency-Key, so a client retrying after a
+// timeout gets the first response back instead of creating the tasks again.
+// A key is reserved while its first request runs; a repeat meanwhile is told
+// to retry later, a repeat with another request body is refused. Bounded in
+// bytes, least recently used keys first out, striped like CompressionCache.
+class IdempotencyCache {
+public:
+    static constexpr size_t STRIPES = 16;
+
+    struct Stored {
+        int status = 0;
+        std::string etag;
+        TaskBody body;
+    };
+
+    enum class Claim { Reserved, Replay, InFlight, Mismatch };
+
+    explicit IdempotencyCache(size_t maxBytes) : stripeBytes(maxBytes / STRIPES) {}
+
+    bool enabled() const {
+        return stripeBytes > 0;
+    }
+
+    // Reserves `key` for a request whose body hashes to `fingerprint`, or
+    // copies the response kept for it into `stored` (Replay). A reservation
+    // ends with complete() or release().
+    Claim claim(const std::string& key, size_t fingerprint, Stored& stored) {
+        Stripe& stripe = stripeOf(key);
+        std::lock_guard<std::mutex> lock(stripe.mtx);
+        auto it = stripe.entries.find(key);
+        if (it == stripe.entries.end()) {
+            stripe.lru.push_front(key);
+            Entry& entry = stripe.entries[key];
+            entry.fingerprint = fingerprint;
+            entry.position = stripe.lru.begin();
+            entry.bytes = footprintOf(key, entry.response);
+            stripe.bytes += entry.bytes;
+            stripe.evict(stripeBytes);
+            return Claim::Reserved;
+        }
+        Entry& entry = it->second;
+        if (entry.fingerprint != fingerprint) return Claim::Mismatch;
+        if (entry.response.status == 0) return Claim::InFlight;
+        stripe.lru.splice(stripe.lru.begin(), stripe.lru, entry.position);
+        stored = entry.response;
+        replayCount.fetch_add(1, std::memory_order_relaxed);
+        return Claim::Replay;
+    }
+
+    // Keeps the response of a reserved key for its retries.
+    void complete(const std::string& key, Stored response) {
+        Stripe& stripe = stripeOf(key);
+        std::lock_guard<std::mutex> lock(stripe.mtx);
+        auto it = stripe.entries.find(key);
+        if (it == stripe.entries.end()) {
+            return;
+        }
+        Entry& entry = it->second;
+        stripe.bytes -= entry.bytes;
+        entry.response = std::move(response);
+        entry.bytes = footprintOf(key, entry.response);
+        stripe.bytes += entry.bytes;
+        stripe.evict(stripeBytes);
+    }
+
+    // Frees a reserved key whose request failed, so a retry runs it again.
+    void release(const std::string& key) {
+        Stripe& stripe = stripeOf(key);
+        std::lock_guard<std::mutex> lock(stripe.mtx);
+        auto it = stripe.entries.find(key);
+        if (it != stripe.entries.end() && it->second.response.status == 0) {
+            stripe.remove(it);
+        }
+    }
+
+    uint64_t replays() const {
+        return replayCount.load(std::memory_order_relaxed);
+    }
+
+    // A reserved key, released when it goes out of scope uncompleted.
+    class Reservation {
+    public:
+        explicit Reservation(IdempotencyCache& cache) : cache(cache) {}
+        Reservation(const Reservation&) = delete;
+        Reservation& operator=(const Reservation&) = delete;
+
+        ~Reservation() {
+            if (!key.empty()) cache.release(key);
+        }
+
+        void reserve(std::string reserved) {
+            key = std::move(reserved);
+        }
+
+        bool active() const {
+            return !key.empty();
+        }
+
+        void complete(Stored response) {
+            if (key.empty()) return;
+            cache.complete(key, std::move(response));
+            key.clear();
+        }
+
+    private:
+        IdempotencyCache& cache;
+        std::string key;
+    };
+
+private:
+    struct Entry {
+        size_t fingerprint = 0;
+        Stored response;            // status 0 while the first request runs
+        size_t bytes = 0;
+        std::list<std::string>::iterator position;
+    };
+
+    struct Stripe {
+        std::mutex mtx;
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string> lru;
+        size_t bytes = 0;
+
+        void remove(std::unordered_map<std::string, Entry>::iterator it) {
+            bytes -= it->second.bytes;
+            lru.erase(it->second.position);
+            entries.erase(it);
+        }
+
+        void evict(size_t maxBytes) {
+            while (bytes > maxBytes && !lru.empty()) {
+                remove(entries.find(lru.back()));
+            }
+        }
+    };
+
+    static size_t footprintOf(const std::string& key, const Stored& response) {
+        return 2 * key.size() + response.etag.size() + (response.body ? response.body->size() : 0) + sizeof(Entry);
+    }
+
+    Stripe& stripeOf(const std::string& key) {
+        return stripes[std::hash<std::string>()(key) % STRIPES];
+    }
+
+    size_t stripeBytes;
+    std::array<Stripe, STRIPES> stripes;
+    std::atomic<uint64_t> replayCount{ 0 };
+};
+
+// One task namespace with its own storage partition: shards and their locks,
+// id sequence, change feed and WAL.
+struct Tenant {
+    TaskStorage storage;
+    ListingCache listings;
+
+    Tenant(size_t shardCount, StorageBackend backend, size_t feedCapacity = ChangeFeed::DEFAULT_CAPACITY)
+        : storage(shardCount, backend, feedCapacity) {}
+};
+
+// The named tenants behind /t/{tenant}/tasks. A tenant is created on its
+// first write and lives as long as the registry, so Tenant pointers stay
+// valid. With a data directory each tenant persists in <dataDir>/<name>.
+// Tenants are kept cheap, as a client can open up to maxTenants of them: a
+// smaller change feed ring, and WAL flushes and snapshots run on threads
+// shared by all tenants.
+class TenantRegistry {
+public:
+    static constexpr size_t MAX_NAME_LENGTH = 64;
+    static constexpr size_t FEED_CAPACITY = 4096;
+    static constexpr size_t JOURNAL_THREADS = 4;
+
+    TenantRegistry(size_t maxTenants, size_t shardCount, StorageBackend backend, std::string dataDir)
+        : maxTenants(maxTenants), shardCount(shardCount), backend(backend), dataDir(std::move(dataDir)) {
+        if (!this->dataDir.empty()) {
+            journalWorkers = std::make_unique<SharedWorkers>(JOURNAL_THREADS);
+            snapshotWorkers = std::make_unique<SharedWorkers>(1);
+        }
+    }
+
+    // Letters, digits, '-' and '_', starting with a letter or digit.
+    static bool validName(const std::string& name) {
+        if (name.empty() || name.size() > MAX_NAME_LENGTH || !std::isalnum(static_cast<unsigned char>(name[0]))) {
+            return false;
+        }
+        return std::all_of(name.begin(), name.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_';
+            });
+    }
+
+    Tenant* find(const std::string& name) const {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        auto it = tenants.find(name);
+        return it == tenants.end() ? nullptr : it->second.get();
+    }
+
+    // The tenant, created (and recovered from its directory) if needed;
+    // nullptr for an invalid name or when maxTenants are open already.
+    // Throws when its persisted state cannot be loaded.
+    Tenant* open(const std::string& name) {
+        if (Tenant* tenant = find(name)) {
+            return tenant;
+        }
+        if (!validName(name)) {
+            return nullptr;
+        }
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        auto it = tenants.find(name);
+        if (it != tenants.end()) {
+            return it->second.get();
+        }
+        if (tenants.size() >= maxTenants) {
+            return nullptr;
+        }
+        auto tenant = std::make_unique<Tenant>(shardCount, backend, FEED_CAPACITY);
+        if (!dataDir.empty()) {
+            PersistenceOptions options;
+            options.dataDir = (std::filesystem::path(dataDir) / name).string();
+            options.journalWorkers = journalWorkers.get();
+            options.snapshotWorkers = snapshotWorkers.get();
+            tenant->storage.enablePersistence(options);
+        }
+        return tenants.emplace(name, std::move(tenant)).first->second.get();
+    }
+
+    // Reopens every tenant that has a directory under the data directory.
+    void loadExisting() {
+        if (dataDir.empty()) {
+            return;
+        }
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(dataDir, ec)) {
+            if (entry.is_directory(ec)) {
+                open(entry.path().filename().string());
+            }
+        }
+    }
+
+    // fn(name, tenant) for every tenant, in name order.
+    template <class Fn>
+    void forEach(Fn&& fn) const {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        for (const auto& entry : tenants) {
+            fn(entry.first, *entry.second);
+        }
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        return tenants.size();
+    }
+
+private:
+    size_t maxTenants;
+    size_t shardCount;
+    StorageBackend backend;
+    std::string dataDir;
+    // Declared before the tenants, which remove their jobs when destroyed.
+    std::unique_ptr<SharedWorkers> journalWorkers;
+    std::unique_ptr<SharedWorkers> snapshotWorkers;
+    mutable std::shared_mutex mtx;
+    std::map<std::string, std::unique_ptr<Tenant>> tenants;
+};
+
+// Follower side of replication: keeps `storage` a copy of a primary's main
+// namespace over one long-lived GET /replication/stream connection, whose
+// Server-Sent Events carry the primary's change feed. It resyncs from
+// /replication/snapshot at start, after the primary restarted and when it
+// fell out of the primary's feed; a dropped connection resumes from the last
+// applied sequence.
+class ReplicaFollower {
+public:
+    static constexpr time_t READ_TIMEOUT_SECONDS = 10;
+    static constexpr std::chrono::seconds RETRY_DELAY{ 1 };
+
+    struct Status {
+        bool connected = false;
+        uint64_t appliedSeq = 0;
+        uint64_t primarySeq = 0;
+        uint64_t resyncs = 0;
+        // Seconds since the follower last had every change the primary had.
+        double lagSeconds = 0;
+    };
+
+    ReplicaFollower(TaskStorage& storage, std::string primaryUrl)
+        : storage(storage), primaryUrl(std::move(primaryUrl)), caughtUp(std::chrono::steady_clock::now()) {
+    }
+
+    ~ReplicaFollower() {
+        stop();
+    }
+
+    ReplicaFollower(const ReplicaFollower&) = delete;
+    ReplicaFollower& operator=(const ReplicaFollower&) = delete;
+
+    void start() {
+        worker = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+            if (client) client->stop();
+        }
+        cv.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    const std::string& primary() const {
+        return primaryUrl;
+    }
+
+    Status status() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        Status result = state;
+        if (state.appliedSeq < state.primarySeq) {
+            result.lagSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - caughtUp).count();
+        }
+        return result;
+    }
+
+    // Applies one ChangeFeed::toJson(event, true) record to `target` and
+    // returns its sequence. Throws json::exception on malformed records.
+    static uint64_t applyRecord(TaskStorage& target, const json& record) {
+        std::string op = record.at("op").get<std::string>();
+        if (op == "delete") {
+            Task task;
+            task.id = record.at("id").get<int>();
+            target.applyReplicated(ChangeFeed::Kind::Delete, std::move(task));
+        }
+        else {
+            target.applyReplicated(op == "create" ? ChangeFeed::Kind::Create : ChangeFeed::Kind::Update, taskOf(record));
+        }
+        return record.at("seq").get<uint64_t>();
+    }
+
+    static Task taskOf(const json& record) {
+        const json& body = record.at("task");
+        Task task;
+        task.id = record.at("id").get<int>();
+        task.title = body.at("title").get<std::string>();
+        task.description = body.at("description").get<std::string>();
+        task.status = statusFromString(body.at("status").get<std::string>());
+        task.version = body.at("version").get<uint64_t>();
+        task.create_time = record.at("create_time").get<int64_t>();
+        task.update_time = record.at("update_time").get<int64_t>();
+        task.body = std::make_shared<const std::string>(body.dump());
+        return task;
+    }
+
+private:
+    TaskStorage& storage;
+    std::string primaryUrl;
+    std::thread worker;
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::unique_ptr<Client> client;
+    // Identifies the primary process the applied sequences belong to.
+    std::string primaryId;
+    Status state;
+    std::chrono::steady_clock::time_point caughtUp;
+
+    bool isStopping() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return stopping;
+    }
+
+    void run() {
+        bool resyncNeeded = true;
+        while (!isStopping()) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                client = std::make_unique<Client>(primaryUrl);
+                client->set_connection_timeout(2);
+                client->set_read_timeout(READ_TIMEOUT_SECONDS);
+            }
+            if (!resyncNeeded || resync()) {
+                resyncNeeded = !follow();
+            }
+            std::unique_lock<std::mutex> lock(mtx);
+            state.connected = false;
+            cv.wait_for(lock, RETRY_DELAY, [this] { return stopping; });
+        }
+    }
+
+    bool resync() {
+        try {
+            auto result = client->Get("/replication/snapshot");
+            if (!result || result->status != 200) {
+                logWarn("replication: cannot fetch a snapshot from ", primaryUrl);
+                return false;
+            }
+            json snapshot = json::parse(result->body);
+            std::vector<Task> tasks;
+            for (const auto& record : snapshot.at("tasks")) {
+                tasks.push_back(taskOf(record));
+            }
+            size_t count = tasks.size();
+            storage.resetReplicated(std::move(tasks));
+            uint64_t seq = snapshot.at("seq").get<uint64_t>();
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                primaryId = snapshot.at("primary").get<std::string>();
+                state.appliedSeq = seq;
+                state.primarySeq = seq;
+                ++state.resyncs;
+                caughtUp = std::chrono::steady_clock::now();
+            }
+            logInfo("replication: loaded ", count, " tasks from ", primaryUrl, " at seq ", seq);
+            return true;
+        }
+        catch (const std::exception& e) {
+            logWarn("replication: invalid snapshot from ", primaryUrl, ": ", e.what());
+            return false;
+        }
+    }
+
+    // Applies the stream until the connection ends; false when a resync is needed.
+    bool follow() {
+        uint64_t since;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            since = state.appliedSeq;
+        }
+        bool resyncNeeded = false;
+        std::string buffer;
+        Headers headers = { {"Accept", "text/event-stream"} };
+        client->Get("/replication/stream?since=" + std::to_string(since), headers, [&](const char* data, size_t size) {
+            buffer.append(data, size);
+            size_t end;
+            while ((end = buffer.find("\n\n")) != std::string::npos) {
+                std::string message = buffer.substr(0, end);
+                buffer.erase(0, end + 2);
+                if (!handle(message)) {
+                    resyncNeeded = true;
+                    return false;
+                }
+            }
+            return !isStopping();
+            });
+        return !resyncNeeded;
+    }
+
+    // One Server-Sent Event; false when the follower has to resync.
+    bool handle(const std::string& message) {
+        std::string event;
+        std::string data;
+        std::istringstream lines(message);
+        std::string line;
+        while (std::getline(lines, line)) {
+            if (line.compare(0, 7, "event: ") == 0) event = line.substr(7);
+            else if (line.compare(0, 6, "data: ") == 0) data += line.substr(6);
+        }
+        if (event.empty()) {
+            return true;
+        }
+        if (event == "reset") {
+            logWarn("replication: fell behind ", primaryUrl, ", resyncing");
+            return false;
+        }
+        try {
+            json payload = json::parse(data);
+            if (event == "change") {
+                uint64_t seq = applyRecord(storage, payload);
+                std::lock_guard<std::mutex> lock(mtx);
+                state.appliedSeq = seq;
+                notePrimarySeq(seq);
+            }
+            else if (event == "hello") {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (payload.at("primary").get<std::string>() != primaryId) {
+                    logWarn("replication: ", primaryUrl, " restarted, resyncing");
+                    return false;
+                }
+                state.connected = true;
+                notePrimarySeq(payload.at("last_seq").get<uint64_t>());
+            }
+            else if (event == "heartbeat") {
+                std::lock_guard<std::mutex> lock(mtx);
+                notePrimarySeq(payload.at("last_seq").get<uint64_t>());
+            }
+            return true;
+        }
+        catch (const std::exception& e) {
+            logWarn("replication: invalid ", event, " event from ", primaryUrl, ": ", e.what());
+            return false;
+        }
+    }
+
+    void notePrimarySeq(uint64_t seq) {
+        state.primarySeq = std::max(state.primarySeq, seq);
+        if (state.appliedSeq >= state.primarySeq) {
+            caughtUp = std::chrono::steady_clock::now();
+        }
+    }
+};
+
+// Background expiry of done tasks (--archive-after). Every INTERVAL, each
+// storage is swept shard by shard in batches of up to batchSize tasks that
+// were last updated longer ago than maxAgeSeconds. A batch is appended to a
+// gzip archive (one gzip member per batch, so the file reads with zcat)
+// holding only the tasks whose delete, conditional on the collected
+// version, succeeded: a task changed in between stays, unarchived, until it
+// expires again. The archive is synced before the deletes are; see
+// TaskStorage::deleteExpired. Without an archive directory expired tasks are
+// only deleted. Deletes go through the WAL and change feed like client deletes.
+class TaskArchiver {
+public:
+    static constexpr std::chrono::seconds INTERVAL{ 10 };
+    // Between batches, so writers queue behind a sweep for one batch at most.
+    static constexpr std::chrono::milliseconds BATCH_PAUSE{ 5 };
+
+    using Storages = std::function<std::vector<std::pair<std::string, TaskStorage*>>()>;
+
+    TaskArchiver(Storages storages, int64_t maxAgeSeconds, size_t batchSize, std::string archiveDir)
+        : storages(std::move(storages)), maxAgeSeconds(maxAgeSeconds), batchSize(batchSize),
+          archiveDir(std::move(archiveDir)) {
+    }
+
+    ~TaskArchiver() {
+        stop();
+    }
+
+    TaskArchiver(const TaskArchiver&) = delete;
+    TaskArchiver& operator=(const TaskArchiver&) = delete;
+
+    void start() {
+        worker = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // Deletes and archives every task expired at `now`; returns how many.
+    size_t sweep(int64_t now) {
+        size_t removed = 0;
+        for (auto& [name, storage] : storages()) {
+            for (size_t shard = 0; shard < storage->shardCount() && !isStopping(); ++shard) {
+                std::pair<int64_t, int> cursor(INT64_MIN, INT_MIN);
+                bool more = true;
+                while (more && !isStopping()) {
+                    std::vector<Task> batch;
+                    more = storage->collectExpired(shard, now - maxAgeSeconds, cursor, batchSize, batch);
+                    if (batch.empty()) continue;
+                    bool archived = true;
+                    size_t deleted = storage->deleteExpired(batch, [&](std::vector<Task>& tasks) {
+                        archived = archiveDir.empty() || append(name, tasks, now);
+                        return archived;
+                        });
+                    removed += deleted;
+                    expiredCount.fetch_add(deleted, std::memory_order_relaxed);
+                    if (!archived) {
+                        return removed;
+                    }
+                    std::this_thread::sleep_for(BATCH_PAUSE);
+                }
+            }
+        }
+        return removed;
+    }
+
+    uint64_t expired() const {
+        return expiredCount.load(std::memory_order_relaxed);
+    }
+
+    const std::string& directory() const {
+        return archiveDir;
+    }
+
+    // <archiveDir>/<storage>-<local date>.jsonl, plus .gz with zlib.
+    std::string archivePath(const std::string& name, int64_t now) const {
+        std::string file = name + "-" + formatTime(now).substr(0, 10) + ".jsonl";
+        if (encodingSupported(ContentEncoding::Gzip)) file += ".gz";
+        return (std::filesystem::path(archiveDir) / file).string();
+    }
+
+private:
+    Storages storages;
+    int64_t maxAgeSeconds;
+    size_t batchSize;
+    std::string archiveDir;
+    std::thread worker;
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::atomic<uint64_t> expiredCount{ 0 };
+
+    bool isStopping() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return stopping;
+    }
+
+    // One task body per line.
+    bool append(const std::string& name, std::vector<Task>& batch, int64_t now) {
+        std::string lines;
+        for (Task& task : batch) {
+            lines += *task.serialized();
+            lines += '\n';
+        }
+        std::string compressed;
+        if (encodingSupported(ContentEncoding::Gzip)) {
+            if (!compressBody(ContentEncoding::Gzip, lines, compressed)) {
+                logError("archive: cannot compress ", batch.size(), " tasks of ", name);
+                return false;
+            }
+            lines.swap(compressed);
+        }
+        std::error_code error;
+        std::filesystem::create_directories(archiveDir, error);
+        std::string path = archivePath(name, now);
+        int fd = fileio::openForWrite(path, false);
+        bool ok = fd >= 0 && fileio::writeAll(fd, lines.data(), lines.size()) && fileio::sync(fd);
+        if (fd >= 0) fileio::closeFile(fd);
+        if (!ok) {
+            logError("archive: cannot write ", path, ", expired tasks are kept");
+        }
+        return ok;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!stopping) {
+            lock.unlock();
+            size_t removed = sweep(static_cast<int64_t>(std::time(nullptr)));
+            if (removed > 0) {
+                logInfo("archive: expired ", removed, " done tasks");
+            }
+            lock.lock();
+            cv.wait_for(lock, INTERVAL, [this] { return stopping; });
+        }
+    }
+};
+
+class TodoAPI {
+private:
+    Server svr;
+    ServerConfig config;
+    // Filled by setupEndpoints(), then served by svr or reactor.
+    HttpRoutes routes;
+#ifdef __linux__
+    // Set for --server-engine epoll.
+    std::unique_ptr<ReactorServer> reactor;
+#endif
+    // Namespace of the unprefixed /tasks routes.
+    Tenant mainTenant;
+    TaskStorage& taskStorage = mainTenant.storage;
+    TenantRegistry tenants;
+    // Set when this node follows a primary (--replicate-from).
+    std::unique_ptr<ReplicaFollower> follower;
+    // Set with --archive-after on a primary; followers get its deletes.
+    std::unique_ptr<TaskArchiver> archiver;
+    int port = 8080;
+    socket_t listenSocket = static_cast<socket_t>(-1);
+    // Distinguishes ETags of this process from those handed out before a restart.
+    std::string etagPrefix;
+    CompressionCache compressionCache;
+    IdempotencyCache idempotency;
+
+    bool checkFieldTypes(const json& body, json& error) {
+        for (const char* field : { "title", "description", "status" }) {
+            if (body.contains(field) && !body[field].is_string()) {
+                error = { {"error", "Field must be a string"}, {"field", field} };
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool checkJsonTasks(const json& body, json& error) {
+        if (!body.contains("title") || body["title"].empty()) {
+            error = { {"error", "Title is required"} };
+            return false;
+        }
+
+        if (!checkFieldTypes(body, error)) {
+            return false;
+        }
+
+        if (body.contains("status")) {
+            std::string status = body["status"];
+            if (!isStatusValid(status)) {
+                error = invalidStatusError();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool checkJsonPatch(const json& body, json& error) {
+        if (!body.is_object() || body.empty()) {
+            error = { {"error", "No fields to update"} };
+            return false;
+        }
+
+        if (!checkFieldTypes(body, error)) {
+            return false;
+        }
+
+        if (body.contains("status") && !isStatusValid(body["status"].get<std::string>())) {
+            error = invalidStatusError();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Decodes a request body in the format its Content-Type names; on failure
+    // fills in the 400 response and returns false.
+    static bool decodeBody(const Request& req, Response& res, json& body) {
+        WireFormat format = wireFormatOf(req.get_header_value("Content-Type"));
+        std::string detail;
+        if (decodeWireFormat(format, req.body, body, detail)) {
+            return true;
+        }
+        res.status = 400;
+        json error = { {"error", format == WireFormat::Json ? "Invalid JSON format" : "Invalid request body"}, {"details", detail} };
+        res.set_content(error.dump(), "application/json");
+        return false;
+    }
+
+    // Parses the body of a single-task request; on failure fills in the 400
+    // response and returns false. JSON goes through TaskBodyParser, binary
+    // formats through a decoded document with the same checks.
+    bool parseTaskBody(const Request& req, Response& res, TaskPatch& patch) {
+        std::string detail;
+        json error;
+        if (wireFormatOf(req.get_header_value("Content-Type")) != WireFormat::Json) {
+            json body;
+            if (!decodeBody(req, res, body)) {
+                return false;
+            }
+            if (!body.is_object()) {
+                error = { {"error", "Body must be an object"} };
+            }
+            else if (checkFieldTypes(body, error)) {
+                if (!body.contains("status") || isStatusValid(body["status"].get<std::string>())) {
+                    patch = TaskPatch::fromJson(body);
+                    return true;
+                }
+                error = invalidStatusError();
+            }
+            res.status = 400;
+            res.set_content(error.dump(), "application/json");
+            return false;
+        }
+        switch (TaskBodyParser::parse(req.body, patch, detail)) {
+        case TaskBodyParser::Result::Ok:
+            return true;
+        case TaskBodyParser::Result::Syntax:
+            error = { {"error", "Invalid JSON format"}, {"details", detail} };
+            break;
+        case TaskBodyParser::Result::FieldType:
+            error = { {"error", "Field must be a string"}, {"field", detail} };
+            break;
+        case TaskBodyParser::Result::InvalidStatus:
+            error = invalidStatusError();
+            break;
+        }
+        res.status = 400;
+        res.set_content(error.dump(), "application/json");
+        return false;
+    }
+
+    static void titleRequired(Response& res) {
+        res.status = 400;
+        res.set_content(json{ {"error", "Title is required"} }.dump(), "application/json");
+    }
+
+    static constexpr size_t MAX_BATCH_OPERATIONS = 50000;
+    static constexpr size_t MAX_IDEMPOTENCY_KEY = 255;
+
+    // Turns one element of a POST /tasks/batch body into an operation, or
+    // fills `error` when it is malformed.
+    bool parseBatchOperation(const json& item, BatchOperation& op, json& error) {
+        if (!item.is_object() || !item.contains("op") || !item["op"].is_string()) {
+            error = { {"error", "Operation must be an object with an \"op\" field"} };
+            return false;
+        }
+        std::string kind = item["op"];
+        if (kind == "create") {
+            op.kind = BatchOperation::Kind::Create;
+            if (!item.contains("task") || !checkJsonTasks(item["task"], error)) {
+                if (error.is_null()) error = { {"error", "Title is required"} };
+                return false;
+            }
+            op.task = Task::fromJson(item["task"]);
+            return true;
+        }
+
+        if (kind != "patch" && kind != "delete") {
+            error = { {"error", "Unknown operation"}, {"valid_operations", {"create", "patch", "delete"}} };
+            return false;
+        }
+        if (!item.contains("id") || !item["id"].is_number_integer() || item["id"].get<int>() <= 0) {
+            error = { {"error", "A positive task id is required"} };
+            return false;
+        }
+        op.id = item["id"];
+
+        if (kind == "delete") {
+            op.kind = BatchOperation::Kind::Delete;
+            return true;
+        }
+        op.kind = BatchOperation::Kind::Patch;
+        if (!item.contains("task") || !checkJsonPatch(item["task"], error)) {
+            if (error.is_null()) error = { {"error", "No fields to update"} };
+            return false;
+        }
+        op.fields = TaskPatch::fromJson(item["task"]);
+        return true;
+    }
+
+    static json invalidStatusError() {
+        return {
+            {"error", "Invalid status"},
+            {"valid_statuses", {"todo", "in_progress", "done"}}
+        };
+    }
+
+    static constexpr size_t DEFAULT_PAGE_LIMIT = 100;
+    static constexpr size_t MAX_PAGE_LIMIT = 1000;
+    static constexpr size_t STREAM_PAGE_SIZE = 256;
+
+    static constexpr int DEFAULT_POLL_TIMEOUT_SECONDS = 30;
+    static constexpr int MAX_POLL_TIMEOUT_SECONDS = 60;
+    static constexpr size_t MAX_CHANGES_PER_RESPONSE = 1000;
+    static constexpr std::chrono::seconds SSE_HEARTBEAT{ 15 };
+    // Shorter than ReplicaFollower::READ_TIMEOUT_SECONDS, and the resolution
+    // of the lag a follower reports while the primary is idle.
+    static constexpr std::chrono::seconds REPLICATION_HEARTBEAT{ 1 };
+
+    // Reads ?cursor= and ?limit=; limit stays 0 when the whole list is requested.
+    // With cursorTime the cursor is "update_time:id", as X-Next-Cursor writes
+    // it for listings in update_time order.
+    bool parsePaging(const Request& req, int& cursor, size_t& limit, json& error, int64_t* cursorTime = nullptr) {
+        // std::stoll stops at the first non-digit; "10abc" is not a number here.
+        auto whole = [](const std::string& value, long long min, long long max) {
+            size_t used = 0;
+            long long parsed = std::stoll(value, &used);
+            if (used != value.size() || parsed < min || parsed > max) throw std::out_of_range(value);
+            return parsed;
+        };
+        try {
+            if (req.has_param("cursor")) {
+                std::string value = req.get_param_value("cursor");
+                if (cursorTime) {
+                    size_t colon = value.find(':');
+                    if (colon == std::string::npos) throw std::invalid_argument("cursor");
+                    *cursorTime = whole(value.substr(0, colon), LLONG_MIN, LLONG_MAX);
+                    value.erase(0, colon + 1);
+                }
+                cursor = static_cast<int>(whole(value, 0, INT_MAX));
+            }
+            if (req.has_param("limit")) {
+                long long value = whole(req.get_param_value("limit"), 1, INT_MAX);
+                limit = std::min(static_cast<size_t>(value), MAX_PAGE_LIMIT);
+            }
+            else if (req.has_param("cursor")) {
+                limit = DEFAULT_PAGE_LIMIT;
+            }
+        }
+        catch (const std::exception&) {
+            error = { {"error", "Invalid pagination parameters"}, {"max_limit", MAX_PAGE_LIMIT} };
+            return false;
+        }
+        return true;
+    }
+
+    // Reads ?status=, ?updated_since=, ?created_before= and ?sort= of GET /tasks.
+    static bool parseQuery(const Request& req, TaskQuery& query, json& error) {
+        if (req.has_param("status")) {
+            query.status = statusIndex(req.get_param_value("status"));
+            if (query.status < 0) {
+                error = invalidStatusError();
+                return false;
+            }
+        }
+        try {
+            if (req.has_param("updated_since") && !parseTime(req.get_param_value("updated_since"), query.updatedSince)) {
+                throw std::invalid_argument("updated_since");
+            }
+            if (req.has_param("created_before") && !parseTime(req.get_param_value("created_before"), query.createdBefore)) {
+                throw std::invalid_argument("created_before");
+            }
+        }
+        catch (const std::exception&) {
+            error = { {"error", "Invalid time filter"}, {"formats", {"epoch seconds", "YYYY-MM-DD HH:MM:SS"}} };
+            return false;
+        }
+        if (req.has_param("sort")) {
+            std::string sort = req.get_param_value("sort");
+            if (sort == "update_time") query.order = TaskQuery::Order::UpdateTime;
+            else if (sort == "-update_time") query.order = TaskQuery::Order::UpdateTimeDesc;
+            else if (sort != "id") {
+                error = { {"error", "Invalid sort order"}, {"valid_sorts", {"id", "update_time", "-update_time"}} };
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static std::string nextCursorOf(const TaskQuery& query, const TaskPage& page) {
+        if (query.order == TaskQuery::Order::Id) {
+            return std::to_string(page.nextCursor);
+        }
+        return std::to_string(page.nextTime) + ':' + std::to_string(page.nextCursor);
+    }
+
+    // {method, route} labels of the request latency series in /metrics.
+    static const std::vector<std::pair<std::string, std::string>>& metricRoutes() {
+        static const std::vector<std::pair<std::string, std::string>> routes = {
+            {"OPTIONS", "*"}, {"GET", "/status"}, {"GET", "/metrics"}, {"PUT", "/log-level"},
+            {"GET", "/tasks"}, {"POST", "/tasks"}, {"POST", "/tasks/batch"}, {"GET", "/tasks/changes"},
+            {"GET", "/tasks/search"},
+            {"GET", "/tasks/{id}"}, {"PUT", "/tasks/{id}"}, {"PATCH", "/tasks/{id}"}, {"DELETE", "/tasks/{id}"},
+            {"GET", "/t/{tenant}/tasks"}, {"POST", "/t/{tenant}/tasks"}, {"POST", "/t/{tenant}/tasks/batch"},
+            {"GET", "/t/{tenant}/tasks/changes"}, {"GET", "/t/{tenant}/tasks/search"},
+            {"GET", "/t/{tenant}/tasks/{id}"}, {"PUT", "/t/{tenant}/tasks/{id}"}, {"PATCH", "/t/{tenant}/tasks/{id}"},
+            {"DELETE", "/t/{tenant}/tasks/{id}"},
+            {"GET", "/replication/snapshot"}, {"GET", "/replication/stream"},
+            {"OTHER", "unmatched"}
+        };
+        return routes;
+    }
+
+    // `path` under /t/{tenant}; the tenant is the first capture of the route.
+    static std::string tenantRoute(const std::string& path) {
+        return "/t/([A-Za-z0-9][A-Za-z0-9_-]{0,63})" + path;
+    }
+
+    // The {id} of a task route, its last capture.
+    static int pathId(const Request& req) {
+        return std::stoi(req.matches[req.matches.size() - 1]);
+    }
+
+    // The namespace a task route addresses: the main one for /tasks, else the
+    // tenant named in /t/{tenant}/tasks, which writes create. Answers 404 for
+    // a read of an unknown tenant and 503 at the tenant limit, returning nullptr;
+    // a follower redirects every write to its primary.
+    Tenant* tenantOf(const Request& req, Response& res, bool create) {
+        if (create && follower) {
+            res.status = 307;
+            res.set_header("Location", follower->primary() + req.target);
+            json error = { {"error", "This node is a read-only replica"}, {"primary", follower->primary()} };
+            res.set_content(error.dump(), "application/json");
+            return nullptr;
+        }
+        if (req.path.compare(0, 3, "/t/") != 0) {
+            return &mainTenant;
+        }
+        std::string name = req.matches[1];
+        Tenant* tenant = create ? tenants.open(name) : tenants.find(name);
+        if (!tenant) {
+            res.status = create ? 503 : 404;
+            json error = { {"error", create ? "Tenant limit reached" : "Tenant not found"}, {"tenant", name} };
+            res.set_content(error.dump(), "application/json");
+        }
+        return tenant;
+    }
+
+    // Maps a request onto metricRoutes() with plain string checks, so the
+    // handler regexes are not evaluated a second time.
+    static size_t routeOf(const Request& req) {
+        const auto& routes = metricRoutes();
+        std::string route;
+        std::string path = req.path;
+        std::string prefix;
+        size_t tenantEnd = path.find('/', 3);
+        if (path.compare(0, 3, "/t/") == 0 && tenantEnd != std::string::npos
+            && TenantRegistry::validName(path.substr(3, tenantEnd - 3))) {
+            path.erase(0, tenantEnd);
+            prefix = "/t/{tenant}";
+        }
+        if (req.method == "OPTIONS") {
+            route = "*";
+        }
+        else if (prefix.empty() && (path == "/status" || path == "/metrics" || path == "/log-level"
+            || path == "/replication/snapshot" || path == "/replication/stream")) {
+            route = path;
+        }
+        else if (path == "/tasks" || path == "/tasks/batch" || path == "/tasks/changes" || path == "/tasks/search") {
+            route = prefix + path;
+        }
+        else if (path.size() > 7 && path.compare(0, 7, "/tasks/") == 0
+            && std::all_of(path.begin() + 7, path.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            route = prefix + "/tasks/{id}";
+        }
+        for (size_t i = 0; i + 1 < routes.size(); ++i) {
+            if (routes[i].first == req.method && routes[i].second == route) return i;
+        }
+        return routes.size() - 1;
+    }
+
+    // Start time of the request the current server thread is handling;
+    // 0 when the request never reached the pre-routing handler.
+    static uint64_t& requestStart() {
+        thread_local uint64_t started = 0;
+        return started;
+    }
+
+    // A ?fields= projection is a representation of its own.
+    std::string taskETag(int id, uint64_t version, unsigned fields = ALL_TASK_FIELDS) const {
+        return "\"" + etagPrefix + "-" + std::to_string(id) + "-" + std::to_string(version) + fieldsTag(fields) + "\"";
+    }
+
+    std::string collectionETag(uint64_t version, unsigned fields = ALL_TASK_FIELDS) const {
+        return "\"" + etagPrefix + "-c" + std::to_string(version) + fieldsTag(fields) + "\"";
+    }
+
+    static std::string fieldsTag(unsigned fields) {
+        return fields == ALL_TASK_FIELDS ? std::string() : "-f" + std::to_string(fields);
+    }
+
+    // MessagePack and CBOR are representations of their own too. Handlers
+    // compute the JSON tag; notModified and sendBody add this suffix.
+    static std::string formatTag(WireFormat format) {
+        static const char* tags[] = { "", "-m", "-b" };
+        return tags[static_cast<size_t>(format)];
+    }
+
+    static std::string withFormatTag(std::string etag, WireFormat format) {
+        if (format != WireFormat::Json && !etag.empty()) etag.insert(etag.size() - 1, formatTag(format));
+        return etag;
+    }
+
+    // Reads ?fields=; every field when it is absent.
+    static bool parseFields(const Request& req, unsigned& fields, json& error) {
+        fields = ALL_TASK_FIELDS;
+        if (req.has_param("fields") && !parseTaskFields(req.get_param_value("fields"), fields)) {
+            error = { {"error", "Invalid fields"}, {"valid_fields", TASK_FIELDS} };
+            return false;
+        }
+        return true;
+    }
+
+    // True when If-None-Match lists `etag` (weak comparison) or is "*".
+    static bool etagMatches(const Request& req, const std::string& etag) {
+        if (!req.has_header("If-None-Match")) return false;
+        std::string header = req.get_header_value("If-None-Match");
+        size_t start = 0;
+        while (start < header.size()) {
+            size_t end = header.find(',', start);
+            if (end == std::string::npos) end = header.size();
+            size_t first = header.find_first_not_of(" \t", start);
+            size_t last = header.find_last_not_of(" \t", end - 1);
+            if (first != std::string::npos && first < end) {
+                std::string candidate = header.substr(first, last - first + 1);
+                if (candidate.compare(0, 2, "W/") == 0) candidate.erase(0, 2);
+                if (candidate == "*" || candidate == etag) return true;
+            }
+            start = end + 1;
+        }
+        return false;
+    }
+
+    // Version of task `id` an If-Match header asks for into `expected`; 0 when
+    // there is no header or it is "*" (the task only has to exist). False when
+    // it names no ETag of this task handed out by this process, which can
+    // never match. Weak tags count too: ours only weaken with the encoding.
+    bool ifMatchVersion(const Request& req, int id, uint64_t& expected) const {
+        expected = 0;
+        if (!req.has_header("If-Match")) return true;
+        std::string header = req.get_header_value("If-Match");
+        std::string prefix = "\"" + etagPrefix + "-" + std::to_string(id) + "-";
+        size_t start = 0;
+        while (start < header.size()) {
+            size_t end = header.find(',', start);
+            if (end == std::string::npos) end = header.size();
+            size_t first = header.find_first_not_of(" \t", start);
+            size_t last = header.find_last_not_of(" \t", end - 1);
+            if (first != std::string::npos && first < end) {
+                std::string candidate = header.substr(first, last - first + 1);
+                if (candidate.compare(0, 2, "W/") == 0) candidate.erase(0, 2);
+                if (candidate == "*") return true;
+                if (candidate.compare(0, prefix.size(), prefix) == 0) {
+                    uint64_t version = 0;
+                    size_t at = prefix.size();
+                    for (; at < candidate.size() && std::isdigit(static_cast<unsigned char>(candidate[at])); ++at) {
+                        version = version * 10 + static_cast<uint64_t>(candidate[at] - '0');
+                    }
+                    bool tail = candidate.back() == '"' && (at == candidate.size() - 1 || candidate.compare(at, 2, "-f") == 0
+                        || candidate.compare(at, 2, "-m") == 0 || candidate.compare(at, 2, "-b") == 0);
+                    if (version > 0 && tail) {
+                        expected = version;
+                        return true;
+                    }
+                }
+            }
+            start = end + 1;
+        }
+        return false;
+    }
+
+    // 412 for a conditional write that lost; carries the current ETag when
+    // the task still exists so the client can refetch and retry.
+    void preconditionFailed(Response& res, int id, uint64_t version) const {
+        res.status = 412;
+        json error = { {"error", "Task was changed; If-Match does not hold"}, {"id", id} };
+        if (version > 0) {
+            res.set_header("ETag", taskETag(id, version));
+            error["version"] = version;
+        }
+        res.set_content(error.dump(), "application/json");
+    }
+
+    // Answers a POST that repeats an Idempotency-Key: replays the response
+    // kept for it, or refuses with 409 while the first request still runs
+    // and with 422 when the key comes with another body. Returns false then;
+    // otherwise reserves the key, if any, in `reservation`.
+    bool reserveIdempotencyKey(const Request& req, Response& res, IdempotencyCache::Reservation& reservation) {
+        if (!req.has_header("Idempotency-Key") || !idempotency.enabled()) return true;
+        std::string key = req.get_header_value("Idempotency-Key");
+        if (key.empty() || key.size() > MAX_IDEMPOTENCY_KEY) {
+            res.status = 400;
+            json error = { {"error", "Invalid Idempotency-Key"}, {"max_length", MAX_IDEMPOTENCY_KEY} };
+            res.set_content(error.dump(), "application/json");
+            return false;
+        }
+        // Keys are scoped by path, and so by tenant and route.
+        std::string scoped = req.path + '\n' + key;
+        IdempotencyCache::Stored stored;
+        switch (idempotency.claim(scoped, std::hash<std::string>()(req.body), stored)) {
+        case IdempotencyCache::Claim::Reserved:
+            reservation.reserve(std::move(scoped));
+            return true;
+        case IdempotencyCache::Claim::Replay:
+            res.status = stored.status;
+            if (!stored.etag.empty()) res.set_header("ETag", stored.etag);
+            res.set_header("Idempotent-Replayed", "true");
+            sendBody(req, res, stored.body);
+            return false;
+        case IdempotencyCache::Claim::InFlight:
+            res.status = 409;
+            res.set_header("Retry-After", "1");
+            res.set_content(json{ {"error", "A request with this Idempotency-Key is in progress"} }.dump(), "application/json");
+            return false;
+        case IdempotencyCache::Claim::Mismatch:
+            res.status = 422;
+            res.set_content(json{ {"error", "Idempotency-Key was used for a different request"} }.dump(), "application/json");
+            return false;
+        }
+        return true;
+    }
+
+    ContentEncoding responseEncoding(const Request& req, size_t size) const {
+        if (!config.compression || size < config.compressionMinBytes) {
+            return ContentEncoding::Identity;
+        }
+        return negotiateEncoding(req.get_header_value("Accept-Encoding"));
+    }
+
+    // A compressed representation gets a weak ETag: it is not byte-identical
+    // to the identity one, but If-None-Match compares weakly anyway.
+    static void weakenETag(Response& res) {
+        auto etag = res.headers.find("ETag");
+        if (etag != res.headers.end() && etag->second.compare(0, 2, "W/") != 0) {
+            etag->second = "W/" + etag->second;
+        }
+    }
+
+    static void tagWireFormat(Response& res, WireFormat format) {
+        auto etag = res.headers.find("ETag");
+        if (etag != res.headers.end()) {
+            etag->second = withFormatTag(etag->second, format);
+        }
+    }
+
+    static size_t variantOf(WireFormat format, ContentEncoding encoding) {
+        return static_cast<size_t>(format) * CONTENT_ENCODINGS.size() + static_cast<size_t>(encoding);
+    }
+
+    // Sends a shared JSON body in the format the client accepts, compressed
+    // when it accepts an encoding and the result is large enough. Conversions
+    // are made once per body through compressionCache.
+    void sendBody(const Request& req, Response& res, const TaskBody& body) {
+        WireFormat format = acceptedWireFormat(req.get_header_value("Accept"));
+        TaskBody out = body;
+        if (format != WireFormat::Json) {
+            out = compressionCache.derive(body, variantOf(format, ContentEncoding::Identity), [&](std::string& converted) {
+                converted = encodeWireFormat(format, json::parse(*body));
+                return true;
+                });
+            tagWireFormat(res, format);
+        }
+        ContentEncoding encoding = responseEncoding(req, out->size());
+        if (encoding != ContentEncoding::Identity) {
+            TaskBody encoded = compressionCache.derive(body, variantOf(format, encoding),
+                [&](std::string& compressed) { return compressBody(encoding, *out, compressed); });
+            if (encoded) {
+                res.set_header("Content-Encoding", CONTENT_ENCODINGS[static_cast<size_t>(encoding)]);
+                weakenETag(res);
+                out = encoded;
+            }
+        }
+        res.set_content(*out, WIRE_FORMAT_TYPES[static_cast<size_t>(format)]);
+    }
+
+    // Same for a JSON body built for this response only; converted uncached.
+    void sendBody(const Request& req, Response& res, std::string&& body) {
+        WireFormat format = acceptedWireFormat(req.get_header_value("Accept"));
+        if (format != WireFormat::Json) {
+            body = encodeWireFormat(format, json::parse(body));
+            tagWireFormat(res, format);
+        }
+        ContentEncoding encoding = responseEncoding(req, body.size());
+        std::string encoded;
+        if (encoding != ContentEncoding::Identity && compressBody(encoding, body, encoded)) {
+            res.set_header("Content-Encoding", CONTENT_ENCODINGS[static_cast<size_t>(encoding)]);
+            weakenETag(res);
+            body = std::move(encoded);
+        }
+        res.set_content(std::move(body), WIRE_FORMAT_TYPES[static_cast<size_t>(format)]);
+    }
+
+    json replicationStatus() const {
+        if (!follower) {
+            return { {"role", "primary"} };
+        }
+        ReplicaFollower::Status replica = follower->status();
+        return {
+            {"role", "follower"},
+            {"primary", follower->primary()},
+            {"connected", replica.connected},
+            {"applied_seq", replica.appliedSeq},
+            {"primary_seq", replica.primarySeq},
+            {"lag_events", replica.primarySeq - replica.appliedSeq},
+            {"lag_seconds", replica.lagSeconds},
+            {"resyncs", replica.resyncs}
+        };
+    }
+
+    // Sets the (JSON) ETag and answers 304 when the client already holds the
+    // representation in the format it accepts; sendBody tags a 200 likewise.
+    static bool notModified(const Request& req, Response& res, const std::string& etag) {
+        std::string tagged = withFormatTag(etag, acceptedWireFormat(req.get_header_value("Accept")));
+        if (etagMatches(req, tagged)) {
+            res.set_header("ETag", tagged);
+            res.status = 304;
+            return true;
+        }
+        res.set_header("ETag", etag);
+        return false;
+    }
+
+    static bool isFlagSet(const Request& req, const std::string& name) {
+        if (!req.has_param(name)) return false;
+        std::string value = req.get_param_value(name);
+        return value != "0" && value != "false";
+    }
+
+    static bool parseUnsigned(const std::string& value, uint64_t& result) {
+        if (value.empty() || value.size() > 19
+            || !std::all_of(value.begin(), value.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            return false;
+        }
+        result = std::stoull(value);
+        return true;
+    }
+
+    static void changesGone(Response& res, const ChangeFeed& feed) {
+        res.status = 410;
+        json error = {
+            {"error", "Changes since this sequence are no longer available, reload the task list"},
+            {"oldest_seq", feed.oldestSequence()},
+            {"last_seq", feed.lastSequence()}
+        };
+        res.set_content(error.dump(), "application/json");
+    }
+
+    // Server-Sent Events: one "change" event per feed entry, a comment line
+    // every SSE_HEARTBEAT while idle (which also detects gone clients) and a
+    // final "reset" event when the subscriber fell out of the ring.
+    static void streamChanges(Response& res, ChangeFeed& feed, uint64_t since) {
+        auto cursor = std::make_shared<uint64_t>(since);
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream", [&feed, cursor](size_t offset, DataSink& sink) {
+            if (offset == 0) {
+                return sink.write("retry: 3000\n\n", 13);
+            }
+            std::string chunk;
+
+            std::vector<ChangeFeed::Event> events;
+            bool available = feed.read(*cursor, STREAM_PAGE_SIZE, events);
+            if (available && events.empty()) {
+                if (!feed.wait(*cursor, SSE_HEARTBEAT)) {
+                    if (feed.isClosed()) {
+                        sink.done();
+                        return true;
+                    }
+                    chunk += ": keepalive\n\n";
+                    return sink.write(chunk.data(), chunk.size());
+                }
+                available = feed.read(*cursor, STREAM_PAGE_SIZE, events);
+            }
+
+            if (!available) {
+                chunk += "event: reset\ndata: {\"oldest_seq\":" + std::to_string(feed.oldestSequence()) + "}\n\n";
+                if (sink.write(chunk.data(), chunk.size())) {
+                    sink.done();
+                }
+                return true;
+            }
+            for (const auto& event : events) {
+                chunk += "id: " + std::to_string(event.seq) + "\nevent: change\ndata: ";
+                chunk += ChangeFeed::toJson(event);
+                chunk += "\n\n";
+                *cursor = event.seq;
+            }
+            return sink.write(chunk.data(), chunk.size());
+            });
+    }
+
+    // Replication stream of the main namespace for ReplicaFollower: a "hello"
+    // naming this process, then a "change" per feed entry after `since` (with
+    // epoch times), a "heartbeat" with the last sequence every
+    // REPLICATION_HEARTBEAT while idle, and a final "reset" once `since` has
+    // left the feed.
+    void streamReplication(Response& res, ChangeFeed& feed, uint64_t since) {
+        auto cursor = std::make_shared<uint64_t>(since);
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream", [this, &feed, cursor](size_t offset, DataSink& sink) {
+            std::string chunk;
+            if (offset == 0) {
+                chunk = "event: hello\ndata: {\"primary\":\"" + etagPrefix + "\",\"last_seq\":"
+                    + std::to_string(feed.lastSequence()) + "}\n\n";
+                return sink.write(chunk.data(), chunk.size());
+            }
+
+            std::vector<ChangeFeed::Event> events;
+            bool available = feed.read(*cursor, STREAM_PAGE_SIZE, events);
+            if (available && events.empty()) {
+                if (!feed.wait(*cursor, REPLICATION_HEARTBEAT)) {
+                    if (feed.isClosed()) {
+                        sink.done();
+                        return true;
+                    }
+                    chunk = "event: heartbeat\ndata: {\"last_seq\":" + std::to_string(feed.lastSequence()) + "}\n\n";
+                    return sink.write(chunk.data(), chunk.size());
+                }
+                available = feed.read(*cursor, STREAM_PAGE_SIZE, events);
+            }
+
+            if (!available) {
+                chunk = "event: reset\ndata: {\"oldest_seq\":" + std::to_string(feed.oldestSequence()) + "}\n\n";
+                if (sink.write(chunk.data(), chunk.size())) {
+                    sink.done();
+                }
+                return true;
+            }
+            for (const auto& event : events) {
+                chunk += "id: " + std::to_string(event.seq) + "\nevent: change\ndata: ";
+                chunk += ChangeFeed::toJson(event, true);
+                chunk += "\n\n";
+                *cursor = event.seq;
+            }
+            return sink.write(chunk.data(), chunk.size());
+            });
+    }
+
+    // Emits the task list as a chunked JSON array, one storage page per chunk,
+    // so neither the lock nor the response buffer scales with the table size.
+    static void streamTasks(Response& res, const TaskStorage& storage, const TaskQuery& query, int64_t cursorTime,
+        int cursor, size_t limit) {
+        struct StreamState {
+            TaskQuery query;
+            int64_t cursorTime;
+            int cursor;
+            size_t remaining;
+            size_t emitted = 0;
+        };
+        auto state = std::make_shared<StreamState>();
+        state->query = query;
+        state->cursorTime = cursorTime;
+        state->cursor = cursor;
+        state->remaining = limit == 0 ? SIZE_MAX : limit;
+
+        res.set_chunked_content_provider("application/json", [&storage, state](size_t offset, DataSink& sink) {
+            std::string chunk;
+            if (offset == 0) {
+                chunk += '[';
+            }
+            TaskPage page = storage.queryTasks(state->query, state->cursorTime, state->cursor,
+                std::min(STREAM_PAGE_SIZE, state->remaining));
+            for (const auto& body : page.bodies) {
+                if (state->emitted++ > 0) chunk += ',';
+                chunk += *body;
+            }
+            state->remaining -= page.bodies.size();
+            state->cursor = page.nextCursor;
+            state->cursorTime = page.nextTime;
+
+            bool last = page.nextCursor == 0 || state->remaining == 0;
+            if (last) {
+                chunk += ']';
+            }
+            if (!sink.write(chunk.data(), chunk.size())) {
+                return false;
+            }
+            if (last) {
+                sink.done();
+            }
+            return true;
+            });
+    }
+public:
+    explicit TodoAPI(const ServerConfig& serverConfig)
+        : config(serverConfig), mainTenant(serverConfig.storageShards, serverConfig.storageBackend),
+          tenants(serverConfig.maxTenants, serverConfig.tenantStorageShards, serverConfig.storageBackend,
+              serverConfig.dataDir.empty() ? "" : (std::filesystem::path(serverConfig.dataDir) / "tenants").string()),
+          port(serverConfig.port), compressionCache(serverConfig.compressionCacheBytes),
+          idempotency(serverConfig.idempotencyCacheBytes) {
+        std::ostringstream prefix;
+        prefix << std::hex << std::chrono::system_clock::now().time_since_epoch().count();
+        etagPrefix = prefix.str();
+        if (!config.dataDir.empty()) {
+            PersistenceOptions options;
+            options.dataDir = config.dataDir;
+            taskStorage.enablePersistence(options);
+            tenants.loadExisting();
+        }
+        if (!config.replicateFrom.empty()) {
+            if (!config.dataDir.empty()) {
+                throw std::invalid_argument("A replication follower keeps no data directory; drop --data-dir");
+            }
+            follower = std::make_unique<ReplicaFollower>(taskStorage, config.replicateFrom);
+        }
+        applyServerConfig();
+        setupEndpoints();
+        if (config.serverEngine == ServerEngine::Epoll) {
+#ifdef __linux__
+            reactor = std::make_unique<ReactorServer>(routes, config);
+            reactor->new_task_queue = svr.new_task_queue;
+#else
+            throw std::invalid_argument("The epoll server engine needs Linux; use --server-engine threads");
+#endif
+        }
+        else {
+            routes.mount(svr);
+        }
+        if (follower) {
+            follower->start();
+        }
+        else if (config.archiveAfterSeconds > 0) {
+            std::string dir = config.archiveDir;
+            if (dir.empty() && !config.dataDir.empty()) {
+                dir = (std::filesystem::path(config.dataDir) / "archive").string();
+            }
+            archiver = std::make_unique<TaskArchiver>([this] {
+                std::vector<std::pair<std::string, TaskStorage*>> storages = { { "_default", &taskStorage } };
+                tenants.forEach([&](const std::string& name, Tenant& tenant) { storages.emplace_back(name, &tenant.storage); });
+                return storages;
+                }, config.archiveAfterSeconds, config.archiveBatch, dir);
+            archiver->start();
+        }
+    }
+
+    TodoAPI(int port = 8080, size_t storageShards = 16, const std::string& dataDir = "")
+        : TodoAPI(makeConfig(port, storageShards, dataDir)) {
+    }
+
+    static ServerConfig makeConfig(int port, size_t storageShards, const std::string& dataDir) {
+        ServerConfig config;
+        config.port = port;
+        config.storageShards = storageShards;
+        config.dataDir = dataDir;
+        return config;
+    }
+
+    void applyServerConfig() {
+        size_t threads = config.threads;
+        size_t maxQueued = config.maxQueuedRequests;
+        if (config.pinWorkers) {
+            svr.new_task_queue = [threads, maxQueued] { return new PinnedThreadPool(threads, maxQueued); };
+        }
+        else {
+            svr.new_task_queue = [threads, maxQueued] { return new ThreadPool(threads, maxQueued); };
+        }
+        svr.set_keep_alive_max_count(config.keepAliveMaxCount);
+        svr.set_keep_alive_timeout(config.keepAliveTimeoutSeconds);
+        svr.set_read_timeout(config.readTimeoutSeconds);
+        svr.set_write_timeout(config.writeTimeoutSeconds);
+        svr.set_payload_max_length(config.payloadMaxBytes);
+        // Replaces httplib's default socket options, so SO_REUSEADDR is set
+        // here as well; the socket is kept to apply the listen backlog.
+        svr.set_socket_options([this](socket_t sock) {
+            int yes = 1;
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&yes), sizeof(yes));
+            listenSocket = sock;
+            });
+    }
+
+    // Raises the backlog from CPPHTTPLIB_LISTEN_BACKLOG to the configured value.
+    // Repeating listen() on a listening socket updates it on POSIX systems;
+    // Winsock ignores it, so there only the compile-time value applies.
+    void applyListenBacklog() {
+#ifndef _WIN32
+        if (listenSocket != static_cast<socket_t>(-1) && ::listen(listenSocket, config.listenBacklog) != 0) {
+            logWarn("cannot set listen backlog to ", config.listenBacklog);
+        }
+#endif
+    }
+
+    void setupEndpoints() {
+        routes.set_pre_routing_handler([](const Request& req, Response& res) {
+            res.set_header("Access-Control-Allow-Origin", "*");
+            res.set_header("Access-Control-Allow-Methods", "GET, POST, PUT, PATCH, DELETE, OPTIONS");
+            res.set_header("Access-Control-Allow-Headers", "Content-Type, Accept, If-None-Match, If-Match, Idempotency-Key, Last-Event-ID");
+            res.set_header("Access-Control-Expose-Headers", "X-Next-Cursor, ETag, Idempotent-Replayed");
+            res.set_header("Vary", "Accept, Accept-Encoding");
+            requestStart() = Metrics::nowNanos();
+            return Server::HandlerResponse::Unhandled;
+            });
+
+        routes.set_post_routing_handler([](const Request& req, Response& res) {
+            uint64_t& started = requestStart();
+            if (started != 0) {
+                uint64_t elapsed = Metrics::nowNanos() - started;
+                Metrics::instance().recordRequest(routeOf(req), res.status, elapsed);
+                logInfo("access method=", req.method, " path=", req.path, " status=", res.status,
+                    " duration_us=", elapsed / 1000, " bytes=", res.body.size(), " remote=", req.remote_addr);
+                started = 0;
+            }
+            });
+
+        routes.Options(".*", [](const Request& req, Response& res) {
+            res.status = 200;
+            });
+
+        routes.Get("/status", [this](const Request& req, Response& res) {
+            json counts = json::object();
+            for (size_t i = 0; i < TASK_STATUSES.size(); ++i) {
+                counts[TASK_STATUSES[i]] = taskStorage.countByStatus(static_cast<int>(i));
+            }
+            json response = {
+                {"status", "ok"},
+                {"tasks_count", taskStorage.count()},
+                {"tenants", tenants.size()},
+                {"replication", replicationStatus()},
+                {"status_counts", counts},
+                {"log_level", LOG_LEVELS[static_cast<size_t>(Logger::instance().level())]},
+                {"service", "Todo API"}
+            };
+            res.set_content(response.dump(), "application/json");
+            });
+
+        routes.Get("/metrics", [this](const Request& req, Response& res) {
+            std::string body = Metrics::instance().render(metricRoutes());
+            body += "# HELP todo_tasks Number of stored tasks by status.\n";
+            body += "# TYPE todo_tasks gauge\n";
+            for (size_t i = 0; i < TASK_STATUSES.size(); ++i) {
+                body += std::string("todo_tasks{status=\"") + TASK_STATUSES[i] + "\"} "
+                    + std::to_string(taskStorage.countByStatus(static_cast<int>(i))) + "\n";
+            }
+            body += "# HELP todo_tenant_tasks Number of stored tasks per tenant (_default: the /tasks routes).\n";
+            body += "# TYPE todo_tenant_tasks gauge\n";
+            std::string bytes = "# HELP todo_tenant_task_bytes Approximate memory held by the tasks and change feed of a tenant.\n"
+                "# TYPE todo_tenant_task_bytes gauge\n";
+            auto tenantMetrics = [&](const std::string& name, const Tenant& tenant) {
+                body += "todo_tenant_tasks{tenant=\"" + name + "\"} " + std::to_string(tenant.storage.count()) + "\n";
+                bytes += "todo_tenant_task_bytes{tenant=\"" + name + "\"} " + std::to_string(tenant.storage.memoryBytes()) + "\n";
+            };
+            tenantMetrics("_default", mainTenant);
+            tenants.forEach(tenantMetrics);
+            body += bytes;
+            if (follower) {
+                ReplicaFollower::Status replica = follower->status();
+                body += "# HELP todo_replication_connected Whether the follower is streaming from its primary.\n";
+                body += "# TYPE todo_replication_connected gauge\n";
+                body += "todo_replication_connected " + std::to_string(replica.connected ? 1 : 0) + "\n";
+                body += "# HELP todo_replication_lag_events Primary changes this follower has not applied yet.\n";
+                body += "# TYPE todo_replication_lag_events gauge\n";
+                body += "todo_replication_lag_events " + std::to_string(replica.primarySeq - replica.appliedSeq) + "\n";
+                body += "# HELP todo_replication_lag_seconds Time since this follower last had every primary change.\n";
+                body += "# TYPE todo_replication_lag_seconds gauge\n";
+                body += "todo_replication_lag_seconds " + std::to_string(replica.lagSeconds) + "\n";
+                body += "# HELP todo_replication_resyncs_total Full reloads from the primary's snapshot.\n";
+                body += "# TYPE todo_replication_resyncs_total counter\n";
+                body += "todo_replication_resyncs_total " + std::to_string(replica.resyncs) + "\n";
+            }
+            body += "# HELP todo_log_dropped_total Log lines dropped because the log ring was full.\n";
+            body += "# TYPE todo_log_dropped_total counter\n";
+            body += "todo_log_dropped_total " + std::to_string(Logger::instance().dropped()) + "\n";
+            body += "# HELP todo_compression_cache_hits_total Responses served from an already compressed body.\n";
+            body += "# TYPE todo_compression_cache_hits_total counter\n";
+            body += "todo_compression_cache_hits_total " + std::to_string(compressionCache.hits()) + "\n";
+            body += "# HELP todo_compression_cache_misses_total Bodies compressed for the compression cache.\n";
+            body += "# TYPE todo_compression_cache_misses_total counter\n";
+            body += "todo_compression_cache_misses_total " + std::to_string(compressionCache.misses()) + "\n";
+            body += "# HELP todo_expired_tasks_total Done tasks removed by the archiver (--archive-after).\n";
+            body += "# TYPE todo_expired_tasks_total counter\n";
+            body += "todo_expired_tasks_total " + std::to_string(archiver ? archiver->expired() : 0) + "\n";
+            body += "# HELP todo_idempotent_replays_total POSTs answered from the Idempotency-Key cache.\n";
+            body += "# TYPE todo_idempotent_replays_total counter\n";
+            body += "todo_idempotent_replays_total " + std::to_string(idempotency.replays()) + "\n";
+            res.set_content(std::move(body), "text/plain; version=0.0.4");
+            });
+
+        // Full state of the main namespace for a follower: the feed sequence it
+        // is consistent with from then on, and every task as a change record.
+        // The tasks are copied after the sequence is read, so some may already
+        // be newer; replaying the stream from `seq` converges regardless,
+        // because every record carries the full task.
+        routes.Get("/replication/snapshot", [this](const Request& req, Response& res) {
+            uint64_t seq = taskStorage.changes().lastSequence();
+            std::vector<Task> tasks = taskStorage.getAllTasks();
+            std::string body = "{\"primary\":\"" + etagPrefix + "\",\"seq\":" + std::to_string(seq) + ",\"tasks\":[";
+            for (size_t i = 0; i < tasks.size(); ++i) {
+                ChangeFeed::Event event;
+                event.kind = ChangeFeed::Kind::Create;
+                event.id = tasks[i].id;
+                event.body = tasks[i].serialized();
+                event.createTime = tasks[i].create_time;
+                event.updateTime = tasks[i].update_time;
+                if (i > 0) body += ',';
+                body += ChangeFeed::toJson(event, true);
+            }
+            body += "]}";
+            sendBody(req, res, std::move(body));
+            });
+
+        routes.Get("/replication/stream", [this](const Request& req, Response& res) {
+            uint64_t since = 0;
+            if (req.has_param("since") && !parseUnsigned(req.get_param_value("since"), since)) {
+                res.status = 400;
+                res.set_content(json{ {"error", "Invalid since"} }.dump(), "application/json");
+                return;
+            }
+            streamReplication(res, taskStorage.changes(), since);
+            });
+
+        routes.Put("/log-level", [](const Request& req, Response& res) {
+            LogLevel level;
+            json body = json::parse(req.body, nullptr, false);
+            if (body.is_discarded() || !body.contains("level") || !body["level"].is_string()
+                || !parseLogLevel(body["level"].get<std::string>(), level)) {
+                res.status = 400;
+                res.set_content(json{ {"error", "Invalid log level"}, {"valid_levels", LOG_LEVELS} }.dump(), "application/json");
+                return;
+            }
+            Logger::instance().setLevel(level);
+            logWarn("log level set to ", LOG_LEVELS[static_cast<size_t>(level)]);
+            res.set_content(json{ {"level", LOG_LEVELS[static_cast<size_t>(level)]} }.dump(), "application/json");
+            });
+
+        auto getTasks = [this](const Request& req, Response& res) {
+            Tenant* tenant = tenantOf(req, res, false);
+            if (!tenant) return;
+            TaskStorage& storage = tenant->storage;
+            try {
+                TaskQuery query;
+                json error;
+                if (!parseQuery(req, query, error) || !parseFields(req, query.fields, error)) {
+                    res.status = 400;
+                    res.set_content(error.dump(), "application/json");
+                    return;
+                }
+
+                int cursor = 0;
+                int64_t cursorTime = 0;
+                size_t limit = 0;
+                bool byTime = query.order != TaskQuery::Order::Id;
+                if (!parsePaging(req, cursor, limit, error, byTime ? &cursorTime : nullptr)) {
+                    res.status = 400;
+                    res.set_content(error.dump(), "application/json");
+                    return;
+                }
+
+                if (isFlagSet(req, "stream")) {
+                    streamTasks(res, storage, query, cursorTime, cursor, limit);
+                    return;
+                }
+
+                if (notModified(req, res, collectionETag(storage.version(), query.fields))) {
+                    return;
+                }
+
+                if (limit == 0 && query.byIdOnly() && query.fields == ALL_TASK_FIELDS) {
+                    sendBody(req, res, tenant->listings.get(storage, query.status));
+                    return;
+                }
+
+                TaskPage page = storage.queryTasks(query, cursorTime, cursor, limit == 0 ? SIZE_MAX : limit);
+                if (page.nextCursor != 0) {
+                    res.set_header("X-Next-Cursor", nextCursorOf(query, page));
+                }
+                sendBody(req, res, toJsonArray(page.bodies));
+            }
+            catch (const std::exception& e) {
+                logError("error in GET /tasks: ", e.what());
+                res.status = 500;
+                res.set_content(
+                    json{ {"error", "Internal Server Error"}, {"details", e.what()} }.dump(),
+                    "application/json"
+                );
+            }
+            };
+        routes.Get("/tasks", getTasks);
+        routes.Get(tenantRoute("/tasks"), getTasks);
+
+        // ?q= matches tasks whose title or description contains every term;
+        // always paged, DEFAULT_PAGE_LIMIT results unless ?limit= is given.
+        auto searchTasks = [this](const Request& req, Response& res) {
+            Tenant* tenant = tenantOf(req, res, false);
+            if (!tenant) return;
+            TaskStorage& storage = tenant->storage;
+            try {
+                std::string query = req.get_param_value("q");
+                if (searchTerms(query).empty()) {
+                    res.status = 400;
+                    res.set_content(json{ {"error", "Missing or empty search query"} }.dump(), "application/json");
+                    return;
+                }
+
+                int cursor = 0;
+                size_t limit = 0;
+                json pagingError;
+                if (!parsePaging(req, cursor, limit, pagingError)) {
+                    res.status = 400;
+                    res.set_content(pagingError.dump(), "application/json");
+                    return;
+                }
+                if (limit == 0) {
+                    limit = DEFAULT_PAGE_LIMIT;
+                }
+
+                int status = -1;
+                if (req.has_param("status")) {
+                    status = statusIndex(req.get_param_value("status"));
+                    if (status < 0) {
+                        res.status = 400;
+                        res.set_content(invalidStatusError().dump(), "application/json");
+                        return;
+                    }
+                }
+
+                if (notModified(req, res, collectionETag(storage.version()))) {
+                    return;
+                }
+
+                TaskPage page = storage.searchTasks(query, cursor, limit, status);
+                if (page.nextCursor != 0) {
+                    res.set_header("X-Next-Cursor", std::to_string(page.nextCursor));
+                }
+                sendBody(req, res, toJsonArray(page.bodies));
+            }
+            catch (const std::exception& e) {
+                logError("error in GET /tasks/search: ", e.what());
+                res.status = 500;
+                res.set_content(
+                    json{ {"error", "Internal Server Error"}, {"details", e.what()} }.dump(),
+                    "application/json"
+                );
+            }
+            };
+        routes.Get("/tasks/search", searchTasks);
+        routes.Get(tenantRoute("/tasks/search"), searchTasks);
+
+        // ?since= (or Last-Event-ID) defaults to the current sequence, i.e.
+        // only changes made from now on. Long-polls for up to ?timeout=
+        // seconds unless ?stream=sse or Accept: text/event-stream is given.
+        auto getChanges = [this](const Request& req, Response& res) {
+            Tenant* tenant = tenantOf(req, res, false);
+            if (!tenant) return;
+            ChangeFeed& feed = tenant->storage.changes();
+            uint64_t since = feed.lastSequence();
+            uint64_t timeout = DEFAULT_POLL_TIMEOUT_SECONDS;
+            uint64_t limit = MAX_CHANGES_PER_RESPONSE;
+            std::string sinceValue = req.has_param("since") ? req.get_param_value("since") : req.get_header_value("Last-Event-ID");
+            if ((!sinceValue.empty() && !parseUnsigned(sinceValue, since))
+                || (req.has_param("timeout") && !parseUnsigned(req.get_param_value("timeout"), timeout))
+                || (req.has_param("limit") && (!parseUnsigned(req.get_param_value("limit"), limit) || limit == 0))) {
+                res.status = 400;
+                json error = {
+                    {"error", "Invalid change feed parameters"},
+                    {"max_timeout", MAX_POLL_TIMEOUT_SECONDS},
+                    {"max_limit", MAX_CHANGES_PER_RESPONSE}
+                };
+                res.set_content(error.dump(), "application/json");
+                return;
+            }
+            timeout = std::min<uint64_t>(timeout, MAX_POLL_TIMEOUT_SECONDS);
+            limit = std::min<uint64_t>(limit, MAX_CHANGES_PER_RESPONSE);
+
+            if (req.get_param_value("stream") == "sse"
+                || req.get_header_value("Accept").find("text/event-stream") != std::string::npos) {
+                if (since > feed.lastSequence() || since + 1 < feed.oldestSequence()) {
+                    changesGone(res, feed);
+                    return;
+                }
+                streamChanges(res, feed, since);
+                return;
+            }
+
+            std::vector<ChangeFeed::Event> events;
+            bool available = feed.read(since, static_cast<size_t>(limit), events);
+            if (available && events.empty() && timeout > 0
+                && feed.wait(since, std::chrono::seconds(timeout))) {
+                available = feed.read(since, static_cast<size_t>(limit), events);
+            }
+            if (!available) {
+                changesGone(res, feed);
+                return;
+            }
+
+            std::string response = "{\"events\":[";
+            for (size_t i = 0; i < events.size(); ++i) {
+                if (i > 0) response += ',';
+                response += ChangeFeed::toJson(events[i]);
+            }
+            response += "],\"last_seq\":" + std::to_string(events.empty() ? since : events.back().seq) + "}";
+            sendBody(req, res, std::move(response));
+            };
+        routes.Get("/tasks/changes", getChanges);
+        routes.Get(tenantRoute("/tasks/changes"), getChanges);
+
+        auto getTask = [this](const Request& req, Response& res) {
+            Tenant* tenant = tenantOf(req, res, false);
+            if (!tenant) return;
+            TaskStorage& storage = tenant->storage;
+            int id = pathId(req);
+            unsigned fields;
+            json fieldsError;
+            if (!parseFields(req, fields, fieldsError)) {
+                res.status = 400;
+                res.set_content(fieldsError.dump(), "application/json");
+                return;
+            }
+            uint64_t version = 0;
+            auto body = storage.getTaskJson(id, &version, fields);
+
+            if (body) {
+                if (notModified(req, res, taskETag(id, version, fields))) {
+                    return;
+                }
+                if (fields == ALL_TASK_FIELDS) {
+                    sendBody(req, res, body);
+                }
+                else {
+                    sendBody(req, res, std::string(*body));
+                }
+            }
+            else {
+                res.status = 404;
+                json error = { {"error", "Task not found"}, {"id", id} };
+                res.set_content(error.dump(), "application/json");
+            }
+            };
+        routes.Get("/tasks/(\\d+)", getTask);
+        routes.Get(tenantRoute("/tasks/(\\d+)"), getTask);
+
+        auto createTask = [this](const Request& req, Response& res) {
+            Tenant* tenant = tenantOf(req, res, true);
+            if (!tenant) return;
+            TaskStorage& storage = tenant->storage;
+            IdempotencyCache::Reservation reservation(idempotency);
+            if (!reserveIdempotencyKey(req, res, reservation)) {
+                return;
+            }
+            TaskPatch patch;
+            if (!parseTaskBody(req, res, patch)) {
+                return;
+            }
+            if (!patch.title) {
+                titleRequired(res);
+                return;
+            }
+            Task created = storage.createTask(Task::fromPatch(std::move(patch)));
+            std::string etag = taskETag(created.id, created.version);
+            reservation.complete({ 201, etag, created.serialized() });
+
+            res.status = 201;
+            res.set_header("ETag", etag);
+            sendBody(req, res, created.serialized());
+            };
+        routes.Post("/tasks", createTask);
+        routes.Post(tenantRoute("/tasks"), createTask);
+
+        auto applyBatch = [this](const Request& req, Response& res) {
+            Tenant* tenant = tenantOf(req, res, true);
+            if (!tenant) return;
+            TaskStorage& storage = tenant->storage;
+            IdempotencyCache::Reservation reservation(idempotency);
+            if (!reserveIdempotencyKey(req, res, reservation)) {
+                return;
+            }
+            json body;
+            if (!decodeBody(req, res, body)) {
+                return;
+            }
+            if (!body.is_array() || body.empty() || body.size() > MAX_BATCH_OPERATIONS) {
+                res.status = 400;
+                json error = {
+                    {"error", "Body must be a non-empty array of operations"},
+                    {"max_operations", MAX_BATCH_OPERATIONS}
+                };
+                res.set_content(error.dump(), "application/json");
+                return;
+            }
+
+            std::vector<BatchOperation> ops(body.size());
+            json errors = json::array();
+            for (size_t i = 0; i < body.size(); ++i) {
+                json error;
+                if (!parseBatchOperation(body[i], ops[i], error)) {
+                    error["index"] = i;
+                    errors.push_back(error);
+                }
+            }
+            if (!errors.empty()) {
+                res.status = 400;
+                json error = { {"error", "Invalid batch, nothing was applied"}, {"errors", errors} };
+                res.set_content(error.dump(), "application/json");
+                return;
+            }
+
+            std::vector<BatchResult> results = storage.applyBatch(ops);
+
+            std::string response = "{\"results\":[";
+            for (size_t i = 0; i < results.size(); ++i) {
+                const BatchResult& result = results[i];
+                if (i > 0) response += ',';
+                response += "{\"index\":" + std::to_string(i)
+                    + ",\"status\":" + std::to_string(result.status)
+                    + ",\"id\":" + std::to_string(result.id);
+                if (result.body) {
+                    response += ",\"task\":";
+                    response += *result.body;
+                }
+                else if (result.status == 404) {
+                    response += ",\"error\":\"Task not found\"";
+                }
+                response += '}';
+            }
+            response += "]}";
+            if (reservation.active()) {
+                auto shared = std::make_shared<const std::string>(std::move(response));
+                reservation.complete({ 200, "", shared });
+                sendBody(req, res, shared);
+            }
+            else {
+                sendBody(req, res, std::move(response));
+            }
+            };
+        routes.Post("/tasks/batch", applyBatch);
+        routes.Post(tenantRoute("/tasks/batch"), applyBatch);
+
+        auto updateTask = [this](const Request& req, Response& res) {
+            Tenant* tenant = tenantOf(req, res, true);
+            if (!tenant) return;
+            TaskStorage& storage = tenant->storage;
+            int id = pathId(req);
+            TaskPatch patch;
+            if (!parseTaskBody(req, res, patch)) {
+                return;
+            }
+            if (!patch.title) {
+                titleRequired(res);
+                return;
+            }
+            uint64_t expected = 0;
+            if (!ifMatchVersion(req, id, expected)) {
+                preconditionFailed(res, id, 0);
+                return;
+            }
+            uint64_t version = 0;
+            if (TaskBody task = storage.updateTask(id, Task::fromPatch(std::move(patch)), &version, expected)) {
+                res.set_header("ETag", taskETag(id, version));
+                sendBody(req, res, task);
+            }
+            else if (version > 0) {
+                preconditionFailed(res, id, version);
+            }
+            else {
+                res.status = 404;
+                json error = { {"error", "Task not found"}, {"id", id} };
+                res.set_content(error.dump(), "application/json");
+            }
+            };
+        routes.Put("/tasks/(\\d+)", updateTask);
+        routes.Put(tenantRoute("/tasks/(\\d+)"), updateTask);
+
+        auto patchTask = [this](const Request& req, Response& res) {
+            Tenant* tenant = tenantOf(req, res, true);
+            if (!tenant) return;
+            TaskStorage& storage = tenant->storage;
+            int id = pathId(req);
+            TaskPatch patch;
+            if (!parseTaskBody(req, res, patch)) {
+                return;
+            }
+            if (patch.empty()) {
+                res.status = 400;
+                res.set_content(json{ {"error", "No fields to update"} }.dump(), "application/json");
+                return;
+            }
+            uint64_t expected = 0;
+            if (!ifMatchVersion(req, id, expected)) {
+                preconditionFailed(res, id, 0);
+                return;
+            }
+            uint64_t version = 0;
+            if (TaskBody task = storage.patchTask(id, std::move(patch), &version, expected)) {
+                res.set_header("ETag", taskETag(id, version));
+                sendBody(req, res, task);
+            }
+            else if (version > 0) {
+                preconditionFailed(res, id, version);
+            }
+            else {
+                res.status = 404;
+                json error = { {"error", "Task not found"}, {"id", id} };
+                res.set_content(error.dump(), "application/json");
+            }
+            };
+        routes.Patch("/tasks/(\\d+)", patchTask);
+        routes.Patch(tenantRoute("/tasks/(\\d+)"), patchTask);
+
+        auto deleteTask = [this](const Request& req, Response& res) {
+            Tenant* tenant = tenantOf(req, res, true);
+            if (!tenant) return;
+            TaskStorage& storage = tenant->storage;
+            int id = pathId(req);
+            uint64_t expected = 0;
+            if (!ifMatchVersion(req, id, expected)) {
+                preconditionFailed(res, id, 0);
+                return;
+            }
+
+            uint64_t version = 0;
+            if (storage.deleteTask(id, expected, &version)) {
+                res.status = 204;
+            }
+            else if (version > 0) {
+                preconditionFailed(res, id, version);
+            }
+            else {
+                res.status = 404;
+                json error = { {"error", "Task not found"}, {"id", id} };
+                res.set_content(error.dump(), "application/json");
+            }
+            };
+        routes.Delete("/tasks/(\\d+)", deleteTask);
+        routes.Delete(tenantRoute("/tasks/(\\d+)"), deleteTask);
+    }
+
+    void run() {
+        std::cout << "________________________________________" << std::endl;
+        std::cout << "Todo API Server" << std::endl;
+        std::cout << "Address: " << config.host << ":" << port << std::endl;
+        std::cout << "Engine: " << SERVER_ENGINES[static_cast<size_t>(config.serverEngine)];
+        if (config.serverEngine == ServerEngine::Epoll) std::cout << " (" << config.reactorThreads << " reactor threads)";
+        std::cout << std::endl;
+        std::cout << "Worker threads: " << config.threads << (config.pinWorkers ? " (pinned)" : "") << std::endl;
+        std::cout << "Keep-alive: " << config.keepAliveMaxCount << " requests, "
+            << config.keepAliveTimeoutSeconds << "s" << std::endl;
+        std::cout << "Storage shards: " << taskStorage.shardCount()
+            << " (" << STORAGE_BACKENDS[static_cast<size_t>(taskStorage.storageBackend())] << ")" << std::endl;
+        std::cout << "Persistence: " << (taskStorage.isPersistent() ? "WAL + snapshots" : "in-memory") << std::endl;
+        std::cout << "Replication: " << (follower ? "follower of " + follower->primary() : std::string("primary")) << std::endl;
+        if (archiver) {
+            std::cout << "Archival: done tasks after " << config.archiveAfterSeconds << "s, "
+                << (archiver->directory().empty() ? std::string("deleted") : "to " + archiver->directory()) << std::endl;
+        }
+        std::cout << "Tenants: " << tenants.size() << " open, up to " << config.maxTenants
+            << " (" << config.tenantStorageShards << " shards each)" << std::endl;
+        std::string encodings;
+        for (ContentEncoding encoding : { ContentEncoding::Zstd, ContentEncoding::Gzip }) {
+            if (!encodingSupported(encoding)) continue;
+            if (!encodings.empty()) encodings += ", ";
+            encodings += CONTENT_ENCODINGS[static_cast<size_t>(encoding)];
+        }
+        if (config.compression && !encodings.empty()) {
+            std::cout << "Compression: " << encodings << " (from " << config.compressionMinBytes << " bytes)" << std::endl;
+        }
+        else {
+            std::cout << "Compression: off" << std::endl;
+        }
+        std::cout << "Log level: " << LOG_LEVELS[static_cast<size_t>(Logger::instance().level())] << std::endl;
+        std::cout << "________________________________________" << std::endl;
+        std::cout << "Endpoints:" << std::endl;
+        std::cout << "  GET    /status         - API status" << std::endl;
+        std::cout << "  GET    /metrics        - Prometheus metrics" << std::endl;
+        std::cout << "  PUT    /log-level      - Change the log level" << std::endl;
+        std::cout << "  GET    /tasks          - Get all tasks (?status=, ?updated_since=, ?created_before=," << std::endl;
+        std::cout << "                           ?sort=update_time|-update_time, ?fields=, ?limit=&cursor=, ?stream=1)" << std::endl;
+        std::cout << "  GET    /tasks/{id}     - Get task by ID (?fields=id,title,...)" << std::endl;
+        std::cout << "  POST   /tasks          - Create new task" << std::endl;
+        std::cout << "  POST   /tasks/batch    - Create/patch/delete many tasks" << std::endl;
+        std::cout << "  GET    /tasks/changes  - Change feed (?since=, long-poll or ?stream=sse)" << std::endl;
+        std::cout << "  GET    /tasks/search   - Full-text search (?q=, ?status=, ?limit=&cursor=)" << std::endl;
+        std::cout << "  PUT    /tasks/{id}     - Update task" << std::endl;
+        std::cout << "  PATCH  /tasks/{id}     - Partially update task" << std::endl;
+        std::cout << "  DELETE /tasks/{id}     - Delete task" << std::endl;
+        std::cout << "  *      /t/{tenant}/tasks... - The task routes above in a tenant namespace" << std::endl;
+        std::cout << "  GET    /replication/snapshot - Full state for a follower" << std::endl;
+        std::cout << "  GET    /replication/stream   - Change stream for a follower (?since=)" << std::endl;
+        std::cout << "________________________________________" << std::endl;
+
+        initialize();
+
+#ifdef __linux__
+        if (reactor) {
+            if (!reactor->bindToPort(config.host, port)) {
+                throw std::runtime_error("Cannot listen on " + config.host + ":" + std::to_string(port));
+            }
+            reactor->listenAfterBind();
+            return;
+        }
+#endif
+        if (!svr.bind_to_port(config.host, port)) {
+            throw std::runtime_error("Cannot listen on " + config.host + ":" + std::to_string(port));
+        }
+        applyListenBacklog();
+        svr.listen_after_bind();
+    }
+
+    // Binds to a free port on `host` and returns it; serve with listenAfterBind().
+    int bindToAnyPort(const std::string& host = "127.0.0.1") {
+#ifdef __linux__
+        if (reactor) {
+            port = reactor->bindToAnyPort(host);
+            return port;
+        }
+#endif
+        port = svr.bind_to_any_port(host);
+        applyListenBacklog();
+        return port;
+    }
+
+    bool listenAfterBind() {
+#ifdef __linux__
+        if (reactor) return reactor->listenAfterBind();
+#endif
+        return svr.listen_after_bind();
+    }
+
+    void waitUntilReady() const {
+#ifdef __linux__
+        if (reactor) {
+            reactor->waitUntilReady();
+            return;
+        }
+#endif
+        svr.wait_until_ready();
+    }
+
+    void stop() {
+        if (follower) {
+            follower->stop();
+        }
+        if (archiver) {
+            archiver->stop();
+        }
+        taskStorage.changes().close();
+        tenants.forEach([](const std::string&, Tenant& tenant) { tenant.storage.changes().close(); });
+#ifdef __linux__
+        if (reactor) {
+            reactor->stop();
+            return;
+        }
+#endif
+        svr.stop();
+    }
+
+    TaskStorage& storage() {
+        return taskStorage;
+    }
+
+    void initialize() {
+        if (taskStorage.isPersistent() || follower) {
+            return;
+        }
+        taskStorage.createTask(Task(0, "Buy milk", "Fat 3.2%", "todo"));
+        taskStorage.createTask(Task(0, "Run API", "Configure and start server", "in_progress"));
+        taskStorage.createTask(Task(0, "Explore Postman", "Check REST API", "done"));
+    }
+};
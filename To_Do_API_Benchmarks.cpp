@@ -0,0 +1,249 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+
+#include <benchmark/benchmark.h>
+
+#include "To_Do_API.h"
+
+// Microbenchmarks for TaskStorage and Task serialization, built against the
+// real implementation in To_Do_API.h. Storage benchmarks run on tables of
+// 1K/100K/1M tasks and from 1 to 64 threads; the point lookup, patch and
+// page benchmarks take the StorageBackend as a second argument.
+
+namespace {
+    const size_t BENCH_SHARDS = 16;
+
+    Task sampleTask(int i) {
+        return Task(0, "Benchmark task " + std::to_string(i), "Description of a benchmark task", TASK_STATUSES[i % 3]);
+    }
+
+    std::unique_ptr<TaskStorage> buildStorage(int64_t size, int64_t backend) {
+        auto storage = std::make_unique<TaskStorage>(BENCH_SHARDS, static_cast<StorageBackend>(backend));
+        for (int64_t i = 0; i < size; ++i) {
+            storage->createTask(sampleTask(static_cast<int>(i)));
+        }
+        return storage;
+    }
+
+    // Storages are built once per size and backend and shared by every
+    // benchmark and thread that asks for them, so those benchmarks must leave
+    // the table size as they found it.
+    TaskStorage& populatedStorage(int64_t size, int64_t backend = 0) {
+        static std::mutex mtx;
+        static std::map<std::pair<int64_t, int64_t>, std::unique_ptr<TaskStorage>> storages;
+        std::lock_guard<std::mutex> lock(mtx);
+        auto& storage = storages[{ size, backend }];
+        if (!storage) {
+            storage = buildStorage(size, backend);
+        }
+        return *storage;
+    }
+
+    // BM_CreateTask adds tasks, so it gets a table of its own, rebuilt with
+    // state.range(0) tasks before every run: each thread count and each
+    // iteration-count estimate starts from the labelled size.
+    std::unique_ptr<TaskStorage> createStorage;
+
+    void buildCreateStorage(const benchmark::State& state) {
+        createStorage = buildStorage(state.range(0), 0);
+    }
+
+    void dropCreateStorage(const benchmark::State&) {
+        createStorage.reset();
+    }
+
+    int randomId(std::mt19937& rng, int64_t size) {
+        return std::uniform_int_distribution<int>(1, static_cast<int>(size))(rng);
+    }
+
+    void storageSizes(benchmark::internal::Benchmark* b) {
+        b->Arg(1000)->Arg(100000)->Arg(1000000)->ThreadRange(1, 64)->UseRealTime();
+    }
+
+    void backendSizes(benchmark::internal::Benchmark* b) {
+        for (int64_t backend = 0; backend < static_cast<int64_t>(STORAGE_BACKENDS.size()); ++backend) {
+            for (int64_t size : { 1000, 100000, 1000000 }) {
+                b->Args({ size, backend });
+            }
+        }
+        b->ThreadRange(1, 64)->UseRealTime();
+    }
+
+    void listSizes(benchmark::internal::Benchmark* b) {
+        b->Arg(1000)->Arg(100000)->Arg(1000000)->ThreadRange(1, 8)->UseRealTime()->Unit(benchmark::kMillisecond);
+    }
+}
+
+static void BM_CreateTask(benchmark::State& state) {
+    TaskStorage& storage = *createStorage;
+    Task task = sampleTask(state.thread_index());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(storage.createTask(task));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CreateTask)->Apply(storageSizes)->Setup(buildCreateStorage)->Teardown(dropCreateStorage);
+
+// Create/delete churn: every iteration allocates and frees one task node.
+static void BM_CreateDeleteTask(benchmark::State& state) {
+    TaskStorage& storage = populatedStorage(state.range(0), state.range(1));
+    Task task = sampleTask(state.thread_index());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(storage.deleteTask(storage.createTask(task).id));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CreateDeleteTask)->Apply(backendSizes);
+
+static void BM_GetTask(benchmark::State& state) {
+    TaskStorage& storage = populatedStorage(state.range(0), state.range(1));
+    std::mt19937 rng(state.thread_index() + 1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(storage.getTask(randomId(rng, state.range(0))));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetTask)->Apply(backendSizes);
+
+static void BM_GetTaskJson(benchmark::State& state) {
+    TaskStorage& storage = populatedStorage(state.range(0), state.range(1));
+    std::mt19937 rng(state.thread_index() + 1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(storage.getTaskJson(randomId(rng, state.range(0))));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetTaskJson)->Apply(backendSizes);
+
+static void BM_PatchTask(benchmark::State& state) {
+    TaskStorage& storage = populatedStorage(state.range(0), state.range(1));
+    std::mt19937 rng(state.thread_index() + 1);
+    const json updates = { {"status", "in_progress"} };
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(storage.patchTask(randomId(rng, state.range(0)), updates));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PatchTask)->Apply(backendSizes);
+
+static void BM_GetTasksPage(benchmark::State& state) {
+    TaskStorage& storage = populatedStorage(state.range(0), state.range(1));
+    std::mt19937 rng(state.thread_index() + 1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(storage.getTasksPage(randomId(rng, state.range(0)), 100));
+    }
+    state.SetItemsProcessed(state.iterations() * 100);
+}
+BENCHMARK(BM_GetTasksPage)->Apply(backendSizes);
+
+static void BM_GetAllTasks(benchmark::State& state) {
+    TaskStorage& storage = populatedStorage(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(storage.getAllTasks());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GetAllTasks)->Apply(listSizes);
+
+static void BM_GetAllTasksJson(benchmark::State& state) {
+    TaskStorage& storage = populatedStorage(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(storage.getAllTasksJson());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GetAllTasksJson)->Apply(listSizes);
+
+static void BM_TaskToJson(benchmark::State& state) {
+    Task task = sampleTask(1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(task.toJson());
+    }
+}
+BENCHMARK(BM_TaskToJson);
+
+static void BM_TaskToJsonDump(benchmark::State& state) {
+    Task task = sampleTask(1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(task.toJson().dump());
+    }
+}
+BENCHMARK(BM_TaskToJsonDump);
+
+static void BM_TaskProjectionDump(benchmark::State& state) {
+    Task task = sampleTask(1);
+    unsigned fields = 0;
+    parseTaskFields("id,title,status", fields);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(task.toJson(fields).dump());
+    }
+}
+BENCHMARK(BM_TaskProjectionDump);
+
+static void BM_TaskSerializedCached(benchmark::State& state) {
+    Task task = sampleTask(1);
+    task.serialized();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(task.serialized());
+    }
+}
+BENCHMARK(BM_TaskSerializedCached);
+
+static void BM_TaskFromJson(benchmark::State& state) {
+    const json body = sampleTask(1).toJson();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Task::fromJson(body));
+    }
+}
+BENCHMARK(BM_TaskFromJson);
+
+static void BM_ParseAndFromJson(benchmark::State& state) {
+    const std::string body = sampleTask(1).toJson().dump();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Task::fromJson(json::parse(body)));
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(body.size()));
+}
+BENCHMARK(BM_ParseAndFromJson);
+
+static void BM_TaskBodyParser(benchmark::State& state) {
+    const std::string body = sampleTask(1).toJson().dump();
+    for (auto _ : state) {
+        TaskPatch patch;
+        std::string detail;
+        benchmark::DoNotOptimize(TaskBodyParser::parse(body, patch, detail));
+        benchmark::DoNotOptimize(Task::fromPatch(std::move(patch)));
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(body.size()));
+}
+BENCHMARK(BM_TaskBodyParser);
+
+static void BM_TaskArrayDump(benchmark::State& state) {
+    std::vector<Task> tasks;
+    for (int i = 0; i < state.range(0); ++i) {
+        tasks.push_back(sampleTask(i));
+    }
+    for (auto _ : state) {
+        json response = json::array();
+        for (const auto& task : tasks) {
+            response.push_back(task.toJson());
+        }
+        benchmark::DoNotOptimize(response.dump());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TaskArrayDump)->Arg(100)->Arg(1000);
+
+static void BM_FormatTime(benchmark::State& state) {
+    int64_t now = static_cast<int64_t>(std::time(nullptr));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(formatTime(now++ / 16));
+    }
+}
+BENCHMARK(BM_FormatTime);
+
+BENCHMARK_MAIN();
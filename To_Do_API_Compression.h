@@ -0,0 +1,237 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <array>
+#include <unordered_map>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+
+// Response compression. gzip needs zlib (define TODO_API_ZLIB_SUPPORT and
+// link zlib), zstd needs libzstd (TODO_API_ZSTD_SUPPORT); without either,
+// every response goes out as identity. httplib's own compression must stay
+// off: it would compress every response again, whatever its size.
+#if defined(CPPHTTPLIB_ZLIB_SUPPORT) || defined(CPPHTTPLIB_BROTLI_SUPPORT)
+#error "TodoAPI compresses responses itself; build without CPPHTTPLIB_ZLIB_SUPPORT / CPPHTTPLIB_BROTLI_SUPPORT"
+#endif
+
+#ifdef TODO_API_ZLIB_SUPPORT
+#include <zlib.h>
+#endif
+#ifdef TODO_API_ZSTD_SUPPORT
+#include <zstd.h>
+#endif
+
+enum class ContentEncoding : uint8_t { Identity, Gzip, Zstd };
+
+const std::array<const char*, 3> CONTENT_ENCODINGS = { "identity", "gzip", "zstd" };
+
+inline bool encodingSupported(ContentEncoding encoding) {
+    switch (encoding) {
+    case ContentEncoding::Identity: return true;
+#ifdef TODO_API_ZLIB_SUPPORT
+    case ContentEncoding::Gzip: return true;
+#endif
+#ifdef TODO_API_ZSTD_SUPPORT
+    case ContentEncoding::Zstd: return true;
+#endif
+    default: return false;
+    }
+}
+
+// Best encoding this build supports among those an Accept-Encoding header
+// allows: the highest q-value wins, zstd before gzip on a tie; q=0 excludes.
+inline ContentEncoding negotiateEncoding(std::string_view header) {
+    double gzip = -1, zstd = -1, any = -1;
+    size_t start = 0;
+    while (start < header.size()) {
+        size_t end = header.find(',', start);
+        if (end == std::string_view::npos) end = header.size();
+        std::string_view item = header.substr(start, end - start);
+        start = end + 1;
+
+        size_t semicolon = item.find(';');
+        std::string_view name = item.substr(0, semicolon);
+        double q = 1;
+        if (semicolon != std::string_view::npos) {
+            size_t at = item.find("q=", semicolon);
+            if (at != std::string_view::npos) {
+                q = std::strtod(std::string(item.substr(at + 2)).c_str(), nullptr);
+            }
+        }
+        while (!name.empty() && std::isspace(static_cast<unsigned char>(name.front()))) name.remove_prefix(1);
+        while (!name.empty() && std::isspace(static_cast<unsigned char>(name.back()))) name.remove_suffix(1);
+
+        std::string lower;
+        for (char c : name) lower += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        if (lower == "gzip" || lower == "x-gzip") gzip = q;
+        else if (lower == "zstd") zstd = q;
+        else if (lower == "*") any = q;
+    }
+    if (gzip < 0) gzip = any;
+    if (zstd < 0) zstd = any;
+
+    ContentEncoding chosen = ContentEncoding::Identity;
+    double best = 0;
+    if (encodingSupported(ContentEncoding::Zstd) && zstd > best) {
+        chosen = ContentEncoding::Zstd;
+        best = zstd;
+    }
+    if (encodingSupported(ContentEncoding::Gzip) && gzip > best) {
+        chosen = ContentEncoding::Gzip;
+    }
+    return chosen;
+}
+
+// Replaces `out` with `in` compressed; false when the encoding is not
+// available or compression failed.
+inline bool compressBody(ContentEncoding encoding, std::string_view in, std::string& out) {
+#ifdef TODO_API_ZLIB_SUPPORT
+    if (encoding == ContentEncoding::Gzip) {
+        if (in.size() > UINT_MAX) return false;
+        z_stream stream{};
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        out.resize(deflateBound(&stream, static_cast<uLong>(in.size())));
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        stream.avail_in = static_cast<uInt>(in.size());
+        stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        stream.avail_out = static_cast<uInt>(out.size());
+        int result = deflate(&stream, Z_FINISH);
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return result == Z_STREAM_END;
+    }
+#endif
+#ifdef TODO_API_ZSTD_SUPPORT
+    if (encoding == ContentEncoding::Zstd) {
+        thread_local std::unique_ptr<ZSTD_CCtx, size_t(*)(ZSTD_CCtx*)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+        out.resize(ZSTD_compressBound(in.size()));
+        size_t size = ZSTD_compressCCtx(context.get(), &out[0], out.size(), in.data(), in.size(), 3);
+        if (ZSTD_isError(size)) return false;
+        out.resize(size);
+        return true;
+    }
+#endif
+    (void)encoding;
+    (void)in;
+    (void)out;
+    return false;
+}
+
+// Compressed (or otherwise re-encoded) forms of immutable shared bodies (the
+// per-task JSON cache, memoized listings), so a hot body is converted once
+// per variant rather than on every request. Entries are keyed by the body's address and hold a
+// weak reference to it: once a task changes and its old body is freed, the
+// entry can never match again, even if the address is reused, and it ages
+// out of the LRU. Striped so concurrent readers rarely share a mutex.
+class CompressionCache {
+public:
+    using Body = std::shared_ptr<const std::string>;
+
+    static constexpr size_t STRIPES = 16;
+    // Variant slots per body; slot i < CONTENT_ENCODINGS.size() is `body`
+    // compressed with ContentEncoding i, callers number any others.
+    static constexpr size_t VARIANTS = 12;
+
+    explicit CompressionCache(size_t maxBytes) : stripeBytes(maxBytes / STRIPES) {}
+
+    // `body` in `encoding`, compressed on first use; nullptr when compression
+    // is not possible. Results larger than a stripe are returned uncached.
+    Body get(const Body& body, ContentEncoding encoding) {
+        return derive(body, static_cast<size_t>(encoding),
+            [&](std::string& out) { return compressBody(encoding, *body, out); });
+    }
+
+    // Variant `slot` of `body`, made by make(std::string& out) -> bool on
+    // first use; nullptr when make fails.
+    template <class Make>
+    Body derive(const Body& body, size_t slot, Make&& make) {
+        Stripe& stripe = stripes[std::hash<const void*>()(body.get()) % STRIPES];
+        {
+            std::lock_guard<std::mutex> lock(stripe.mtx);
+            auto it = stripe.entries.find(body.get());
+            if (it != stripe.entries.end()) {
+                if (it->second.body.lock() != body) {
+                    stripe.remove(it);
+                }
+                else if (it->second.encoded[slot]) {
+                    stripe.lru.splice(stripe.lru.begin(), stripe.lru, it->second.position);
+                    hitCount.fetch_add(1, std::memory_order_relaxed);
+                    return it->second.encoded[slot];
+                }
+            }
+        }
+
+        std::string out;
+        if (!make(out)) {
+            return nullptr;
+        }
+        missCount.fetch_add(1, std::memory_order_relaxed);
+        auto encoded = std::make_shared<const std::string>(std::move(out));
+        if (encoded->size() > stripeBytes) {
+            return encoded;
+        }
+
+        std::lock_guard<std::mutex> lock(stripe.mtx);
+        auto it = stripe.entries.find(body.get());
+        if (it != stripe.entries.end() && it->second.body.lock() != body) {
+            stripe.remove(it);
+            it = stripe.entries.end();
+        }
+        if (it == stripe.entries.end()) {
+            stripe.lru.push_front(body.get());
+            it = stripe.entries.emplace(body.get(), Entry{ body, {}, stripe.lru.begin() }).first;
+        }
+        if (!it->second.encoded[slot]) {
+            it->second.encoded[slot] = encoded;
+            stripe.bytes += encoded->size();
+        }
+        while (stripe.bytes > stripeBytes && !stripe.lru.empty()) {
+            stripe.remove(stripe.entries.find(stripe.lru.back()));
+        }
+        return encoded;
+    }
+
+    uint64_t hits() const {
+        return hitCount.load(std::memory_order_relaxed);
+    }
+
+    uint64_t misses() const {
+        return missCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry {
+        std::weak_ptr<const std::string> body;
+        std::array<Body, VARIANTS> encoded;
+        std::list<const std::string*>::iterator position;
+    };
+
+    struct Stripe {
+        std::mutex mtx;
+        std::unordered_map<const std::string*, Entry> entries;
+        std::list<const std::string*> lru;
+        size_t bytes = 0;
+
+        void remove(std::unordered_map<const std::string*, Entry>::iterator it) {
+            for (const auto& encoded : it->second.encoded) {
+                if (encoded) bytes -= encoded->size();
+            }
+            lru.erase(it->second.position);
+            entries.erase(it);
+        }
+    };
+
+    size_t stripeBytes;
+    std::array<Stripe, STRIPES> stripes;
+    std::atomic<uint64_t> hitCount{ 0 };
+    std::atomic<uint64_t> missCount{ 0 };
+};
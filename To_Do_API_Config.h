@@ -0,0 +1,256 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <functional>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <cctype>
+
+#include "nlohmann/json.hpp"
+
+#include "To_Do_API_Log.h"
+
+inline std::string getEnv(const char* name) {
+#ifdef _WIN32
+    char* value = nullptr;
+    size_t size = 0;
+    std::string result;
+    if (_dupenv_s(&value, &size, name) == 0 && value) {
+        result = value;
+    }
+    free(value);
+    return result;
+#else
+    const char* value = std::getenv(name);
+    return value ? value : "";
+#endif
+}
+
+// Primary index used by the TaskStorage shards; see TaskIndex.
+enum class StorageBackend : uint8_t { Map, Rcu, Flat, Arena };
+
+const std::array<const char*, 4> STORAGE_BACKENDS = { "map", "rcu", "flat", "arena" };
+
+inline bool parseStorageBackend(const std::string& name, StorageBackend& backend) {
+    for (size_t i = 0; i < STORAGE_BACKENDS.size(); ++i) {
+        if (name == STORAGE_BACKENDS[i]) {
+            backend = static_cast<StorageBackend>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// HTTP front end: httplib's thread per connection, or ReactorServer's epoll
+// reactors (Linux only) with a worker pool for the handlers.
+enum class ServerEngine : uint8_t { Threads, Epoll };
+
+const std::array<const char*, 2> SERVER_ENGINES = { "threads", "epoll" };
+
+inline bool parseServerEngine(const std::string& name, ServerEngine& engine) {
+    for (size_t i = 0; i < SERVER_ENGINES.size(); ++i) {
+        if (name == SERVER_ENGINES[i]) {
+            engine = static_cast<ServerEngine>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Startup configuration of the server. Values are taken, lowest precedence
+// first, from the defaults below, a JSON file (--config or TODO_API_CONFIG),
+// TODO_API_* environment variables and command line flags. Every option has
+// the same name in all three sources: "keep_alive_timeout" in the file,
+// TODO_API_KEEP_ALIVE_TIMEOUT in the environment, --keep-alive-timeout on the
+// command line.
+struct ServerConfig {
+    std::string host = "0.0.0.0";
+    int port = 8080;
+    ServerEngine serverEngine = ServerEngine::Threads;
+    size_t threads = std::max(8u, std::thread::hardware_concurrency());
+    size_t reactorThreads = std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+    size_t maxQueuedRequests = 0;              // 0 = unbounded
+    size_t keepAliveMaxCount = 100;
+    time_t keepAliveTimeoutSeconds = 5;
+    time_t readTimeoutSeconds = 5;
+    time_t writeTimeoutSeconds = 5;
+    size_t payloadMaxBytes = 64 * 1024 * 1024;
+    int listenBacklog = 1024;
+    bool pinWorkers = false;
+    size_t storageShards = 16;
+    StorageBackend storageBackend = StorageBackend::Map;
+    std::string dataDir;
+    size_t maxTenants = 1024;                  // 0 = no /t/{tenant} namespaces
+    size_t tenantStorageShards = 1;
+    std::string replicateFrom;                 // primary URL; empty = this node is a primary
+    int64_t archiveAfterSeconds = 0;           // age of done tasks to expire; 0 = keep them
+    size_t archiveBatch = 256;
+    std::string archiveDir;                    // empty: <dataDir>/archive, or no archive in memory
+    bool compression = true;
+    size_t compressionMinBytes = 1024;
+    size_t compressionCacheBytes = 64 * 1024 * 1024;
+    size_t idempotencyCacheBytes = 16 * 1024 * 1024;   // 0 = Idempotency-Key is ignored
+    LogLevel logLevel = LogLevel::Info;
+    std::string logFile;
+
+    // Throws std::invalid_argument on unknown options or malformed values.
+    static ServerConfig load(int argc, char** argv) {
+        ServerConfig config;
+        std::string file = getEnv("TODO_API_CONFIG");
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (std::string(argv[i]) == "--config") file = argv[i + 1];
+        }
+        if (!file.empty()) {
+            config.loadFile(file);
+        }
+
+        for (const auto& option : config.options()) {
+            std::string value = getEnv(envName(option.name).c_str());
+            if (!value.empty()) option.set(value);
+        }
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg.compare(0, 2, "--") != 0 || i + 1 >= argc) {
+                throw std::invalid_argument("Expected --option value, got " + arg);
+            }
+            std::string value = argv[++i];
+            if (arg == "--config") continue;
+            config.set(flagToName(arg.substr(2)), value);
+        }
+        return config;
+    }
+
+    static std::string usage() {
+        return "Usage: To_Do_API [--config FILE] [--host H] [--port N] [--server-engine threads|epoll]\n"
+            "                 [--threads N] [--reactor-threads N] [--max-queued-requests N]\n"
+            "                 [--keep-alive-max-count N] [--keep-alive-timeout SEC] [--read-timeout SEC]\n"
+            "                 [--write-timeout SEC] [--payload-max-bytes N] [--listen-backlog N]\n"
+            "                 [--pin-workers true|false] [--storage-shards N]\n"
+            "                 [--storage-backend map|rcu|flat|arena] [--data-dir DIR]\n"
+            "                 [--max-tenants N] [--tenant-storage-shards N]\n"
+            "                 [--replicate-from http://HOST:PORT]\n"
+            "                 [--archive-after SEC] [--archive-batch N] [--archive-dir DIR]\n"
+            "                 [--compression true|false] [--compression-min-bytes N]\n"
+            "                 [--compression-cache-bytes N] [--idempotency-cache-bytes N]\n"
+            "                 [--log-level debug|info|warn|error|off] [--log-file PATH]";
+    }
+
+private:
+    struct Option {
+        const char* name;
+        std::function<void(const std::string&)> set;
+    };
+
+    std::vector<Option> options() {
+        return {
+            { "host", [this](const std::string& v) { host = v; } },
+            { "port", [this](const std::string& v) { port = static_cast<int>(number(v, 0, 65535)); } },
+            { "server_engine", [this](const std::string& v) {
+                if (!parseServerEngine(v, serverEngine)) throw std::invalid_argument("Invalid server engine " + v);
+            } },
+            { "threads", [this](const std::string& v) { threads = static_cast<size_t>(number(v, 1, 4096)); } },
+            { "reactor_threads", [this](const std::string& v) { reactorThreads = static_cast<size_t>(number(v, 1, 256)); } },
+            { "max_queued_requests", [this](const std::string& v) { maxQueuedRequests = static_cast<size_t>(number(v, 0, UINT32_MAX)); } },
+            { "keep_alive_max_count", [this](const std::string& v) { keepAliveMaxCount = static_cast<size_t>(number(v, 1, UINT32_MAX)); } },
+            { "keep_alive_timeout", [this](const std::string& v) { keepAliveTimeoutSeconds = static_cast<time_t>(number(v, 0, 3600)); } },
+            { "read_timeout", [this](const std::string& v) { readTimeoutSeconds = static_cast<time_t>(number(v, 0, 3600)); } },
+            { "write_timeout", [this](const std::string& v) { writeTimeoutSeconds = static_cast<time_t>(number(v, 0, 3600)); } },
+            { "payload_max_bytes", [this](const std::string& v) { payloadMaxBytes = static_cast<size_t>(number(v, 1, INT64_MAX)); } },
+            { "listen_backlog", [this](const std::string& v) { listenBacklog = static_cast<int>(number(v, 1, 65535)); } },
+            { "pin_workers", [this](const std::string& v) { pinWorkers = flag(v); } },
+            { "storage_shards", [this](const std::string& v) { storageShards = static_cast<size_t>(number(v, 1, 4096)); } },
+            { "storage_backend", [this](const std::string& v) {
+                if (!parseStorageBackend(v, storageBackend)) throw std::invalid_argument("Invalid storage backend " + v);
+            } },
+            { "data_dir", [this](const std::string& v) { dataDir = v; } },
+            { "max_tenants", [this](const std::string& v) { maxTenants = static_cast<size_t>(number(v, 0, 1000000)); } },
+            { "replicate_from", [this](const std::string& v) {
+                if (!v.empty() && v.compare(0, 7, "http://") != 0 && v.compare(0, 8, "https://") != 0) {
+                    throw std::invalid_argument("Expected an http:// or https:// URL, got " + v);
+                }
+                replicateFrom = v;
+                while (!replicateFrom.empty() && replicateFrom.back() == '/') replicateFrom.pop_back();
+            } },
+            { "archive_after", [this](const std::string& v) { archiveAfterSeconds = number(v, 0, INT32_MAX); } },
+            { "archive_batch", [this](const std::string& v) { archiveBatch = static_cast<size_t>(number(v, 1, 100000)); } },
+            { "archive_dir", [this](const std::string& v) { archiveDir = v; } },
+            { "tenant_storage_shards", [this](const std::string& v) { tenantStorageShards = static_cast<size_t>(number(v, 1, 4096)); } },
+            { "compression", [this](const std::string& v) { compression = flag(v); } },
+            { "compression_min_bytes", [this](const std::string& v) { compressionMinBytes = static_cast<size_t>(number(v, 0, INT64_MAX)); } },
+            { "compression_cache_bytes", [this](const std::string& v) { compressionCacheBytes = static_cast<size_t>(number(v, 0, INT64_MAX)); } },
+            { "idempotency_cache_bytes", [this](const std::string& v) { idempotencyCacheBytes = static_cast<size_t>(number(v, 0, INT64_MAX)); } },
+            { "log_level", [this](const std::string& v) {
+                if (!parseLogLevel(v, logLevel)) throw std::invalid_argument("Invalid log level " + v);
+            } },
+            { "log_file", [this](const std::string& v) { logFile = v; } },
+        };
+    }
+
+    void set(const std::string& name, const std::string& value) {
+        for (const auto& option : options()) {
+            if (name == option.name) {
+                option.set(value);
+                return;
+            }
+        }
+        throw std::invalid_argument("Unknown option " + name);
+    }
+
+    void loadFile(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) {
+            throw std::invalid_argument("Cannot open config file " + path);
+        }
+        nlohmann::json file = nlohmann::json::parse(in, nullptr, false);
+        if (file.is_discarded() || !file.is_object()) {
+            throw std::invalid_argument("Config file " + path + " must hold a JSON object");
+        }
+        for (const auto& item : file.items()) {
+            const auto& value = item.value();
+            if (value.is_string()) set(item.key(), value.get<std::string>());
+            else if (value.is_boolean() || value.is_number_integer()) set(item.key(), value.dump());
+            else throw std::invalid_argument("Invalid value for " + item.key());
+        }
+    }
+
+    static int64_t number(const std::string& value, int64_t min, int64_t max) {
+        size_t used = 0;
+        long long parsed = 0;
+        try {
+            parsed = std::stoll(value, &used);
+        }
+        catch (const std::exception&) {
+            used = 0;
+        }
+        if (used == 0 || used != value.size() || parsed < min || parsed > max) {
+            throw std::invalid_argument("Expected a number between " + std::to_string(min)
+                + " and " + std::to_string(max) + ", got " + value);
+        }
+        return parsed;
+    }
+
+    static bool flag(const std::string& value) {
+        if (value == "1" || value == "true" || value == "yes" || value == "on") return true;
+        if (value == "0" || value == "false" || value == "no" || value == "off") return false;
+        throw std::invalid_argument("Expected true or false, got " + value);
+    }
+
+    static std::string envName(const std::string& name) {
+        std::string env = "TODO_API_";
+        for (char c : name) env += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        return env;
+    }
+
+    static std::string flagToName(std::string flag) {
+        std::replace(flag.begin(), flag.end(), '-', '_');
+        return flag;
+    }
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+
+// Epoch-based reclamation for structures that are read without locks.
+// A reader pins the current global epoch for the lifetime of an EpochGuard;
+// a writer that unlinks an object retires it tagged with the epoch seen
+// after the unlink, and frees it once every pinned epoch is newer than that.
+// Readers touch only their own cache line, so they never contend.
+class EpochDomain {
+public:
+    static constexpr size_t MAX_THREADS = 4096;
+
+    static EpochDomain& instance() {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    uint64_t current() const {
+        return epoch.load();
+    }
+
+    // Starts a new epoch and returns the oldest epoch still pinned by a reader
+    // (the new epoch when none is). Objects retired before it are unreachable.
+    uint64_t advance() {
+        uint64_t oldest = epoch.fetch_add(1) + 1;
+        size_t used = slotsUsed.load();
+        for (size_t i = 0; i < used; ++i) {
+            uint64_t pinned = slots[i].pinned.load();
+            if (pinned != 0 && pinned < oldest) {
+                oldest = pinned;
+            }
+        }
+        return oldest;
+    }
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+private:
+    friend class EpochGuard;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> pinned{ 0 };
+        std::atomic<bool> owned{ false };
+    };
+
+    // Per-thread slot, claimed on first use and handed back when the thread exits.
+    struct ThreadState {
+        Slot* slot = nullptr;
+        unsigned depth = 0;
+
+        ~ThreadState() {
+            if (slot) slot->owned.store(false);
+        }
+    };
+
+    std::array<Slot, MAX_THREADS> slots;
+    std::atomic<size_t> slotsUsed{ 0 };
+    std::atomic<uint64_t> epoch{ 1 };
+
+    EpochDomain() = default;
+
+    ThreadState& local() {
+        thread_local ThreadState state;
+        if (!state.slot) {
+            for (size_t i = 0; i < MAX_THREADS; ++i) {
+                if (!slots[i].owned.exchange(true)) {
+                    state.slot = &slots[i];
+                    size_t used = slotsUsed.load();
+                    while (used < i + 1 && !slotsUsed.compare_exchange_weak(used, i + 1)) {
+                    }
+                    break;
+                }
+            }
+            if (!state.slot) {
+                throw std::runtime_error("EpochDomain: too many reader threads");
+            }
+        }
+        return state;
+    }
+
+    // Publishes the pinned epoch and re-reads the global one: if a writer
+    // advanced in between it may have missed the pin, so pin the newer epoch.
+    void pin(Slot& slot) {
+        uint64_t seen = epoch.load();
+        for (;;) {
+            slot.pinned.store(seen);
+            uint64_t now = epoch.load();
+            if (now == seen) return;
+            seen = now;
+        }
+    }
+};
+
+// Pins the calling thread's epoch; guards nest.
+class EpochGuard {
+public:
+    EpochGuard() : state(EpochDomain::instance().local()) {
+        if (state.depth++ == 0) {
+            EpochDomain::instance().pin(*state.slot);
+        }
+    }
+
+    ~EpochGuard() {
+        if (--state.depth == 0) {
+            state.slot->pinned.store(0, std::memory_order_release);
+        }
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+
+private:
+    EpochDomain::ThreadState& state;
+};
+
+// Objects unlinked from a lock-free structure, waiting until no reader can
+// still see them. Not thread-safe: callers serialize writers themselves.
+template <class T>
+class RetireList {
+public:
+    static constexpr size_t RECLAIM_EVERY = 64;
+
+    RetireList() = default;
+    RetireList(const RetireList&) = delete;
+    RetireList& operator=(const RetireList&) = delete;
+
+    // Nothing may be reading the structure any more when it is destroyed.
+    ~RetireList() {
+        for (auto& item : items) delete item.second;
+    }
+
+    void retire(const T* object) {
+        items.emplace_back(EpochDomain::instance().current(), object);
+        if (items.size() >= threshold) {
+            reclaim();
+        }
+    }
+
+    void reclaim() {
+        uint64_t oldest = EpochDomain::instance().advance();
+        size_t kept = 0;
+        for (auto& item : items) {
+            if (item.first < oldest) {
+                delete item.second;
+            }
+            else {
+                items[kept++] = item;
+            }
+        }
+        items.resize(kept);
+        // A reader parked in an old epoch must not turn every retire into a scan.
+        threshold = kept + RECLAIM_EVERY;
+    }
+
+    size_t pending() const {
+        return items.size();
+    }
+
+private:
+    std::vector<std::pair<uint64_t, const T*>> items;
+    size_t threshold = RECLAIM_EVERY;
+};
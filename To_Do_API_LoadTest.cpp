@@ -0,0 +1,229 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <iomanip>
+
+#include "To_Do_API.h"
+
+// In-process HTTP load test: starts TodoAPI on a free local port and drives
+// it from N keep-alive clients with a weighted mix of requests.
+//
+//   To_Do_API_LoadTest [--threads N] [--duration SEC] [--preload N]
+//                      [--shards N] [--mix get=70,list=5,post=10,patch=10,delete=5]
+//                      [--engine threads|epoll]
+//                      [--log-level debug|info|warn|error|off]
+
+enum class Endpoint { Get, List, Post, Patch, Delete };
+
+const std::array<const char*, 5> ENDPOINT_NAMES = { "get", "list", "post", "patch", "delete" };
+const std::array<const char*, 5> ENDPOINT_ROUTES = {
+    "GET /tasks/{id}", "GET /tasks?limit=100", "POST /tasks", "PATCH /tasks/{id}", "DELETE /tasks/{id}"
+};
+
+struct LoadTestOptions {
+    size_t threads = 8;
+    int durationSeconds = 10;
+    int preload = 1000;
+    size_t shards = 16;
+    ServerEngine engine = ServerEngine::Threads;
+    std::array<int, 5> weights = { 70, 5, 10, 10, 5 };
+    LogLevel logLevel = LogLevel::Warn;
+};
+
+struct EndpointStats {
+    std::vector<uint32_t> latenciesUs;
+    size_t errors = 0;
+};
+
+using ThreadStats = std::array<EndpointStats, ENDPOINT_NAMES.size()>;
+
+bool parseMix(const std::string& mix, std::array<int, 5>& weights) {
+    std::array<int, 5> parsed = { 0, 0, 0, 0, 0 };
+    size_t start = 0;
+    while (start < mix.size()) {
+        size_t end = mix.find(',', start);
+        if (end == std::string::npos) end = mix.size();
+        std::string item = mix.substr(start, end - start);
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        auto name = std::find(ENDPOINT_NAMES.begin(), ENDPOINT_NAMES.end(), item.substr(0, eq));
+        if (name == ENDPOINT_NAMES.end()) return false;
+        parsed[name - ENDPOINT_NAMES.begin()] = std::stoi(item.substr(eq + 1));
+        start = end + 1;
+    }
+    weights = parsed;
+    return true;
+}
+
+bool parseArgs(int argc, char** argv, LoadTestOptions& options) {
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) return false;
+            std::string value = argv[++i];
+            if (arg == "--threads") options.threads = std::stoul(value);
+            else if (arg == "--duration") options.durationSeconds = std::stoi(value);
+            else if (arg == "--preload") options.preload = std::stoi(value);
+            else if (arg == "--shards") options.shards = std::stoul(value);
+            else if (arg == "--mix") {
+                if (!parseMix(value, options.weights)) return false;
+            }
+            else if (arg == "--engine") {
+                if (!parseServerEngine(value, options.engine)) return false;
+            }
+            else if (arg == "--log-level") {
+                if (!parseLogLevel(value, options.logLevel)) return false;
+            }
+            else return false;
+        }
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    int total = 0;
+    for (int weight : options.weights) total += weight;
+    return options.threads > 0 && options.durationSeconds > 0 && total > 0;
+}
+
+uint32_t percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void runClient(int port, const LoadTestOptions& options, std::atomic<int>& maxId,
+    std::atomic<bool>& stop, unsigned seed, ThreadStats& stats) {
+    Client client("127.0.0.1", port);
+    client.set_keep_alive(true);
+
+    std::mt19937 rng(seed);
+    std::discrete_distribution<int> pick(options.weights.begin(), options.weights.end());
+    const std::string body = "{\"title\":\"Load test\",\"description\":\"Generated task\",\"status\":\"todo\"}";
+    const std::array<const char*, 3> patches = {
+        "{\"status\":\"in_progress\"}", "{\"status\":\"done\"}", "{\"title\":\"Renamed\"}"
+    };
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        Endpoint endpoint = static_cast<Endpoint>(pick(rng));
+        int upper = std::max(1, maxId.load(std::memory_order_relaxed));
+        std::string path = "/tasks/" + std::to_string(std::uniform_int_distribution<int>(1, upper)(rng));
+
+        auto started = std::chrono::steady_clock::now();
+        Result result;
+        switch (endpoint) {
+        case Endpoint::Get:
+            result = client.Get(path);
+            break;
+        case Endpoint::List:
+            result = client.Get("/tasks?limit=100&cursor=" + std::to_string(std::uniform_int_distribution<int>(0, upper)(rng)));
+            break;
+        case Endpoint::Post:
+            result = client.Post("/tasks", body, "application/json");
+            break;
+        case Endpoint::Patch:
+            result = client.Patch(path, patches[rng() % patches.size()], "application/json");
+            break;
+        case Endpoint::Delete:
+            result = client.Delete(path);
+            break;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+
+        EndpointStats& endpointStats = stats[static_cast<size_t>(endpoint)];
+        endpointStats.latenciesUs.push_back(static_cast<uint32_t>(std::min<long long>(elapsed.count(), UINT32_MAX)));
+        // Random ids regularly hit deleted tasks, so 404 is an expected answer.
+        if (!result || (result->status >= 400 && result->status != 404)) {
+            ++endpointStats.errors;
+        }
+        else if (endpoint == Endpoint::Post && result->status == 201) {
+            int id = json::parse(result->body)["id"];
+            int current = maxId.load(std::memory_order_relaxed);
+            while (current < id && !maxId.compare_exchange_weak(current, id)) {
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    LoadTestOptions options;
+    if (!parseArgs(argc, argv, options)) {
+        std::cerr << "Usage: To_Do_API_LoadTest [--threads N] [--duration SEC] [--preload N] [--shards N]"
+            << " [--mix get=70,list=5,post=10,patch=10,delete=5] [--engine threads|epoll] [--log-level LEVEL]" << std::endl;
+        return 2;
+    }
+
+    Logger::instance().setLevel(options.logLevel);
+    try {
+        ServerConfig config = TodoAPI::makeConfig(0, options.shards, "");
+        config.serverEngine = options.engine;
+        TodoAPI api(config);
+        for (int i = 0; i < options.preload; ++i) {
+            api.storage().createTask(Task(0, "Preloaded " + std::to_string(i), "Load test data", "todo"));
+        }
+        int port = api.bindToAnyPort();
+        if (port <= 0) {
+            std::cerr << "Error: cannot bind a local port" << std::endl;
+            return 1;
+        }
+        std::thread server([&api] { api.listenAfterBind(); });
+        api.waitUntilReady();
+
+        std::atomic<int> maxId{ options.preload };
+        std::atomic<bool> stop{ false };
+        std::vector<ThreadStats> stats(options.threads);
+        std::vector<std::thread> clients;
+        auto started = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < options.threads; ++i) {
+            clients.emplace_back(runClient, port, std::cref(options), std::ref(maxId), std::ref(stop),
+                static_cast<unsigned>(i + 1), std::ref(stats[i]));
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(options.durationSeconds));
+        stop = true;
+        for (auto& client : clients) {
+            client.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        api.stop();
+        server.join();
+
+        std::cout << "threads=" << options.threads << " duration=" << std::fixed << std::setprecision(1)
+            << seconds << "s shards=" << options.shards << " preload=" << options.preload
+            << " engine=" << SERVER_ENGINES[static_cast<size_t>(options.engine)] << std::endl;
+        std::cout << std::left << std::setw(22) << "endpoint" << std::right
+            << std::setw(10) << "requests" << std::setw(8) << "errors" << std::setw(12) << "req/s"
+            << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(10) << "p999 us"
+            << std::setw(10) << "max us" << std::endl;
+
+        size_t totalRequests = 0;
+        for (size_t e = 0; e < ENDPOINT_NAMES.size(); ++e) {
+            std::vector<uint32_t> latencies;
+            size_t errors = 0;
+            for (const auto& thread : stats) {
+                latencies.insert(latencies.end(), thread[e].latenciesUs.begin(), thread[e].latenciesUs.end());
+                errors += thread[e].errors;
+            }
+            if (latencies.empty()) continue;
+            std::sort(latencies.begin(), latencies.end());
+            totalRequests += latencies.size();
+            std::cout << std::left << std::setw(22) << ENDPOINT_ROUTES[e] << std::right
+                << std::setw(10) << latencies.size() << std::setw(8) << errors
+                << std::setw(12) << std::setprecision(0) << latencies.size() / seconds
+                << std::setw(10) << percentile(latencies, 0.50) << std::setw(10) << percentile(latencies, 0.99)
+                << std::setw(10) << percentile(latencies, 0.999) << std::setw(10) << latencies.back() << std::endl;
+        }
+        std::cout << "total: " << totalRequests << " requests, " << std::setprecision(0)
+            << totalRequests / seconds << " req/s" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
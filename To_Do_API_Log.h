@@ -0,0 +1,253 @@
+#pragma once
+
+#include <string>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <charconv>
+#include <string_view>
+#include <algorithm>
+#include <type_traits>
+
+enum class LogLevel : uint8_t { Debug, Info, Warn, Error, Off };
+
+const std::array<const char*, 5> LOG_LEVELS = { "debug", "info", "warn", "error", "off" };
+
+inline bool parseLogLevel(const std::string& name, LogLevel& level) {
+    for (size_t i = 0; i < LOG_LEVELS.size(); ++i) {
+        if (name == LOG_LEVELS[i]) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Asynchronous logger. Producers format a line into a slot of a bounded
+// lock-free ring (Vyukov MPMC queue used with a single consumer) and return;
+// a background thread drains the ring and writes batches to the output with
+// one fwrite/fflush per batch. When the ring is full the line is dropped and
+// counted rather than blocking the caller.
+class Logger {
+public:
+    static constexpr size_t CAPACITY = 8192;
+    static constexpr size_t LINE_SIZE = 240;
+
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    bool enabled(LogLevel level) const {
+        return level >= minLevel.load(std::memory_order_relaxed) && level != LogLevel::Off;
+    }
+
+    LogLevel level() const {
+        return minLevel.load(std::memory_order_relaxed);
+    }
+
+    void setLevel(LogLevel level) {
+        minLevel.store(level, std::memory_order_relaxed);
+    }
+
+    // Redirects output to `path` (appending); an empty path means stderr.
+    bool setOutput(const std::string& path) {
+        std::FILE* file = stderr;
+        if (!path.empty()) {
+#ifdef _WIN32
+            if (fopen_s(&file, path.c_str(), "a") != 0) file = nullptr;
+#else
+            file = std::fopen(path.c_str(), "a");
+#endif
+            if (!file) return false;
+        }
+        std::lock_guard<std::mutex> lock(outputMtx);
+        if (output != stderr) std::fclose(output);
+        output = file;
+        return true;
+    }
+
+    uint64_t dropped() const {
+        return droppedLines.load(std::memory_order_relaxed);
+    }
+
+    // Concatenates the arguments (strings, characters and numbers) into one
+    // line; anything past LINE_SIZE is cut off.
+    template <class... Args>
+    void write(LogLevel level, const Args&... args) {
+        if (!enabled(level)) return;
+
+        size_t pos = head.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[pos & (CAPACITY - 1)];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) {
+                droppedLines.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->level = level;
+        slot->time = std::chrono::system_clock::now();
+        LineWriter writer{ slot->text, 0 };
+        (writer.append(args), ...);
+        slot->length = static_cast<uint16_t>(writer.length);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    // Writes out everything queued so far; used on shutdown and by tests.
+    void flush() {
+        std::lock_guard<std::mutex> lock(drainMtx);
+        drain();
+    }
+
+    ~Logger() {
+        stop.store(true);
+        if (worker.joinable()) worker.join();
+        flush();
+        if (output != stderr) std::fclose(output);
+    }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence{ 0 };
+        LogLevel level = LogLevel::Info;
+        uint16_t length = 0;
+        std::chrono::system_clock::time_point time;
+        char text[LINE_SIZE];
+    };
+
+    struct LineWriter {
+        char* out;
+        size_t length;
+
+        void append(std::string_view text) {
+            size_t n = std::min(text.size(), LINE_SIZE - length);
+            std::memcpy(out + length, text.data(), n);
+            length += n;
+        }
+        void append(const char* text) { append(std::string_view(text ? text : "")); }
+        void append(const std::string& text) { append(std::string_view(text)); }
+        void append(char c) { if (length < LINE_SIZE) out[length++] = c; }
+        void append(bool value) { append(std::string_view(value ? "true" : "false")); }
+        void append(double value) {
+            char buffer[32];
+            int n = std::snprintf(buffer, sizeof(buffer), "%g", value);
+            append(std::string_view(buffer, n > 0 ? static_cast<size_t>(n) : 0));
+        }
+        template <class T, class = std::enable_if_t<std::is_integral_v<T>>>
+        void append(T value) {
+            char buffer[24];
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+            append(std::string_view(buffer, static_cast<size_t>(result.ptr - buffer)));
+        }
+    };
+
+    std::array<Slot, CAPACITY> slots;
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) size_t tail = 0;
+    std::atomic<uint64_t> droppedLines{ 0 };
+    std::atomic<LogLevel> minLevel{ LogLevel::Info };
+
+    std::mutex outputMtx;
+    std::FILE* output = stderr;
+    std::mutex drainMtx;
+    std::string batch;
+    int64_t cachedSecond = -1;
+    char cachedStamp[24] = {};
+
+    std::atomic<bool> stop{ false };
+    std::thread worker;
+
+    Logger() {
+        for (size_t i = 0; i < CAPACITY; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        worker = std::thread([this] { run(); });
+    }
+
+    void run() {
+        while (!stop.load()) {
+            bool wrote;
+            {
+                std::lock_guard<std::mutex> lock(drainMtx);
+                wrote = drain();
+            }
+            if (!wrote) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    // Single consumer; callers hold drainMtx.
+    bool drain() {
+        batch.clear();
+        for (size_t lines = 0; lines < CAPACITY; ++lines) {
+            Slot& slot = slots[tail & (CAPACITY - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != tail + 1) break;
+            appendLine(slot);
+            slot.sequence.store(tail + CAPACITY, std::memory_order_release);
+            ++tail;
+        }
+        if (batch.empty()) return false;
+        std::lock_guard<std::mutex> lock(outputMtx);
+        std::fwrite(batch.data(), 1, batch.size(), output);
+        std::fflush(output);
+        return true;
+    }
+
+    // "2026-01-31T12:00:00.123Z info <text>"
+    void appendLine(const Slot& slot) {
+        auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(slot.time.time_since_epoch()).count();
+        int64_t second = millis / 1000;
+        if (second != cachedSecond) {
+            std::time_t time = static_cast<std::time_t>(second);
+            std::tm tm;
+#ifdef _WIN32
+            gmtime_s(&tm, &time);
+#else
+            gmtime_r(&time, &tm);
+#endif
+            std::strftime(cachedStamp, sizeof(cachedStamp), "%Y-%m-%dT%H:%M:%S", &tm);
+            cachedSecond = second;
+        }
+        char fraction[6];
+        std::snprintf(fraction, sizeof(fraction), ".%03dZ", static_cast<int>(millis % 1000));
+        batch += cachedStamp;
+        batch += fraction;
+        batch += ' ';
+        batch += LOG_LEVELS[static_cast<size_t>(slot.level)];
+        batch += ' ';
+        batch.append(slot.text, slot.length);
+        batch += '\n';
+    }
+};
+
+template <class... Args>
+void logDebug(const Args&... args) { Logger::instance().write(LogLevel::Debug, args...); }
+
+template <class... Args>
+void logInfo(const Args&... args) { Logger::instance().write(LogLevel::Info, args...); }
+
+template <class... Args>
+void logWarn(const Args&... args) { Logger::instance().write(LogLevel::Warn, args...); }
+
+template <class... Args>
+void logError(const Args&... args) { Logger::instance().write(LogLevel::Error, args...); }
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <iomanip>
+
+// Latency histogram with HDR-style log-linear buckets: values below 16 ns get
+// their own bucket, larger ones fall into 8 sub-buckets per power of two
+// (at most 12.5% relative error) up to 2^40 ns; the last bucket takes the rest.
+// Every histogram is written by a single thread, so increments are plain
+// relaxed load/store pairs instead of locked read-modify-write operations;
+// readers may see a slightly stale but never torn value.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BITS;
+    static constexpr int MAX_EXPONENT = 40;
+    static constexpr size_t BUCKETS = (MAX_EXPONENT - SUB_BITS + 1) * SUB_BUCKETS + 1;
+
+    void record(uint64_t nanos) {
+        bump(counts[bucketOf(nanos)], 1);
+        bump(total, nanos);
+    }
+
+    uint64_t count(size_t bucket) const {
+        return counts[bucket].load(std::memory_order_relaxed);
+    }
+
+    uint64_t sum() const {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    static size_t bucketOf(uint64_t value) {
+        if (value < 2 * SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+        int msb = 63;
+        while (!(value >> msb)) --msb;
+        if (msb >= MAX_EXPONENT) {
+            return BUCKETS - 1;
+        }
+        int shift = msb - SUB_BITS;
+        return static_cast<size_t>(shift + 1) * SUB_BUCKETS + static_cast<size_t>((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    // Largest value that maps to `bucket`.
+    static uint64_t upperBound(size_t bucket) {
+        if (bucket < 2 * SUB_BUCKETS) {
+            return bucket;
+        }
+        if (bucket >= BUCKETS - 1) {
+            return UINT64_MAX;
+        }
+        size_t shift = bucket / SUB_BUCKETS - 1;
+        uint64_t low = (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        return low + (uint64_t(1) << shift) - 1;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> counts{};
+    std::atomic<uint64_t> total{ 0 };
+
+    static void bump(std::atomic<uint64_t>& value, uint64_t delta) {
+        value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+};
+
+// Process-wide metrics registry. Each thread records into its own block,
+// registered once on first use and kept for the life of the process (server
+// threads are pooled, so blocks are not churned); a scrape sums all blocks.
+class Metrics {
+public:
+    enum class LockMode { Read, Write };
+
+    static constexpr size_t MAX_ROUTES = 32;
+    static constexpr std::array<int, 16> STATUS_CODES = {
+        200, 201, 204, 206, 304, 400, 404, 405, 409, 410, 412, 413, 415, 429, 500, 503
+    };
+    static constexpr size_t CODE_SLOTS = STATUS_CODES.size() + 1;
+
+    static Metrics& instance() {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    void recordRequest(size_t route, int status, uint64_t nanos) {
+        if (route >= MAX_ROUTES) return;
+        ThreadBlock& block = local();
+        auto& slot = block.requests[route * CODE_SLOTS + codeSlot(status)];
+        LatencyHistogram* histogram = slot.load(std::memory_order_acquire);
+        if (!histogram) {
+            histogram = new LatencyHistogram();
+            slot.store(histogram, std::memory_order_release);
+        }
+        histogram->record(nanos);
+    }
+
+    void recordLockWait(LockMode mode, uint64_t nanos) {
+        local().lockWait[static_cast<size_t>(mode)].record(nanos);
+    }
+
+    void recordLockHold(LockMode mode, uint64_t nanos) {
+        local().lockHold[static_cast<size_t>(mode)].record(nanos);
+    }
+
+    // Prometheus text exposition of every series recorded so far. `routes`
+    // holds the {method, route} label pair for each route index.
+    std::string render(const std::vector<std::pair<std::string, std::string>>& routes) const {
+        std::ostringstream out;
+        std::lock_guard<std::mutex> lock(registryMtx);
+
+        out << "# HELP todo_http_request_duration_seconds Request latency by route and status code.\n";
+        out << "# TYPE todo_http_request_duration_seconds histogram\n";
+        for (size_t route = 0; route < routes.size() && route < MAX_ROUTES; ++route) {
+            for (size_t code = 0; code < CODE_SLOTS; ++code) {
+                std::vector<const LatencyHistogram*> parts;
+                for (const auto& block : blocks) {
+                    const LatencyHistogram* histogram = block->requests[route * CODE_SLOTS + code].load(std::memory_order_acquire);
+                    if (histogram) parts.push_back(histogram);
+                }
+                if (parts.empty()) continue;
+                std::string labels = "method=\"" + routes[route].first + "\",route=\"" + routes[route].second
+                    + "\",code=\"" + (code < STATUS_CODES.size() ? std::to_string(STATUS_CODES[code]) : std::string("other")) + "\"";
+                writeHistogram(out, "todo_http_request_duration_seconds", labels, parts);
+            }
+        }
+
+        const char* modes[] = { "read", "write" };
+        out << "# HELP todo_storage_lock_wait_seconds Time spent waiting for a TaskStorage shard lock.\n";
+        out << "# TYPE todo_storage_lock_wait_seconds histogram\n";
+        for (size_t mode = 0; mode < 2; ++mode) {
+            std::vector<const LatencyHistogram*> parts;
+            for (const auto& block : blocks) parts.push_back(&block->lockWait[mode]);
+            writeHistogram(out, "todo_storage_lock_wait_seconds", std::string("mode=\"") + modes[mode] + "\"", parts);
+        }
+        out << "# HELP todo_storage_lock_hold_seconds Time a TaskStorage shard lock was held.\n";
+        out << "# TYPE todo_storage_lock_hold_seconds histogram\n";
+        for (size_t mode = 0; mode < 2; ++mode) {
+            std::vector<const LatencyHistogram*> parts;
+            for (const auto& block : blocks) parts.push_back(&block->lockHold[mode]);
+            writeHistogram(out, "todo_storage_lock_hold_seconds", std::string("mode=\"") + modes[mode] + "\"", parts);
+        }
+        return out.str();
+    }
+
+    static uint64_t nowNanos() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+private:
+    struct ThreadBlock {
+        std::array<std::atomic<LatencyHistogram*>, MAX_ROUTES * CODE_SLOTS> requests{};
+        std::array<LatencyHistogram, 2> lockWait;
+        std::array<LatencyHistogram, 2> lockHold;
+
+        ~ThreadBlock() {
+            for (auto& slot : requests) delete slot.load();
+        }
+    };
+
+    // Upper bounds, in seconds, of the exported cumulative buckets.
+    static constexpr std::array<double, 17> EXPORT_BOUNDS = {
+        0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+        0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 5.0
+    };
+
+    mutable std::mutex registryMtx;
+    std::vector<std::unique_ptr<ThreadBlock>> blocks;
+
+    Metrics() = default;
+
+    ThreadBlock& local() {
+        thread_local ThreadBlock* block = nullptr;
+        if (!block) {
+            auto owned = std::make_unique<ThreadBlock>();
+            block = owned.get();
+            std::lock_guard<std::mutex> lock(registryMtx);
+            blocks.push_back(std::move(owned));
+        }
+        return *block;
+    }
+
+    static size_t codeSlot(int status) {
+        for (size_t i = 0; i < STATUS_CODES.size(); ++i) {
+            if (STATUS_CODES[i] == status) return i;
+        }
+        return STATUS_CODES.size();
+    }
+
+    static void writeHistogram(std::ostringstream& out, const std::string& name, const std::string& labels,
+        const std::vector<const LatencyHistogram*>& parts) {
+        std::array<uint64_t, LatencyHistogram::BUCKETS> merged{};
+        uint64_t sum = 0;
+        for (const LatencyHistogram* part : parts) {
+            for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) merged[i] += part->count(i);
+            sum += part->sum();
+        }
+
+        uint64_t cumulative = 0;
+        size_t bucket = 0;
+        for (double bound : EXPORT_BOUNDS) {
+            uint64_t limit = static_cast<uint64_t>(bound * 1e9);
+            while (bucket < LatencyHistogram::BUCKETS && LatencyHistogram::upperBound(bucket) <= limit) {
+                cumulative += merged[bucket++];
+            }
+            out << name << "_bucket{" << labels << ",le=\"" << bound << "\"} " << cumulative << "\n";
+        }
+        while (bucket < LatencyHistogram::BUCKETS) cumulative += merged[bucket++];
+        out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << cumulative << "\n";
+        out << name << "_sum{" << labels << "} " << std::setprecision(9) << sum / 1e9 << "\n";
+        out << name << "_count{" << labels << "} " << cumulative << "\n";
+    }
+};
+
+// Scoped shard lock that reports how long it waited for and held the mutex.
+template <class Lock, Metrics::LockMode Mode>
+class TimedLock {
+public:
+    template <class Mutex>
+    explicit TimedLock(Mutex& mtx) : started(Metrics::nowNanos()), lock(mtx), acquired(Metrics::nowNanos()) {
+        Metrics::instance().recordLockWait(Mode, acquired - started);
+    }
+
+    ~TimedLock() {
+        Metrics::instance().recordLockHold(Mode, Metrics::nowNanos() - acquired);
+    }
+
+    TimedLock(const TimedLock&) = delete;
+    TimedLock& operator=(const TimedLock&) = delete;
+
+private:
+    uint64_t started;
+    Lock lock;
+    uint64_t acquired;
+};
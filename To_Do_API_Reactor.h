@@ -0,0 +1,992 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <regex>
+#include <functional>
+#include <unordered_map>
+#include <exception>
+#include <cstdint>
+#include <cctype>
+#include <cstring>
+#include <cstdio>
+
+#include "httplib.h"
+
+#include "To_Do_API_Config.h"
+#include "To_Do_API_Log.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Routes recorded with httplib::Server's registration calls, so the handlers
+// of TodoAPI::setupEndpoints() serve either engine: mount() hands them to an
+// httplib::Server, ReactorServer dispatches them itself with dispatch().
+class HttpRoutes {
+public:
+    using Handler = httplib::Server::Handler;
+    using PreRouting = httplib::Server::HandlerWithResponse;
+
+    HttpRoutes& Get(const std::string& pattern, Handler handler) { return add("GET", pattern, std::move(handler)); }
+    HttpRoutes& Post(const std::string& pattern, Handler handler) { return add("POST", pattern, std::move(handler)); }
+    HttpRoutes& Put(const std::string& pattern, Handler handler) { return add("PUT", pattern, std::move(handler)); }
+    HttpRoutes& Patch(const std::string& pattern, Handler handler) { return add("PATCH", pattern, std::move(handler)); }
+    HttpRoutes& Delete(const std::string& pattern, Handler handler) { return add("DELETE", pattern, std::move(handler)); }
+    HttpRoutes& Options(const std::string& pattern, Handler handler) { return add("OPTIONS", pattern, std::move(handler)); }
+
+    HttpRoutes& set_pre_routing_handler(PreRouting handler) {
+        preRouting = std::move(handler);
+        return *this;
+    }
+
+    HttpRoutes& set_post_routing_handler(Handler handler) {
+        postRouting = std::move(handler);
+        return *this;
+    }
+
+    void mount(httplib::Server& server) const {
+        if (preRouting) server.set_pre_routing_handler(preRouting);
+        if (postRouting) server.set_post_routing_handler(postRouting);
+        for (const Route& route : routes) {
+            if (route.method == "GET") server.Get(route.pattern, route.handler);
+            else if (route.method == "POST") server.Post(route.pattern, route.handler);
+            else if (route.method == "PUT") server.Put(route.pattern, route.handler);
+            else if (route.method == "PATCH") server.Patch(route.pattern, route.handler);
+            else if (route.method == "DELETE") server.Delete(route.pattern, route.handler);
+            else if (route.method == "OPTIONS") server.Options(route.pattern, route.handler);
+        }
+    }
+
+    // Routes a parsed request the way httplib does: pre-routing handler, the
+    // first route of the method (HEAD uses GET's) whose pattern matches the
+    // whole path, 404 when none does, 500 when the handler throws, then the
+    // post-routing handler.
+    void dispatch(httplib::Request& req, httplib::Response& res) const {
+        bool handled = preRouting && preRouting(req, res) == httplib::Server::HandlerResponse::Handled;
+        if (!handled) {
+            const std::string& method = req.method == "HEAD" ? std::string("GET") : req.method;
+            bool routed = false;
+            for (const Route& route : routes) {
+                if (route.method != method || !std::regex_match(req.path, req.matches, route.regex)) {
+                    continue;
+                }
+                routed = true;
+                try {
+                    route.handler(req, res);
+                }
+                catch (const std::exception& e) {
+                    logError("handler failed method=", req.method, " path=", req.path, " error=", e.what());
+                    res = httplib::Response();
+                    res.status = 500;
+                }
+                break;
+            }
+            if (!routed) {
+                res.status = 404;
+            }
+        }
+        if (res.status == -1) {
+            res.status = 200;
+        }
+        if (postRouting) {
+            postRouting(req, res);
+        }
+    }
+
+private:
+    struct Route {
+        std::string method;
+        std::string pattern;
+        std::regex regex;
+        Handler handler;
+    };
+
+    std::vector<Route> routes;
+    PreRouting preRouting;
+    Handler postRouting;
+
+    HttpRoutes& add(const char* method, const std::string& pattern, Handler handler) {
+        routes.push_back(Route{ method, pattern, std::regex(pattern), std::move(handler) });
+        return *this;
+    }
+};
+
+enum class HttpParse { Incomplete, AwaitingBody, Complete, Invalid };
+
+// Request line and headers must fit in this, like httplib's line limit.
+constexpr size_t HTTP_MAX_HEADER_BYTES = 64 * 1024;
+
+inline const char* httpReason(int status) {
+    switch (status) {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 307: return "Temporary Redirect";
+    case 308: return "Permanent Redirect";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 406: return "Not Acceptable";
+    case 408: return "Request Timeout";
+    case 409: return "Conflict";
+    case 410: return "Gone";
+    case 411: return "Length Required";
+    case 412: return "Precondition Failed";
+    case 413: return "Payload Too Large";
+    case 415: return "Unsupported Media Type";
+    case 422: return "Unprocessable Content";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    default: return "Unknown";
+    }
+}
+
+// %XX escapes, and '+' as a space in query strings.
+inline std::string decodeUrl(std::string_view text, bool plusAsSpace) {
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c == '%' && i + 2 < text.size() && std::isxdigit(static_cast<unsigned char>(text[i + 1]))
+            && std::isxdigit(static_cast<unsigned char>(text[i + 2]))) {
+            out += static_cast<char>(std::stoi(std::string(text.substr(i + 1, 2)), nullptr, 16));
+            i += 2;
+        }
+        else {
+            out += plusAsSpace && c == '+' ? ' ' : c;
+        }
+    }
+    return out;
+}
+
+// Decodes a chunked body starting at `in[start]`; Incomplete until the last
+// chunk and the trailers are in, and then `end` is one past them.
+inline HttpParse decodeChunked(std::string_view in, size_t start, size_t maxBody, std::string& body, size_t& end,
+    int& status) {
+    body.clear();
+    size_t at = start;
+    for (;;) {
+        size_t line = in.find("\r\n", at);
+        if (line == std::string_view::npos) return HttpParse::Incomplete;
+        size_t size = 0;
+        size_t digits = 0;
+        for (; at + digits < line && std::isxdigit(static_cast<unsigned char>(in[at + digits])); ++digits) {
+            if (size > maxBody) break;
+            char c = static_cast<char>(std::tolower(static_cast<unsigned char>(in[at + digits])));
+            size = size * 16 + static_cast<size_t>(c <= '9' ? c - '0' : c - 'a' + 10);
+        }
+        if (digits == 0 || (at + digits < line && in[at + digits] != ';')) {
+            status = 400;
+            return HttpParse::Invalid;
+        }
+        if (body.size() + size > maxBody) {
+            status = 413;
+            return HttpParse::Invalid;
+        }
+        at = line + 2;
+        if (size == 0) {
+            // Trailers are read and dropped.
+            for (;;) {
+                size_t next = in.find("\r\n", at);
+                if (next == std::string_view::npos) return HttpParse::Incomplete;
+                bool last = next == at;
+                at = next + 2;
+                if (last) {
+                    end = at;
+                    return HttpParse::Complete;
+                }
+            }
+        }
+        if (in.size() < at + size + 2) return HttpParse::Incomplete;
+        if (in.compare(at + size, 2, "\r\n") != 0) {
+            status = 400;
+            return HttpParse::Invalid;
+        }
+        body.append(in.data() + at, size);
+        at += size + 2;
+    }
+}
+
+// Parses the first HTTP/1.x request in `in` into `req`. Complete sets
+// `consumed` to its length, so a pipelined request may follow. AwaitingBody
+// means the headers are in but the body is not; `consumed` is then the size
+// the buffer must reach first (0 for a chunked body: unknown). Invalid sets
+// the status to answer with before closing the connection.
+inline HttpParse parseHttpRequest(std::string_view in, size_t maxBody, httplib::Request& req, size_t& consumed,
+    int& status) {
+    size_t headerEnd = in.find("\r\n\r\n");
+    if (headerEnd == std::string_view::npos || headerEnd > HTTP_MAX_HEADER_BYTES) {
+        if (in.size() <= HTTP_MAX_HEADER_BYTES) return HttpParse::Incomplete;
+        status = 431;
+        return HttpParse::Invalid;
+    }
+    req = httplib::Request();
+    status = 400;
+
+    size_t lineEnd = in.find("\r\n");
+    std::string_view line = in.substr(0, lineEnd);
+    size_t first = line.find(' ');
+    size_t second = first == std::string_view::npos ? first : line.find(' ', first + 1);
+    if (second == std::string_view::npos || first == 0) return HttpParse::Invalid;
+    req.method = std::string(line.substr(0, first));
+    req.target = std::string(line.substr(first + 1, second - first - 1));
+    req.version = std::string(line.substr(second + 1));
+    for (char c : req.method) {
+        if (c < 'A' || c > 'Z') return HttpParse::Invalid;
+    }
+    if (req.version != "HTTP/1.1" && req.version != "HTTP/1.0") {
+        status = 505;
+        return HttpParse::Invalid;
+    }
+    if (req.target.empty() || req.target[0] != '/') return HttpParse::Invalid;
+
+    size_t question = req.target.find('?');
+    req.path = decodeUrl(std::string_view(req.target).substr(0, question), false);
+    if (question != std::string::npos) {
+        std::string_view query = std::string_view(req.target).substr(question + 1);
+        size_t start = 0;
+        while (start <= query.size()) {
+            size_t end = query.find('&', start);
+            if (end == std::string_view::npos) end = query.size();
+            std::string_view item = query.substr(start, end - start);
+            if (!item.empty()) {
+                size_t equals = item.find('=');
+                std::string key = decodeUrl(item.substr(0, equals), true);
+                std::string value = equals == std::string_view::npos ? "" : decodeUrl(item.substr(equals + 1), true);
+                req.params.emplace(std::move(key), std::move(value));
+            }
+            start = end + 1;
+        }
+    }
+
+    size_t at = lineEnd + 2;
+    while (at < headerEnd + 2) {
+        size_t end = in.find("\r\n", at);
+        std::string_view header = in.substr(at, end - at);
+        at = end + 2;
+        size_t colon = header.find(':');
+        if (colon == std::string_view::npos || colon == 0) return HttpParse::Invalid;
+        std::string_view value = header.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+        req.headers.emplace(std::string(header.substr(0, colon)), std::string(value));
+    }
+
+    size_t bodyStart = headerEnd + 4;
+    if (req.has_header("Transfer-Encoding")) {
+        std::string encoding = req.get_header_value("Transfer-Encoding");
+        for (char& c : encoding) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        if (encoding != "chunked") {
+            status = 501;
+            return HttpParse::Invalid;
+        }
+        size_t end = 0;
+        HttpParse chunked = decodeChunked(in, bodyStart, maxBody, req.body, end, status);
+        if (chunked == HttpParse::Invalid) return chunked;
+        if (chunked == HttpParse::Incomplete) {
+            consumed = 0;
+            return HttpParse::AwaitingBody;
+        }
+        consumed = end;
+        return HttpParse::Complete;
+    }
+
+    size_t length = 0;
+    if (req.has_header("Content-Length")) {
+        std::string text = req.get_header_value("Content-Length");
+        if (text.empty() || text.size() > 19) return HttpParse::Invalid;
+        for (char c : text) {
+            if (!std::isdigit(static_cast<unsigned char>(c))) return HttpParse::Invalid;
+            length = length * 10 + static_cast<size_t>(c - '0');
+        }
+        if (length > maxBody) {
+            status = 413;
+            return HttpParse::Invalid;
+        }
+    }
+    consumed = bodyStart + length;
+    if (in.size() < consumed) {
+        return HttpParse::AwaitingBody;
+    }
+    req.body = std::string(in.substr(bodyStart, length));
+    return HttpParse::Complete;
+}
+
+#ifdef __linux__
+
+// Event-driven alternative to httplib::Server (ServerEngine::Epoll). A few
+// reactor threads, each with its own epoll set, own the sockets: they accept,
+// read and parse requests and write responses without blocking, so an idle
+// keep-alive connection costs a socket and a buffer rather than a thread.
+// Handlers run on the worker TaskQueue; a connection has at most one request
+// there at a time, and pipelined requests wait in its input buffer, so the
+// responses go out in request order. A chunked response keeps its worker
+// while it streams, as with httplib, and blocks there (not in a reactor)
+// when the client reads slower than it is produced.
+class ReactorServer {
+public:
+    // A streaming worker waits while this much output is still unsent.
+    static constexpr size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+    static constexpr size_t READ_SIZE = 16 * 1024;
+
+    std::function<httplib::TaskQueue* ()> new_task_queue;
+
+    ReactorServer(const HttpRoutes& routes, const ServerConfig& config) : routes(routes), config(config) {}
+
+    ~ReactorServer() {
+        stop();
+        if (listenFd >= 0) ::close(listenFd);
+    }
+
+    ReactorServer(const ReactorServer&) = delete;
+    ReactorServer& operator=(const ReactorServer&) = delete;
+
+    bool bindToPort(const std::string& host, int port) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* found = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0) {
+            return false;
+        }
+        for (addrinfo* info = found; info && listenFd < 0; info = info->ai_next) {
+            int fd = ::socket(info->ai_family, info->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, info->ai_protocol);
+            if (fd < 0) continue;
+            int yes = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+            if (::bind(fd, info->ai_addr, info->ai_addrlen) == 0 && ::listen(fd, config.listenBacklog) == 0) {
+                listenFd = fd;
+            }
+            else {
+                ::close(fd);
+            }
+        }
+        freeaddrinfo(found);
+        return listenFd >= 0;
+    }
+
+    // The port bound to, or -1.
+    int bindToAnyPort(const std::string& host) {
+        if (!bindToPort(host, 0)) return -1;
+        sockaddr_storage address{};
+        socklen_t size = sizeof(address);
+        getsockname(listenFd, reinterpret_cast<sockaddr*>(&address), &size);
+        return address.ss_family == AF_INET6 ? ntohs(reinterpret_cast<sockaddr_in6*>(&address)->sin6_port)
+            : ntohs(reinterpret_cast<sockaddr_in*>(&address)->sin_port);
+    }
+
+    // Serves until stop(); false when nothing is bound or it was stopped.
+    bool listenAfterBind() {
+        if (listenFd < 0 || stopping) return false;
+        workers.reset(new_task_queue ? new_task_queue() : new httplib::ThreadPool(config.threads, config.maxQueuedRequests));
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(stateMtx);
+            for (size_t i = 0; i < config.reactorThreads; ++i) {
+                reactors.push_back(std::make_unique<Reactor>(*this));
+            }
+            for (auto& reactor : reactors) {
+                threads.emplace_back([&reactor] { reactor->run(); });
+            }
+            running = true;
+        }
+        stateCv.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        workers->shutdown();
+        {
+            std::lock_guard<std::mutex> lock(stateMtx);
+            running = false;
+        }
+        stateCv.notify_all();
+        return true;
+    }
+
+    void waitUntilReady() {
+        std::unique_lock<std::mutex> lock(stateMtx);
+        stateCv.wait(lock, [this] { return running || stopping; });
+    }
+
+    bool isRunning() {
+        std::lock_guard<std::mutex> lock(stateMtx);
+        return running;
+    }
+
+    // Accepted connections not closed yet, over all reactors.
+    size_t connectionCount() const {
+        return openConnections.load();
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(stateMtx);
+            stopping = true;
+            for (auto& reactor : reactors) {
+                reactor->wake(nullptr);
+            }
+        }
+        stateCv.notify_all();
+    }
+
+private:
+    class Reactor;
+
+    struct Connection : std::enable_shared_from_this<Connection> {
+        int fd;
+        std::string remoteAddr;
+        int remotePort;
+        Reactor& owner;
+
+        // Reactor thread only.
+        std::string in;
+        size_t inStart = 0;
+        size_t needBytes = 0;
+        size_t served = 0;
+        bool busy = false;
+        bool closeWhenDone = false;
+        bool closeAfterFlush = false;
+        bool readPaused = false;
+        bool continueSent = false;
+        std::chrono::steady_clock::time_point lastActive = std::chrono::steady_clock::now();
+
+        // Shared with the worker serving its request.
+        std::mutex mtx;
+        std::condition_variable drained;
+        std::string out;
+        size_t outSent = 0;
+        bool finished = false;
+        bool abandoned = false;
+        bool closed = false;
+
+        Connection(int fd, std::string remoteAddr, int remotePort, Reactor& owner)
+            : fd(fd), remoteAddr(std::move(remoteAddr)), remotePort(remotePort), owner(owner) {
+        }
+
+        // Queues output from a worker, waiting up to `timeout` for the
+        // client to drain earlier output; false once the connection is gone.
+        bool push(std::string&& data, bool last, std::chrono::seconds timeout) {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                if (!drained.wait_for(lock, timeout, [&] { return closed || out.size() - outSent < MAX_PENDING_OUTPUT; })
+                    || closed) {
+                    return false;
+                }
+                if (out.empty()) out = std::move(data);
+                else out += data;
+                finished = last;
+            }
+            owner.wake(shared_from_this());
+            return true;
+        }
+
+        // Gives up on the response after a failed push: hangs up, so the
+        // client cannot reuse a connection left mid-response, and hands the
+        // connection back to the reactor to be closed.
+        void abandon() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (closed) return;
+                ::shutdown(fd, SHUT_RDWR);
+                finished = true;
+                abandoned = true;
+            }
+            owner.wake(shared_from_this());
+        }
+
+        bool isClosed() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return closed;
+        }
+    };
+
+    class Reactor {
+    public:
+        explicit Reactor(ReactorServer& server) : server(server) {
+            epollFd = epoll_create1(EPOLL_CLOEXEC);
+            eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (epollFd < 0 || eventFd < 0) {
+                throw std::runtime_error(std::string("ReactorServer: ") + std::strerror(errno));
+            }
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.ptr = &eventTag;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, eventFd, &event);
+            event.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+            event.events |= EPOLLEXCLUSIVE;
+#endif
+            event.data.ptr = &listenTag;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, server.listenFd, &event);
+        }
+
+        ~Reactor() {
+            ::close(epollFd);
+            ::close(eventFd);
+        }
+
+        // Has the reactor look at `connection` (nullptr: just wake up).
+        void wake(std::shared_ptr<Connection> connection) {
+            bool first;
+            {
+                std::lock_guard<std::mutex> lock(wakeMtx);
+                first = woken.empty() && !wakePending;
+                if (connection) woken.push_back(std::move(connection));
+                wakePending = true;
+            }
+            if (first) {
+                uint64_t one = 1;
+                ssize_t written = ::write(eventFd, &one, sizeof(one));
+                (void)written;
+            }
+        }
+
+        void run() {
+            std::vector<epoll_event> events(256);
+            auto lastSweep = std::chrono::steady_clock::now();
+            while (!server.stopping) {
+                int count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 1000);
+                for (int i = 0; i < count; ++i) {
+                    void* tag = events[i].data.ptr;
+                    if (tag == &listenTag) {
+                        accept();
+                    }
+                    else if (tag == &eventTag) {
+                        uint64_t value;
+                        ssize_t read = ::read(eventFd, &value, sizeof(value));
+                        (void)read;
+                    }
+                    else {
+                        onEvent(static_cast<Connection*>(tag), events[i].events);
+                    }
+                }
+                serveWoken();
+                auto now = std::chrono::steady_clock::now();
+                if (now - lastSweep >= std::chrono::seconds(1)) {
+                    sweep(now);
+                    lastSweep = now;
+                }
+            }
+            std::vector<Connection*> open;
+            for (auto& item : connections) open.push_back(item.first);
+            for (Connection* connection : open) close(connection);
+            serveWoken();
+        }
+
+    private:
+        ReactorServer& server;
+        int epollFd = -1;
+        int eventFd = -1;
+        char listenTag = 0;
+        char eventTag = 0;
+        std::unordered_map<Connection*, std::shared_ptr<Connection>> connections;
+        std::mutex wakeMtx;
+        std::vector<std::shared_ptr<Connection>> woken;
+        bool wakePending = false;
+
+        void accept() {
+            for (;;) {
+                sockaddr_storage address{};
+                socklen_t size = sizeof(address);
+                int fd = accept4(server.listenFd, reinterpret_cast<sockaddr*>(&address), &size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) continue;
+                    return;
+                }
+                int yes = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+                char host[INET6_ADDRSTRLEN] = {};
+                int port = 0;
+                if (address.ss_family == AF_INET6) {
+                    auto* in6 = reinterpret_cast<sockaddr_in6*>(&address);
+                    inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+                    port = ntohs(in6->sin6_port);
+                }
+                else {
+                    auto* in4 = reinterpret_cast<sockaddr_in*>(&address);
+                    inet_ntop(AF_INET, &in4->sin_addr, host, sizeof(host));
+                    port = ntohs(in4->sin_port);
+                }
+                auto connection = std::make_shared<Connection>(fd, host, port, *this);
+                epoll_event event{};
+                event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                event.data.ptr = connection.get();
+                if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                    ::close(fd);
+                    continue;
+                }
+                connections.emplace(connection.get(), std::move(connection));
+                ++server.openConnections;
+            }
+        }
+
+        void onEvent(Connection* connection, uint32_t events) {
+            if (events & (EPOLLERR | EPOLLHUP)) {
+                close(connection);
+                return;
+            }
+            if (events & EPOLLOUT) {
+                if (!flush(connection)) return;
+                finishIfDone(connection);
+                if (connections.find(connection) == connections.end()) return;
+            }
+            if (events & (EPOLLIN | EPOLLRDHUP)) {
+                onReadable(connection);
+            }
+        }
+
+        // Reads until the socket is drained; stops early while a request is
+        // being served and a full request's worth is already buffered.
+        void onReadable(Connection* connection) {
+            size_t limit = server.config.payloadMaxBytes + HTTP_MAX_HEADER_BYTES;
+            connection->readPaused = false;
+            for (;;) {
+                if (connection->busy && connection->in.size() - connection->inStart > limit) {
+                    connection->readPaused = true;
+                    break;
+                }
+                size_t used = connection->in.size();
+                connection->in.resize(used + READ_SIZE);
+                ssize_t n = ::recv(connection->fd, &connection->in[used], READ_SIZE, 0);
+                connection->in.resize(used + static_cast<size_t>(std::max<ssize_t>(n, 0)));
+                if (n > 0) {
+                    connection->lastActive = std::chrono::steady_clock::now();
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                // Orderly shutdown or error: answer what was already asked.
+                connection->closeAfterFlush = true;
+                break;
+            }
+            next(connection);
+        }
+
+        // Starts the next buffered request when none is being served.
+        void next(Connection* connection) {
+            if (connection->busy || connection->closeWhenDone) {
+                finishIfDone(connection);
+                return;
+            }
+            std::string_view in = std::string_view(connection->in).substr(connection->inStart);
+            if (in.empty() || in.size() < connection->needBytes) {
+                finishIfDone(connection);
+                return;
+            }
+            auto req = std::make_shared<httplib::Request>();
+            size_t consumed = 0;
+            int status = 0;
+            HttpParse parsed = parseHttpRequest(in, server.config.payloadMaxBytes, *req, consumed, status);
+            if (parsed == HttpParse::Incomplete || parsed == HttpParse::AwaitingBody) {
+                connection->needBytes = consumed;
+                if (parsed == HttpParse::AwaitingBody && !connection->continueSent
+                    && req->get_header_value("Expect") == "100-continue") {
+                    connection->continueSent = true;
+                    queue(connection, "HTTP/1.1 100 Continue\r\n\r\n");
+                }
+                finishIfDone(connection);
+                return;
+            }
+            if (parsed == HttpParse::Invalid) {
+                connection->in.clear();
+                connection->inStart = 0;
+                connection->closeWhenDone = true;
+                connection->closeAfterFlush = true;
+                std::string response = "HTTP/1.1 " + std::to_string(status) + " " + httpReason(status)
+                    + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+                queue(connection, response);
+                return;
+            }
+
+            connection->inStart += consumed;
+            if (connection->inStart * 2 >= connection->in.size()) {
+                connection->in.erase(0, connection->inStart);
+                connection->inStart = 0;
+            }
+            connection->needBytes = 0;
+            connection->continueSent = false;
+            connection->busy = true;
+            ++connection->served;
+            req->remote_addr = connection->remoteAddr;
+            req->remote_port = connection->remotePort;
+
+            std::string token = req->get_header_value("Connection");
+            for (char& c : token) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            bool keepAlive = req->version == "HTTP/1.1" ? token.find("close") == std::string::npos
+                : token.find("keep-alive") != std::string::npos;
+            connection->closeWhenDone = !keepAlive || connection->closeAfterFlush || server.stopping
+                || connection->served >= server.config.keepAliveMaxCount;
+
+            std::shared_ptr<Connection> shared = connections[connection];
+            bool close = connection->closeWhenDone;
+            ReactorServer& owner = server;
+            if (!server.workers->enqueue([&owner, shared, req, close] { owner.serve(*shared, *req, close); })) {
+                connection->busy = false;
+                connection->closeWhenDone = true;
+                connection->closeAfterFlush = true;
+                queue(connection, "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            }
+        }
+
+        void queue(Connection* connection, const std::string& data) {
+            {
+                std::lock_guard<std::mutex> lock(connection->mtx);
+                connection->out += data;
+            }
+            if (flush(connection)) finishIfDone(connection);
+        }
+
+        // False when the connection was closed.
+        bool flush(Connection* connection) {
+            std::unique_lock<std::mutex> lock(connection->mtx);
+            while (connection->outSent < connection->out.size()) {
+                ssize_t n = ::send(connection->fd, connection->out.data() + connection->outSent,
+                    connection->out.size() - connection->outSent, MSG_NOSIGNAL);
+                if (n > 0) {
+                    connection->outSent += static_cast<size_t>(n);
+                    connection->lastActive = std::chrono::steady_clock::now();
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                lock.unlock();
+                close(connection);
+                return false;
+            }
+            if (connection->outSent == connection->out.size()) {
+                connection->out.clear();
+                connection->outSent = 0;
+            }
+            else if (connection->outSent >= MAX_PENDING_OUTPUT) {
+                connection->out.erase(0, connection->outSent);
+                connection->outSent = 0;
+            }
+            lock.unlock();
+            connection->drained.notify_all();
+            return true;
+        }
+
+        void finishIfDone(Connection* connection) {
+            if (!connection->closeAfterFlush || connection->busy) return;
+            std::unique_lock<std::mutex> lock(connection->mtx);
+            bool empty = connection->out.empty();
+            lock.unlock();
+            if (empty) close(connection);
+        }
+
+        void serveWoken() {
+            std::vector<std::shared_ptr<Connection>> ready;
+            {
+                std::lock_guard<std::mutex> lock(wakeMtx);
+                ready.swap(woken);
+                wakePending = false;
+            }
+            for (const auto& shared : ready) {
+                Connection* connection = shared.get();
+                if (connections.find(connection) == connections.end()) {
+                    continue;
+                }
+                bool abandoned;
+                {
+                    std::lock_guard<std::mutex> lock(connection->mtx);
+                    abandoned = connection->abandoned;
+                }
+                if (abandoned) {
+                    close(connection);
+                    continue;
+                }
+                if (!flush(connection)) {
+                    continue;
+                }
+                bool finished;
+                {
+                    std::lock_guard<std::mutex> lock(connection->mtx);
+                    finished = connection->finished;
+                    connection->finished = false;
+                }
+                if (!finished) {
+                    finishIfDone(connection);
+                    continue;
+                }
+                connection->busy = false;
+                if (connection->closeWhenDone) {
+                    connection->closeAfterFlush = true;
+                    finishIfDone(connection);
+                }
+                else if (connection->readPaused) {
+                    onReadable(connection);
+                }
+                else {
+                    next(connection);
+                }
+            }
+        }
+
+        // Closes connections idle past the keep-alive timeout, stuck
+        // mid-request past the read timeout or not reading their response
+        // past the write timeout. A connection being served is left alone
+        // unless its output stopped draining; its worker then sees `closed`.
+        void sweep(std::chrono::steady_clock::time_point now) {
+            std::vector<Connection*> expired;
+            for (auto& item : connections) {
+                Connection* connection = item.first;
+                bool pending;
+                {
+                    std::lock_guard<std::mutex> lock(connection->mtx);
+                    pending = !connection->out.empty();
+                }
+                if (connection->busy && !pending) continue;
+                time_t seconds = pending ? server.config.writeTimeoutSeconds
+                    : connection->in.size() > connection->inStart ? server.config.readTimeoutSeconds
+                    : server.config.keepAliveTimeoutSeconds;
+                if (now - connection->lastActive >= std::chrono::seconds(seconds)) {
+                    expired.push_back(connection);
+                }
+            }
+            for (Connection* connection : expired) close(connection);
+        }
+
+        void close(Connection* connection) {
+            auto it = connections.find(connection);
+            if (it == connections.end()) return;
+            {
+                // Before the descriptor is closed (and may be reused): a worker
+                // only touches it while it finds `closed` unset.
+                std::lock_guard<std::mutex> lock(connection->mtx);
+                connection->closed = true;
+            }
+            connection->drained.notify_all();
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+            ::close(connection->fd);
+            // A worker still serving it holds its own reference.
+            connections.erase(it);
+            --server.openConnections;
+        }
+    };
+
+    const HttpRoutes& routes;
+    const ServerConfig& config;
+    int listenFd = -1;
+    std::unique_ptr<httplib::TaskQueue> workers;
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    std::atomic<bool> stopping{ false };
+    std::atomic<size_t> openConnections{ 0 };
+    bool running = false;
+    std::mutex stateMtx;
+    std::condition_variable stateCv;
+
+    static std::string head(const httplib::Request& req, const httplib::Response& res, bool close,
+        const ServerConfig& config) {
+        std::string out = "HTTP/1.1 " + std::to_string(res.status) + " " + httpReason(res.status) + "\r\n";
+        for (const auto& header : res.headers) {
+            out += header.first;
+            out += ": ";
+            out += header.second;
+            out += "\r\n";
+        }
+        if (close) {
+            out += "Connection: close\r\n";
+        }
+        else {
+            out += "Connection: keep-alive\r\nKeep-Alive: timeout=" + std::to_string(config.keepAliveTimeoutSeconds)
+                + ", max=" + std::to_string(config.keepAliveMaxCount) + "\r\n";
+        }
+        (void)req;
+        return out;
+    }
+
+    static bool bodyless(const httplib::Request& req, int status) {
+        return req.method == "HEAD" || status == 204 || status == 304 || (status >= 100 && status < 200);
+    }
+
+    // Worker side of one request: runs the handler and hands the response to
+    // the connection's reactor, streaming it chunk by chunk when the handler
+    // set a content provider.
+    void serve(Connection& connection, httplib::Request& req, bool close) {
+        httplib::Response res;
+        routes.dispatch(req, res);
+        std::chrono::seconds timeout(config.writeTimeoutSeconds);
+        bool noBody = bodyless(req, res.status);
+
+        if (!res.content_provider_ || noBody) {
+            std::string out = head(req, res, close, config);
+            if (res.status >= 200 && res.status != 204 && res.status != 304) {
+                out += "Content-Length: " + std::to_string(res.content_provider_ ? res.content_length_ : res.body.size()) + "\r\n";
+            }
+            out += "\r\n";
+            if (!noBody) out += res.body;
+            if (!connection.push(std::move(out), true, timeout)) connection.abandon();
+            return;
+        }
+
+        bool chunked = res.is_chunked_content_provider_;
+        std::string out = head(req, res, close, config);
+        out += chunked ? "Transfer-Encoding: chunked\r\n\r\n" : "Content-Length: " + std::to_string(res.content_length_) + "\r\n\r\n";
+        if (!connection.push(std::move(out), false, timeout)) {
+            connection.abandon();
+            return;
+        }
+
+        size_t offset = 0;
+        bool ok = true;
+        bool done = false;
+        httplib::DataSink sink;
+        sink.write = [&](const char* data, size_t size) {
+            if (size == 0) return true;
+            std::string piece;
+            if (chunked) {
+                char hex[32];
+                std::snprintf(hex, sizeof(hex), "%zx\r\n", size);
+                piece = hex;
+            }
+            piece.append(data, size);
+            if (chunked) piece += "\r\n";
+            if (!connection.push(std::move(piece), false, timeout)) {
+                ok = false;
+                return false;
+            }
+            offset += size;
+            return true;
+        };
+        sink.done = [&] { done = true; };
+        sink.is_writable = [&] { return !connection.isClosed(); };
+        while (ok && !done && (chunked || offset < res.content_length_)) {
+            if (!res.content_provider_(offset, chunked ? 0 : res.content_length_ - offset, sink)) ok = false;
+        }
+        if (!ok || !connection.push(chunked ? "0\r\n\r\n" : "", true, timeout)) {
+            // The client got a truncated response.
+            connection.abandon();
+        }
+    }
+};
+
+#endif
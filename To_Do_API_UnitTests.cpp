@@ -1,366 +1,1489 @@
-﻿#include "pch.h"
-#include "CppUnitTest.h"
-#include <iostream>
-#include <string>
-#include <vector>
-#include <map>
-#include <memory>
-#include <mutex>
-#include <ctime>
-#include <sstream>
-#include <iomanip>
-
-#include "nlohmann/json.hpp"
-#include "httplib.h"
-
-using json = nlohmann::json;
-using namespace Microsoft::VisualStudio::CppUnitTestFramework;
-
-namespace TestCode {
-    class Task {
-    public:
-        int id;
-        std::string title;
-        std::string description;
-        std::string status;
-        std::string create_time;
-        std::string update_time;
-
-        Task() : id(0), status("todo") {
-            setTime();
-        }
-
-        Task(int id, const std::string& title, const std::string& description, const std::string& status)
-            : id(id), title(title), description(description), status(status) {
-            setTime();
-        }
-
-        void setTime() {
-            auto t = std::time(nullptr);
-            std::tm tm;
-            localtime_s(&tm, &t);
-            std::ostringstream oss;
-            oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
-            create_time = oss.str();
-            update_time = create_time;
-        }
-
-        void updateTime() {
-            auto t = std::time(nullptr);
-            std::tm tm;
-            localtime_s(&tm, &t);
-            std::ostringstream oss;
-            oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
-            update_time = oss.str();
-        }
-
-        json toJson() const {
-            try {
-                return json{
-                    {"id", id},
-                    {"title", title},
-                    {"description", description},
-                    {"status", status},
-                    {"create_time", create_time},
-                    {"update_time", update_time}
-                };
-            }
-            catch (const std::exception& e) {
-                std::cerr << "error in Task::toJson: " << e.what() << std::endl;
-                return json{ {"error", "Failed to serialize task"} };
-            }
-        }
-
-        static Task fromJson(const json& j) {
-            Task task;
-            if (j.contains("title")) task.title = j["title"];
-            if (j.contains("description")) task.description = j["description"];
-            if (j.contains("status")) task.status = j["status"];
-            return task;
-        }
-    };
-
-    class TaskStorage {
-    private:
-        std::map<int, Task> tasks;
-        int nextId = 1;
-        mutable std::mutex mtx;
-
-    public:
-        Task createTask(const Task& task) {
-            std::lock_guard<std::mutex> lock(mtx);
-            Task newTask = task;
-            newTask.id = nextId++;
-            newTask.setTime();
-            tasks[newTask.id] = newTask;
-            return newTask;
-        }
-
-        std::vector<Task> getAllTasks() const {
-            std::lock_guard<std::mutex> lock(mtx);
-            std::vector<Task> result;
-            for (const auto& pair : tasks) {
-                result.push_back(pair.second);
-            }
-            return result;
-        }
-
-        Task getTask(int id) const {
-            std::lock_guard<std::mutex> lock(mtx);
-            auto it = tasks.find(id);
-            if (it != tasks.end()) {
-                return it->second;
-            }
-            return Task();
-        }
-
-        bool updateTask(int id, const Task& updatedTask) {
-            std::lock_guard<std::mutex> lock(mtx);
-            auto it = tasks.find(id);
-            if (it != tasks.end()) {
-                Task& task = it->second;
-                task.title = updatedTask.title;
-                task.description = updatedTask.description;
-                task.status = updatedTask.status;
-                task.updateTime();
-                return true;
-            }
-            return false;
-        }
-
-        bool patchTask(int id, const json& updates) {
-            std::lock_guard<std::mutex> lock(mtx);
-            auto it = tasks.find(id);
-            if (it != tasks.end()) {
-                Task& task = it->second;
-                if (updates.contains("title")) {
-                    task.title = updates["title"];
-                }
-                if (updates.contains("description")) {
-                    task.description = updates["description"];
-                }
-                if (updates.contains("status")) {
-                    task.status = updates["status"];
-                }
-                task.updateTime();
-                return true;
-            }
-            return false;
-        }
-
-        bool deleteTask(int id) {
-            std::lock_guard<std::mutex> lock(mtx);
-            return tasks.erase(id) > 0;
-        }
-
-        size_t count() const {
-            std::lock_guard<std::mutex> lock(mtx);
-            return tasks.size();
-        }
-    };
-
-    bool isStatusValid(const std::string& status) {
-        return status == "todo" || status == "in_progress" || status == "done";
-    }
-}
-
-using namespace TestCode;
-
-namespace ToDoAPIUnitTests
-{
-    TEST_CLASS(TaskTests)
-    {
-    public:
-
-        TEST_METHOD(TestDefaultConstructor)
-        {
-            Task task;
-
-            Assert::AreEqual(0, task.id);
-            Assert::AreEqual(std::string(""), task.title);
-            Assert::AreEqual(std::string(""), task.description);
-            Assert::AreEqual(std::string("todo"), task.status);
-            Assert::IsFalse(task.create_time.empty());
-            Assert::IsFalse(task.update_time.empty());
-        }
-
-        TEST_METHOD(TestParameterConstructor)
-        {
-            Task task(1, "Test Title", "Test Description", "in_progress");
-
-            Assert::AreEqual(1, task.id);
-            Assert::AreEqual(std::string("Test Title"), task.title);
-            Assert::AreEqual(std::string("Test Description"), task.description);
-            Assert::AreEqual(std::string("in_progress"), task.status);
-            Assert::IsFalse(task.create_time.empty());
-            Assert::IsFalse(task.update_time.empty());
-            Assert::AreEqual(task.create_time, task.update_time);
-        }
-        TEST_METHOD(TestToJson)
-        {
-            Task task(42, "Json Test", "Json Description", "done");
-
-            json j = task.toJson();
-
-            Assert::AreEqual(42, j["id"].get<int>());
-            Assert::AreEqual(std::string("Json Test"), j["title"].get<std::string>());
-            Assert::AreEqual(std::string("Json Description"), j["description"].get<std::string>());
-            Assert::AreEqual(std::string("done"), j["status"].get<std::string>());
-            Assert::IsTrue(j.contains("create_time"));
-            Assert::IsTrue(j.contains("update_time"));
-        }
-
-        TEST_METHOD(TestFromJson)
-        {
-            json j = {
-                {"title", "New Task"},
-                {"description", "Task Description"},
-                {"status", "in_progress"}
-            };
-
-            Task task = Task::fromJson(j);
-
-            Assert::AreEqual(std::string("New Task"), task.title);
-            Assert::AreEqual(std::string("Task Description"), task.description);
-            Assert::AreEqual(std::string("in_progress"), task.status);
-            Assert::AreEqual(0, task.id);
-        }
-
-        TEST_METHOD(TestFromJsonPartial)
-        {
-            json j = {
-                {"title", "Partial Task"}
-            };
-
-            Task task = Task::fromJson(j);
-
-            Assert::AreEqual(std::string("Partial Task"), task.title);
-            Assert::AreEqual(std::string(""), task.description);
-            Assert::AreEqual(std::string("todo"), task.status);
-        }
-    };
-
-    TEST_CLASS(TaskStorageTests)
-    {
-    public:
-
-        TEST_METHOD(TestCreateTask)
-        {
-            TaskStorage storage;
-            Task task(0, "Test Task", "Test Description", "todo");
-
-            Task created = storage.createTask(task);
-
-            Assert::IsTrue(created.id > 0);
-            Assert::AreEqual(std::string("Test Task"), created.title);
-            Assert::AreEqual(std::string("todo"), created.status);
-        }
-
-        TEST_METHOD(TestGetTask)
-        {
-            TaskStorage storage;
-            Task task(0, "Test", "Description", "todo");
-            Task created = storage.createTask(task);
-
-            Task task1 = storage.getTask(created.id);
-
-            Assert::AreEqual(created.id, task1.id);
-            Assert::AreEqual(std::string("Test"), task1.title);
-            Assert::AreEqual(std::string("Description"), task1.description);
-        }
-
-        TEST_METHOD(TestGetNonExistentTask)
-        {
-            TaskStorage storage;
-
-            Task task = storage.getTask(999);
-
-            Assert::AreEqual(0, task.id);
-        }
-
-        TEST_METHOD(TestGetAllTasks)
-        {
-            TaskStorage storage;
-
-            storage.createTask(Task(0, "Task 1", "Desc 1", "todo"));
-            storage.createTask(Task(0, "Task 2", "Desc 2", "in_progress"));
-            storage.createTask(Task(0, "Task 3", "Desc 3", "done"));
-
-            auto tasks = storage.getAllTasks();
-
-            Assert::AreEqual(static_cast<size_t>(3), tasks.size());
-            Assert::AreEqual(std::string("Task 1"), tasks[0].title);
-            Assert::AreEqual(std::string("Task 2"), tasks[1].title);
-            Assert::AreEqual(std::string("Task 3"), tasks[2].title);
-        }
-
-        TEST_METHOD(TestUpdateTask)
-        {
-            TaskStorage storage;
-            Task original(0, "Original", "Original Desc", "todo");
-            Task created = storage.createTask(original);
-
-            Task updated(0, "Updated", "Updated Desc", "in_progress");
-            bool success = storage.updateTask(created.id, updated);
-
-            Assert::IsTrue(success);
-
-            Task task = storage.getTask(created.id);
-            Assert::AreEqual(std::string("Updated"), task.title);
-            Assert::AreEqual(std::string("Updated Desc"), task.description);
-            Assert::AreEqual(std::string("in_progress"), task.status);
-        }
-
-        TEST_METHOD(TestUpdateNonExistentTask)
-        {
-            TaskStorage storage;
-            Task task(0, "Test", "Desc", "todo");
-
-            bool success = storage.updateTask(999, task);
-
-            Assert::IsFalse(success);
-        }
-
-        TEST_METHOD(TestDeleteTask)
-        {
-            TaskStorage storage;
-            Task task(0, "Test", "Desc", "todo");
-            Task created = storage.createTask(task);
-
-            bool deleted = storage.deleteTask(created.id);
-
-            Assert::IsTrue(deleted);
-
-            Task task1 = storage.getTask(created.id);
-            Assert::AreEqual(0, task.id);
-        }
-
-        TEST_METHOD(TestStorageCount)
-        {
-            TaskStorage storage;
-
-            Assert::AreEqual(static_cast<size_t>(0), storage.count());
-
-            storage.createTask(Task(0, "Task 1", "Desc 1", "todo"));
-            Assert::AreEqual(static_cast<size_t>(1), storage.count());
-
-            storage.createTask(Task(0, "Task 2", "Desc 2", "in_progress"));
-            Assert::AreEqual(static_cast<size_t>(2), storage.count());
-        }
-    };
-
-    TEST_CLASS(ValidationTests)
-    {
-    public:
-
-        TEST_METHOD(TestIsStatusValid)
-        {
-            Assert::IsTrue(isStatusValid("todo"));
-            Assert::IsTrue(isStatusValid("in_progress"));
-            Assert::IsTrue(isStatusValid("done"));
-
-            Assert::IsFalse(isStatusValid(""));
-            Assert::IsFalse(isStatusValid("invalid"));
-        }
-    };
-}
\ No newline at end of file
+#include "pch.h"
+#include "CppUnitTest.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include "To_Do_API.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace ToDoAPIUnitTests
+{
+    TEST_CLASS(TaskTests)
+    {
+    public:
+
+        TEST_METHOD(TestDefaultConstructor)
+        {
+            Task task;
+
+            Assert::AreEqual(0, task.id);
+            Assert::AreEqual(std::string(""), task.title);
+            Assert::AreEqual(std::string(""), task.description);
+            Assert::IsTrue(task.status == TaskStatus::Todo);
+            Assert::IsTrue(task.create_time == 0);
+            Assert::IsTrue(task.update_time == 0);
+        }
+
+        TEST_METHOD(TestParameterConstructor)
+        {
+            Task task(1, "Test Title", "Test Description", "in_progress");
+
+            Assert::AreEqual(1, task.id);
+            Assert::AreEqual(std::string("Test Title"), task.title);
+            Assert::AreEqual(std::string("Test Description"), task.description);
+            Assert::IsTrue(task.status == TaskStatus::InProgress);
+            Assert::IsTrue(task.create_time > 0);
+            Assert::IsTrue(task.create_time == task.update_time);
+        }
+        TEST_METHOD(TestToJson)
+        {
+            Task task(42, "Json Test", "Json Description", "done");
+
+            json j = task.toJson();
+
+            Assert::AreEqual(42, j["id"].get<int>());
+            Assert::AreEqual(std::string("Json Test"), j["title"].get<std::string>());
+            Assert::AreEqual(std::string("Json Description"), j["description"].get<std::string>());
+            Assert::AreEqual(std::string("done"), j["status"].get<std::string>());
+            Assert::IsTrue(j.contains("create_time"));
+            Assert::IsTrue(j.contains("update_time"));
+            Assert::AreEqual(formatTime(task.create_time), j["create_time"].get<std::string>());
+        }
+
+        TEST_METHOD(TestSerializedIsCachedUntilUpdate)
+        {
+            Task task(7, "Cached", "Body", "todo");
+
+            TaskBody first = task.serialized();
+            Assert::IsTrue(first == task.serialized());
+            Assert::AreEqual(task.toJson().dump(), *first);
+
+            task.title = "Changed";
+            task.updateTime();
+            Assert::IsTrue(task.body == nullptr);
+            Assert::AreEqual(std::string("Changed"), json::parse(*task.serialized())["title"].get<std::string>());
+        }
+
+        TEST_METHOD(TestFromJson)
+        {
+            json j = {
+                {"title", "New Task"},
+                {"description", "Task Description"},
+                {"status", "in_progress"}
+            };
+
+            Task task = Task::fromJson(j);
+
+            Assert::AreEqual(std::string("New Task"), task.title);
+            Assert::AreEqual(std::string("Task Description"), task.description);
+            Assert::IsTrue(task.status == TaskStatus::InProgress);
+            Assert::AreEqual(0, task.id);
+        }
+
+        TEST_METHOD(TestFromJsonPartial)
+        {
+            json j = {
+                {"title", "Partial Task"}
+            };
+
+            Task task = Task::fromJson(j);
+
+            Assert::AreEqual(std::string("Partial Task"), task.title);
+            Assert::AreEqual(std::string(""), task.description);
+            Assert::IsTrue(task.status == TaskStatus::Todo);
+        }
+    };
+
+    TEST_CLASS(TaskStorageTests)
+    {
+    public:
+
+        TEST_METHOD(TestCreateTask)
+        {
+            TaskStorage storage;
+            Task task(0, "Test Task", "Test Description", "todo");
+
+            Task created = storage.createTask(task);
+
+            Assert::IsTrue(created.id > 0);
+            Assert::AreEqual(std::string("Test Task"), created.title);
+            Assert::IsTrue(created.status == TaskStatus::Todo);
+        }
+
+        TEST_METHOD(TestGetTask)
+        {
+            TaskStorage storage;
+            Task task(0, "Test", "Description", "todo");
+            Task created = storage.createTask(task);
+
+            Task task1 = storage.getTask(created.id);
+
+            Assert::AreEqual(created.id, task1.id);
+            Assert::AreEqual(std::string("Test"), task1.title);
+            Assert::AreEqual(std::string("Description"), task1.description);
+        }
+
+        TEST_METHOD(TestGetNonExistentTask)
+        {
+            TaskStorage storage;
+
+            Task task = storage.getTask(999);
+
+            Assert::AreEqual(0, task.id);
+        }
+
+        TEST_METHOD(TestGetAllTasks)
+        {
+            TaskStorage storage;
+
+            storage.createTask(Task(0, "Task 1", "Desc 1", "todo"));
+            storage.createTask(Task(0, "Task 2", "Desc 2", "in_progress"));
+            storage.createTask(Task(0, "Task 3", "Desc 3", "done"));
+
+            auto tasks = storage.getAllTasks();
+
+            Assert::AreEqual(static_cast<size_t>(3), tasks.size());
+            Assert::AreEqual(std::string("Task 1"), tasks[0].title);
+            Assert::AreEqual(std::string("Task 2"), tasks[1].title);
+            Assert::AreEqual(std::string("Task 3"), tasks[2].title);
+        }
+
+        TEST_METHOD(TestUpdateTask)
+        {
+            TaskStorage storage;
+            Task original(0, "Original", "Original Desc", "todo");
+            Task created = storage.createTask(original);
+
+            Task updated(0, "Updated", "Updated Desc", "in_progress");
+            bool success = storage.updateTask(created.id, updated) != nullptr;
+
+            Assert::IsTrue(success);
+
+            Task task = storage.getTask(created.id);
+            Assert::AreEqual(std::string("Updated"), task.title);
+            Assert::AreEqual(std::string("Updated Desc"), task.description);
+            Assert::IsTrue(task.status == TaskStatus::InProgress);
+        }
+
+        TEST_METHOD(TestWritesReturnNewBody)
+        {
+            TaskStorage storage(2);
+            int id = storage.createTask(Task(0, "Before", "", "todo")).id;
+
+            TaskPatch patch;
+            patch.title = "After";
+            uint64_t version = 0;
+            TaskBody body = storage.patchTask(id, std::move(patch), &version);
+            Assert::IsTrue(body != nullptr);
+            Assert::AreEqual(static_cast<uint64_t>(2), version);
+            Assert::IsTrue(body == storage.getTaskJson(id));
+            Assert::AreEqual(std::string("After"), json::parse(*body)["title"].get<std::string>());
+
+            body = storage.updateTask(id, Task(0, "Replaced", "Desc", "done"), &version);
+            Assert::AreEqual(static_cast<uint64_t>(3), version);
+            Assert::AreEqual(std::string("done"), json::parse(*body)["status"].get<std::string>());
+            Assert::IsTrue(storage.patchTask(999, TaskPatch()) == nullptr);
+        }
+
+        TEST_METHOD(TestUpdateNonExistentTask)
+        {
+            TaskStorage storage;
+            Task task(0, "Test", "Desc", "todo");
+
+            bool success = storage.updateTask(999, task) != nullptr;
+
+            Assert::IsFalse(success);
+        }
+
+        TEST_METHOD(TestDeleteTask)
+        {
+            TaskStorage storage;
+            Task task(0, "Test", "Desc", "todo");
+            Task created = storage.createTask(task);
+
+            bool deleted = storage.deleteTask(created.id);
+
+            Assert::IsTrue(deleted);
+
+            Task task1 = storage.getTask(created.id);
+            Assert::AreEqual(0, task1.id);
+        }
+
+        TEST_METHOD(TestConditionalWrites)
+        {
+            TaskStorage storage;
+            Task created = storage.createTask(Task(0, "Test", "Desc", "todo"));
+
+            uint64_t version = 0;
+            Assert::IsTrue(storage.updateTask(created.id, Task(0, "Stale", "Desc", "todo"), &version, 2) == nullptr);
+            Assert::AreEqual(static_cast<uint64_t>(1), version);
+            Assert::AreEqual(std::string("Test"), storage.getTask(created.id).title);
+
+            Assert::IsTrue(storage.updateTask(created.id, Task(0, "Fresh", "Desc", "todo"), &version, 1) != nullptr);
+            Assert::AreEqual(static_cast<uint64_t>(2), version);
+
+            TaskPatch patch;
+            patch.status = TaskStatus::Done;
+            version = 0;
+            Assert::IsTrue(storage.patchTask(created.id, std::move(patch), &version, 1) == nullptr);
+            Assert::AreEqual(static_cast<uint64_t>(2), version);
+
+            version = 0;
+            Assert::IsFalse(storage.deleteTask(created.id, 1, &version));
+            Assert::AreEqual(static_cast<uint64_t>(2), version);
+            Assert::IsTrue(storage.deleteTask(created.id, 2, &version));
+
+            version = 0;
+            Assert::IsFalse(storage.deleteTask(created.id, 2, &version));
+            Assert::AreEqual(static_cast<uint64_t>(0), version);
+        }
+
+        TEST_METHOD(TestStorageCount)
+        {
+            TaskStorage storage;
+
+            Assert::AreEqual(static_cast<size_t>(0), storage.count());
+
+            storage.createTask(Task(0, "Task 1", "Desc 1", "todo"));
+            Assert::AreEqual(static_cast<size_t>(1), storage.count());
+
+            storage.createTask(Task(0, "Task 2", "Desc 2", "in_progress"));
+            Assert::AreEqual(static_cast<size_t>(2), storage.count());
+        }
+
+        TEST_METHOD(TestShardedStorageKeepsIdOrder)
+        {
+            TaskStorage storage(4);
+            std::vector<std::thread> writers;
+            for (int t = 0; t < 4; ++t) {
+                writers.emplace_back([&storage] {
+                    for (int i = 0; i < 50; ++i) storage.createTask(Task(0, "Task", "Desc", "todo"));
+                    });
+            }
+            for (auto& writer : writers) writer.join();
+
+            auto tasks = storage.getAllTasks();
+            Assert::AreEqual(static_cast<size_t>(200), tasks.size());
+            for (size_t i = 0; i < tasks.size(); ++i) {
+                Assert::AreEqual(static_cast<int>(i) + 1, tasks[i].id);
+            }
+        }
+
+        TEST_METHOD(TestGetTaskJson)
+        {
+            TaskStorage storage(2);
+            Task created = storage.createTask(Task(0, "Json", "Desc", "done"));
+
+            TaskBody body = storage.getTaskJson(created.id);
+
+            Assert::IsTrue(body != nullptr);
+            Assert::AreEqual(created.toJson().dump(), *body);
+            Assert::IsTrue(storage.getTaskJson(999) == nullptr);
+        }
+
+        TEST_METHOD(TestGetTasksPage)
+        {
+            TaskStorage storage(3);
+            for (int i = 0; i < 10; ++i) storage.createTask(Task(0, "Task", "Desc", "todo"));
+
+            TaskPage first = storage.getTasksPage(0, 4);
+            Assert::AreEqual(static_cast<size_t>(4), first.bodies.size());
+            Assert::AreEqual(4, first.nextCursor);
+
+            TaskPage last = storage.getTasksPage(8, 4);
+            Assert::AreEqual(static_cast<size_t>(2), last.bodies.size());
+            Assert::AreEqual(0, last.nextCursor);
+            Assert::AreEqual(9, json::parse(*last.bodies[0])["id"].get<int>());
+        }
+
+        TEST_METHOD(TestStatusIndex)
+        {
+            TaskStorage storage(2);
+            Task a = storage.createTask(Task(0, "A", "", "todo"));
+            Task b = storage.createTask(Task(0, "B", "", "todo"));
+            storage.createTask(Task(0, "C", "", "done"));
+
+            storage.patchTask(a.id, json{ {"status", "in_progress"} });
+            storage.deleteTask(b.id);
+
+            Assert::AreEqual(static_cast<size_t>(0), storage.countByStatus(static_cast<int>(TaskStatus::Todo)));
+            Assert::AreEqual(static_cast<size_t>(1), storage.countByStatus(static_cast<int>(TaskStatus::InProgress)));
+            Assert::AreEqual(static_cast<size_t>(1), storage.countByStatus(static_cast<int>(TaskStatus::Done)));
+
+            json inProgress = json::parse(storage.getAllTasksJson(static_cast<int>(TaskStatus::InProgress)));
+            Assert::AreEqual(static_cast<size_t>(1), inProgress.size());
+            Assert::AreEqual(a.id, inProgress[0]["id"].get<int>());
+        }
+
+        TEST_METHOD(TestVersions)
+        {
+            TaskStorage storage(2);
+            int id = storage.createTask(Task(0, "Versioned", "", "todo")).id;
+            uint64_t created = storage.version();
+            uint64_t version = 0;
+            storage.getTaskJson(id, &version);
+            Assert::AreEqual(static_cast<uint64_t>(1), version);
+
+            storage.patchTask(id, json{ {"status", "done"} });
+            storage.updateTask(id, Task(0, "Replaced", "", "todo"));
+            storage.getTaskJson(id, &version);
+            Assert::AreEqual(static_cast<uint64_t>(3), version);
+            Assert::AreEqual(static_cast<uint64_t>(3), storage.getTask(id).version);
+            Assert::IsTrue(storage.version() > created);
+
+            uint64_t beforeRead = storage.version();
+            storage.getAllTasksJson();
+            Assert::AreEqual(beforeRead, storage.version());
+            storage.deleteTask(id);
+            Assert::IsTrue(storage.version() > beforeRead);
+        }
+
+        TEST_METHOD(TestApplyBatch)
+        {
+            TaskStorage storage(2);
+            Task existing = storage.createTask(Task(0, "Existing", "", "todo"));
+
+            std::vector<BatchOperation> ops(3);
+            ops[0].kind = BatchOperation::Kind::Create;
+            ops[0].task = Task(0, "New", "", "done");
+            ops[1].kind = BatchOperation::Kind::Patch;
+            ops[1].id = existing.id;
+            ops[1].fields.title = "Patched";
+            ops[2].kind = BatchOperation::Kind::Delete;
+            ops[2].id = 999;
+
+            auto results = storage.applyBatch(ops);
+
+            Assert::AreEqual(201, results[0].status);
+            Assert::AreEqual(200, results[1].status);
+            Assert::AreEqual(404, results[2].status);
+            Assert::AreEqual(static_cast<size_t>(2), storage.count());
+            Assert::AreEqual(std::string("Patched"), storage.getTask(existing.id).title);
+        }
+
+        TEST_METHOD(TestSearchTerms)
+        {
+            std::vector<std::string> expected = { "2024", "buy", "milk", "x" };
+            Assert::IsTrue(searchTerms("Buy MILK, buy... x/2024!") == expected);
+            Assert::IsTrue(searchTerms(" ,.-").empty());
+            Assert::AreEqual(static_cast<size_t>(64), searchTerms(std::string(100, 'a'))[0].size());
+            Assert::AreEqual(std::string("caf\xc3\xa9"), searchTerms("Caf\xc3\xa9")[0]);
+        }
+
+        TEST_METHOD(TestSearchTasks)
+        {
+            TaskStorage storage(3);
+            int milk = storage.createTask(Task(0, "Buy milk", "From the shop", "todo")).id;
+            int bread = storage.createTask(Task(0, "Buy bread", "", "done")).id;
+            int call = storage.createTask(Task(0, "Call mom", "about the shop", "todo")).id;
+
+            auto ids = [](const TaskPage& page) {
+                std::vector<int> result;
+                for (const auto& body : page.bodies) result.push_back(json::parse(*body)["id"].get<int>());
+                return result;
+            };
+
+            Assert::IsTrue(ids(storage.searchTasks("buy", 0, 10)) == std::vector<int>{ milk, bread });
+            Assert::IsTrue(ids(storage.searchTasks("SHOP buy", 0, 10)) == std::vector<int>{ milk });
+            Assert::IsTrue(ids(storage.searchTasks("buy", 0, 10, static_cast<int>(TaskStatus::Done))) == std::vector<int>{ bread });
+            Assert::IsTrue(storage.searchTasks("buy unknown", 0, 10).bodies.empty());
+            Assert::IsTrue(storage.searchTasks("", 0, 10).bodies.empty());
+
+            TaskPage first = storage.searchTasks("buy", 0, 1);
+            Assert::AreEqual(milk, first.nextCursor);
+            Assert::IsTrue(ids(storage.searchTasks("buy", first.nextCursor, 1)) == std::vector<int>{ bread });
+
+            storage.patchTask(milk, json{ {"title", "Sell milk"} });
+            storage.updateTask(call, Task(0, "Buy flowers", "", "todo"));
+            storage.deleteTask(bread);
+            Assert::IsTrue(ids(storage.searchTasks("buy", 0, 10)) == std::vector<int>{ call });
+            Assert::IsTrue(ids(storage.searchTasks("shop", 0, 10)) == std::vector<int>{ milk });
+            Assert::IsTrue(ids(storage.searchTasks("sell", 0, 10)) == std::vector<int>{ milk });
+        }
+
+        TEST_METHOD(TestFieldProjection)
+        {
+            unsigned fields = 0;
+            Assert::IsTrue(parseTaskFields("id,title,status", fields));
+            Assert::IsFalse(parseTaskFields("id,owner", fields));
+            Assert::IsFalse(parseTaskFields("id,", fields));
+            Assert::IsFalse(parseTaskFields("", fields));
+            Assert::IsTrue(parseTaskFields("status,id,title", fields));
+
+            TaskStorage storage(2);
+            int id = storage.createTask(Task(0, "Projected", "Long description", "done")).id;
+            storage.createTask(Task(0, "Other", "", "todo"));
+
+            json one = json::parse(*storage.getTaskJson(id, nullptr, fields));
+            Assert::AreEqual(json({ {"id", id}, {"title", "Projected"}, {"status", "done"} }).dump(), one.dump());
+            Assert::AreEqual(static_cast<size_t>(7), json::parse(*storage.getTaskJson(id)).size());
+
+            TaskPage page = storage.getTasksPage(0, 10, -1, fields);
+            Assert::AreEqual(static_cast<size_t>(2), page.bodies.size());
+            for (const auto& body : page.bodies) {
+                Assert::AreEqual(static_cast<size_t>(3), json::parse(*body).size());
+            }
+
+            TaskQuery query;
+            query.order = TaskQuery::Order::UpdateTimeDesc;
+            parseTaskFields("version", query.fields);
+            page = storage.queryTasks(query, 0, 0, 10);
+            Assert::AreEqual(std::string("{\"version\":1}"), *page.bodies[0]);
+        }
+
+        TEST_METHOD(TestParseTime)
+        {
+            int64_t seconds = 0;
+            Assert::IsTrue(parseTime("1700000000", seconds));
+            Assert::AreEqual(static_cast<int64_t>(1700000000), seconds);
+            Assert::IsTrue(parseTime(formatTime(1700000000), seconds));
+            Assert::AreEqual(static_cast<int64_t>(1700000000), seconds);
+            Assert::IsFalse(parseTime("2024-01-01", seconds));
+            Assert::IsFalse(parseTime("yesterday", seconds));
+            Assert::IsFalse(parseTime("", seconds));
+        }
+
+        TEST_METHOD(TestQueryByUpdateTime)
+        {
+            TaskStorage storage(2);
+            int a = storage.createTask(Task(0, "A", "", "todo")).id;
+            int b = storage.createTask(Task(0, "B", "", "done")).id;
+            int c = storage.createTask(Task(0, "C", "", "todo")).id;
+            int64_t created = storage.getTask(c).create_time;
+            while (std::time(nullptr) == created) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+            storage.patchTask(a, json{ {"title", "A2"} });
+            int64_t patched = storage.getTask(a).update_time;
+
+            auto ids = [](const TaskPage& page) {
+                std::vector<int> result;
+                for (const auto& body : page.bodies) result.push_back(json::parse(*body)["id"].get<int>());
+                return result;
+            };
+
+            TaskQuery query;
+            query.order = TaskQuery::Order::UpdateTime;
+            Assert::IsTrue(ids(storage.queryTasks(query, 0, 0, 10)) == std::vector<int>{ b, c, a });
+            query.order = TaskQuery::Order::UpdateTimeDesc;
+            TaskPage first = storage.queryTasks(query, 0, 0, 2);
+            Assert::IsTrue(ids(first) == std::vector<int>{ a, c });
+            Assert::AreEqual(c, first.nextCursor);
+            Assert::AreEqual(created, first.nextTime);
+            Assert::IsTrue(ids(storage.queryTasks(query, first.nextTime, first.nextCursor, 2)) == std::vector<int>{ b });
+
+            query.order = TaskQuery::Order::Id;
+            query.updatedSince = patched;
+            Assert::IsTrue(ids(storage.queryTasks(query, 0, 0, 10)) == std::vector<int>{ a });
+            query.updatedSince = INT64_MIN;
+            query.createdBefore = created + 1;
+            query.status = static_cast<int>(TaskStatus::Todo);
+            TaskPage todo = storage.queryTasks(query, 0, 0, 1);
+            Assert::IsTrue(ids(todo) == std::vector<int>{ a });
+            Assert::IsTrue(ids(storage.queryTasks(query, 0, todo.nextCursor, 1)) == std::vector<int>{ c });
+            query.createdBefore = storage.getTask(a).create_time;
+            Assert::IsTrue(storage.queryTasks(query, 0, 0, 10).bodies.empty());
+
+            storage.updateTask(b, Task(0, "B2", "", "done"));
+            storage.deleteTask(c);
+            query = TaskQuery();
+            query.order = TaskQuery::Order::UpdateTime;
+            query.updatedSince = patched;
+            Assert::IsTrue(ids(storage.queryTasks(query, 0, 0, 10)) == std::vector<int>{ a, b });
+        }
+    };
+
+    TEST_CLASS(StorageBackendTests)
+    {
+    public:
+
+        // The listing without timestamps, which differ between two storages.
+        static std::string withoutTimes(const std::string& listing)
+        {
+            json tasks = json::parse(listing);
+            for (auto& task : tasks) {
+                task.erase("create_time");
+                task.erase("update_time");
+            }
+            return tasks.dump();
+        }
+
+        static void churn(TaskStorage& storage)
+        {
+            for (int i = 0; i < 3000; ++i) {
+                storage.createTask(Task(0, "Task " + std::to_string(i), "", TASK_STATUSES[i % 3]));
+            }
+            for (int id = 1; id <= 3000; id += 7) storage.deleteTask(id);
+            for (int id = 2; id <= 3000; id += 5) storage.patchTask(id, json{ {"status", "done"} });
+            storage.updateTask(3, Task(0, "Replaced", "", "in_progress"));
+        }
+
+        TEST_METHOD(TestBackendsMatchMap)
+        {
+            TaskStorage map(3, StorageBackend::Map);
+            churn(map);
+            int done = static_cast<int>(TaskStatus::Done);
+            TaskPage mapPage = map.getTasksPage(1500, 50, done);
+
+            for (StorageBackend backend : { StorageBackend::Rcu, StorageBackend::Flat, StorageBackend::Arena }) {
+                TaskStorage other(3, backend);
+                churn(other);
+                Assert::AreEqual(map.count(), other.count());
+                Assert::AreEqual(withoutTimes(map.getAllTasksJson()), withoutTimes(other.getAllTasksJson()));
+                Assert::AreEqual(withoutTimes(map.getAllTasksJson(done)), withoutTimes(other.getAllTasksJson(done)));
+                Assert::AreEqual(map.countByStatus(done), other.countByStatus(done));
+                TaskPage page = other.getTasksPage(1500, 50, done);
+                Assert::AreEqual(mapPage.nextCursor, page.nextCursor);
+                Assert::AreEqual(withoutTimes(toJsonArray(mapPage.bodies)), withoutTimes(toJsonArray(page.bodies)));
+                Assert::AreEqual(map.getAllTasks().size(), other.getAllTasks().size());
+                Assert::AreEqual(std::string("Replaced"), other.getTask(3).title);
+                Assert::IsTrue(other.getTaskJson(8) == nullptr);
+                Assert::AreEqual(withoutTimes(toJsonArray(map.searchTasks("task 12", 0, 20).bodies)),
+                    withoutTimes(toJsonArray(other.searchTasks("task 12", 0, 20).bodies)));
+            }
+        }
+
+        TEST_METHOD(TestRcuReadsDuringWrites)
+        {
+            TaskStorage storage(2, StorageBackend::Rcu);
+            for (int i = 0; i < 200; ++i) storage.createTask(Task(0, "Task", "", "todo"));
+
+            std::atomic<bool> stop{ false };
+            std::atomic<int> torn{ 0 };
+            std::vector<std::thread> readers;
+            for (int r = 0; r < 4; ++r) {
+                readers.emplace_back([&] {
+                    while (!stop.load()) {
+                        for (int id = 1; id <= 200; ++id) {
+                            Task task = storage.getTask(id);
+                            if (task.id != 0 && task.id != id) ++torn;
+                        }
+                        TaskPage page = storage.getTasksPage(0, 300);
+                        int last = 0;
+                        for (const auto& body : page.bodies) {
+                            int id = json::parse(*body)["id"].get<int>();
+                            if (id <= last) ++torn;
+                            last = id;
+                        }
+                    }
+                    });
+            }
+            for (int round = 0; round < 2000; ++round) {
+                int id = round % 200 + 1;
+                storage.patchTask(id, json{ {"title", "Round " + std::to_string(round)} });
+                if (round < 200 && round % 10 == 0) {
+                    storage.deleteTask(id);
+                    storage.createTask(Task(0, "New", "", "done"));
+                }
+            }
+            stop = true;
+            for (auto& reader : readers) reader.join();
+
+            Assert::AreEqual(0, torn.load());
+            Assert::AreEqual(static_cast<size_t>(200), storage.count());
+        }
+
+        // A listing collected after reading version() must already hold every
+        // change counted in that version, or a stale body gets cached under it.
+        TEST_METHOD(TestRcuListingNotOlderThanVersion)
+        {
+            TaskStorage storage(2, StorageBackend::Rcu);
+            storage.createTask(Task(0, "0", "", "todo"));
+            const uint64_t base = storage.version();
+
+            std::atomic<bool> stop{ false };
+            std::atomic<int> stale{ 0 };
+            std::thread reader([&] {
+                while (!stop.load()) {
+                    uint64_t version = storage.version();
+                    json tasks = json::parse(storage.getAllTasksJson());
+                    uint64_t title = std::stoull(tasks[0]["title"].get<std::string>());
+                    if (title < version - base) ++stale;
+                }
+                });
+            for (int round = 1; round <= 20000; ++round) {
+                storage.patchTask(1, json{ {"title", std::to_string(round)} });
+            }
+            stop = true;
+            reader.join();
+
+            Assert::AreEqual(0, stale.load());
+            Assert::AreEqual(base + 20000, storage.version());
+        }
+    };
+
+    TEST_CLASS(ChangeFeedTests)
+    {
+    public:
+
+        TEST_METHOD(TestStoragePublishesChanges)
+        {
+            TaskStorage storage(2);
+            int id = storage.createTask(Task(0, "Watched", "", "todo")).id;
+            storage.patchTask(id, json{ {"status", "done"} });
+            storage.deleteTask(id);
+
+            std::vector<ChangeFeed::Event> events;
+            Assert::IsTrue(storage.changes().read(0, 10, events));
+            Assert::AreEqual(static_cast<size_t>(3), events.size());
+            Assert::IsTrue(events[0].kind == ChangeFeed::Kind::Create);
+            Assert::IsTrue(events[1].kind == ChangeFeed::Kind::Update);
+            Assert::IsTrue(events[2].kind == ChangeFeed::Kind::Delete);
+            Assert::AreEqual(static_cast<uint64_t>(3), events[2].seq);
+            Assert::IsTrue(ChangeFeed::toJson(events[1]).find("\"status\":\"done\"") != std::string::npos);
+            Assert::AreEqual(std::string("{\"seq\":3,\"op\":\"delete\",\"id\":") + std::to_string(id) + "}",
+                ChangeFeed::toJson(events[2]));
+        }
+
+        TEST_METHOD(TestRingOverflowAndWait)
+        {
+            ChangeFeed feed(4);
+            for (int i = 1; i <= 6; ++i) {
+                feed.publish(ChangeFeed::Kind::Create, i, nullptr);
+            }
+            std::vector<ChangeFeed::Event> events;
+            Assert::IsFalse(feed.read(1, 10, events));
+            Assert::IsFalse(feed.read(7, 10, events));
+            Assert::IsTrue(feed.read(2, 10, events));
+            Assert::AreEqual(static_cast<size_t>(4), events.size());
+            Assert::AreEqual(3, events[0].id);
+
+            Assert::IsFalse(feed.wait(6, std::chrono::milliseconds(1)));
+            std::thread writer([&feed] { feed.publish(ChangeFeed::Kind::Delete, 7, nullptr); });
+            Assert::IsTrue(feed.wait(6, std::chrono::seconds(5)));
+            writer.join();
+        }
+
+        TEST_METHOD(TestRingGrowsToCapacity)
+        {
+            ChangeFeed feed(1000);
+            Assert::AreEqual(static_cast<size_t>(0), feed.memoryBytes());
+            feed.publish(ChangeFeed::Kind::Create, 1, nullptr);
+            Assert::IsTrue(feed.memoryBytes() < 100 * sizeof(ChangeFeed::Event));
+            for (int i = 2; i <= 5000; ++i) {
+                feed.publish(ChangeFeed::Kind::Create, i, nullptr);
+            }
+            Assert::AreEqual(1000 * sizeof(ChangeFeed::Event), feed.memoryBytes());
+            Assert::AreEqual(static_cast<uint64_t>(4001), feed.oldestSequence());
+            std::vector<ChangeFeed::Event> events;
+            Assert::IsTrue(feed.read(4000, 2000, events));
+            Assert::AreEqual(static_cast<size_t>(1000), events.size());
+            Assert::AreEqual(4001, events.front().id);
+            Assert::AreEqual(5000, events.back().id);
+        }
+    };
+
+    TEST_CLASS(PersistenceTests)
+    {
+    public:
+
+        TEST_METHOD(TestRecoverFromSnapshotAndWal)
+        {
+            std::string dir = (std::filesystem::temp_directory_path() / "todo_api_persistence_test").string();
+            std::filesystem::remove_all(dir);
+            PersistenceOptions options;
+            options.dataDir = dir;
+            int patchedId = 0;
+            int deletedId = 0;
+            {
+                TaskStorage storage(2);
+                storage.enablePersistence(options);
+                patchedId = storage.createTask(Task(0, "Keep", "Desc", "todo")).id;
+                deletedId = storage.createTask(Task(0, "Drop", "Desc", "todo")).id;
+                storage.patchTask(patchedId, json{ {"title", "Kept"}, {"status", "done"} });
+                storage.deleteTask(deletedId);
+            }
+
+            TaskStorage recovered(3);
+            recovered.enablePersistence(options);
+
+            Assert::AreEqual(static_cast<size_t>(1), recovered.count());
+            Task task = recovered.getTask(patchedId);
+            Assert::AreEqual(std::string("Kept"), task.title);
+            Assert::IsTrue(task.status == TaskStatus::Done);
+            Assert::AreEqual(static_cast<uint64_t>(2), task.version);
+            Assert::AreEqual(0, recovered.getTask(deletedId).id);
+            Assert::IsTrue(recovered.createTask(Task(0, "Next", "", "todo")).id > deletedId);
+        }
+
+        TEST_METHOD(TestSharedWorkers)
+        {
+            SharedWorkers workers(2);
+            std::atomic<int> scheduled{ 0 };
+            std::atomic<int> ticks{ 0 };
+            std::atomic<int> concurrent{ 0 };
+            std::atomic<bool> overlapped{ false };
+            int a = 0;
+            int b = 0;
+            workers.add(&a, [&] {
+                if (++concurrent > 1) overlapped = true;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                ++scheduled;
+                --concurrent;
+                });
+            workers.add(&b, [&] { ++ticks; }, true);
+            for (int i = 0; i < 200; ++i) workers.schedule(&a);
+
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while ((scheduled.load() == 0 || ticks.load() == 0) && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            workers.remove(&a);
+            workers.remove(&b);
+            int runs = scheduled.load();
+            workers.schedule(&a);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+            Assert::IsTrue(runs > 0 && runs <= 200);
+            Assert::AreEqual(runs, scheduled.load());
+            Assert::IsTrue(ticks.load() > 0);
+            Assert::IsFalse(overlapped.load());
+        }
+    };
+
+    TEST_CLASS(TenantTests)
+    {
+    public:
+
+        TEST_METHOD(TestTenantNames)
+        {
+            Assert::IsTrue(TenantRegistry::validName("team-a_1"));
+            Assert::IsTrue(TenantRegistry::validName(std::string(64, 'x')));
+            Assert::IsFalse(TenantRegistry::validName(""));
+            Assert::IsFalse(TenantRegistry::validName("_default"));
+            Assert::IsFalse(TenantRegistry::validName("a/b"));
+            Assert::IsFalse(TenantRegistry::validName(std::string(65, 'x')));
+        }
+
+        TEST_METHOD(TestTenantsArePartitioned)
+        {
+            TenantRegistry tenants(2, 1, StorageBackend::Map, "");
+            Assert::IsTrue(tenants.find("a") == nullptr);
+            Tenant* a = tenants.open("a");
+            Tenant* b = tenants.open("b");
+            Assert::IsTrue(a != nullptr && b != nullptr && a != b);
+            Assert::IsTrue(tenants.open("a") == a);
+            Assert::IsTrue(tenants.find("a") == a);
+            Assert::IsTrue(tenants.open("c") == nullptr);
+            Assert::AreEqual(static_cast<size_t>(2), tenants.size());
+
+            Assert::AreEqual(1, a->storage.createTask(Task(0, "A1", "", "todo")).id);
+            Assert::AreEqual(1, b->storage.createTask(Task(0, "B1", "", "todo")).id);
+            Assert::AreEqual(2, a->storage.createTask(Task(0, "A2", "", "todo")).id);
+            Assert::AreEqual(static_cast<size_t>(2), a->storage.count());
+            Assert::AreEqual(std::string("B1"), b->storage.getTask(1).title);
+            Assert::IsTrue(a->storage.memoryBytes() > b->storage.memoryBytes());
+
+            std::vector<std::string> names;
+            tenants.forEach([&](const std::string& name, Tenant&) { names.push_back(name); });
+            Assert::IsTrue(names == std::vector<std::string>{ "a", "b" });
+        }
+
+        TEST_METHOD(TestMemoryAccounting)
+        {
+            for (StorageBackend backend : { StorageBackend::Map, StorageBackend::Rcu }) {
+                TaskStorage storage(2, backend);
+                Assert::AreEqual(static_cast<size_t>(0), storage.memoryBytes());
+                int id = storage.createTask(Task(0, "Short", "", "todo")).id;
+                size_t one = storage.memoryBytes();
+                storage.patchTask(id, json{ {"description", std::string(1000, 'd')} });
+                Assert::IsTrue(storage.memoryBytes() >= one + 2000);
+                storage.updateTask(id, Task(0, "Short", "", "todo"));
+                Assert::AreEqual(one, storage.memoryBytes());
+                storage.deleteTask(id);
+                Assert::IsTrue(storage.changes().memoryBytes() > 0);
+                Assert::AreEqual(storage.changes().memoryBytes(), storage.memoryBytes());
+            }
+        }
+
+        TEST_METHOD(TestTenantsPersistSeparately)
+        {
+            std::string dir = (std::filesystem::temp_directory_path() / "todo_api_tenant_test").string();
+            std::filesystem::remove_all(dir);
+            {
+                TenantRegistry tenants(16, 2, StorageBackend::Map, dir);
+                tenants.open("a")->storage.createTask(Task(0, "A", "", "todo"));
+                tenants.open("b");
+            }
+
+            TenantRegistry reopened(16, 2, StorageBackend::Map, dir);
+            reopened.loadExisting();
+            Assert::AreEqual(static_cast<size_t>(2), reopened.size());
+            Assert::AreEqual(std::string("A"), reopened.find("a")->storage.getTask(1).title);
+            Assert::AreEqual(static_cast<size_t>(0), reopened.find("b")->storage.count());
+        }
+    };
+
+    TEST_CLASS(ArchiverTests)
+    {
+    public:
+
+        TEST_METHOD(TestCollectExpiredInBatches)
+        {
+            TaskStorage storage(1);
+            for (int i = 0; i < 10; ++i) storage.createTask(Task(0, "T", "", i % 2 == 0 ? "done" : "todo"));
+            int64_t later = static_cast<int64_t>(std::time(nullptr)) + 10;
+
+            std::pair<int64_t, int> cursor(INT64_MIN, INT_MIN);
+            std::vector<Task> batch;
+            Assert::IsTrue(storage.collectExpired(0, later, cursor, 2, batch));
+            Assert::AreEqual(static_cast<size_t>(2), batch.size());
+            Assert::AreEqual(1, batch[0].id);
+            Assert::AreEqual(3, batch[1].id);
+            size_t total = batch.size();
+            bool more = true;
+            while (more) {
+                batch.clear();
+                more = storage.collectExpired(0, later, cursor, 2, batch);
+                total += batch.size();
+            }
+            Assert::AreEqual(static_cast<size_t>(5), total);
+
+            batch.clear();
+            cursor = { INT64_MIN, INT_MIN };
+            Assert::IsFalse(storage.collectExpired(0, later - 3600, cursor, 2, batch));
+            Assert::IsTrue(batch.empty());
+        }
+
+        TEST_METHOD(TestTaskChangedAfterCollectIsNotArchived)
+        {
+            TaskStorage storage(2);
+            for (int i = 0; i < 4; ++i) storage.createTask(Task(0, "T", "", "done"));
+            int64_t later = static_cast<int64_t>(std::time(nullptr)) + 10;
+            std::vector<Task> batch;
+            for (size_t shard = 0; shard < storage.shardCount(); ++shard) {
+                std::pair<int64_t, int> cursor(INT64_MIN, INT_MIN);
+                storage.collectExpired(shard, later, cursor, 10, batch);
+            }
+            Assert::AreEqual(static_cast<size_t>(4), batch.size());
+            storage.patchTask(2, json{ {"status", "todo"} });
+
+            std::vector<int> archived;
+            Assert::AreEqual(static_cast<size_t>(3), storage.deleteExpired(batch, [&](std::vector<Task>& tasks) {
+                for (const Task& task : tasks) archived.push_back(task.id);
+                return true;
+                }));
+            std::sort(archived.begin(), archived.end());
+            Assert::IsTrue(archived == std::vector<int>{ 1, 3, 4 });
+            Assert::IsTrue(storage.getTask(2).status == TaskStatus::Todo);
+            Assert::AreEqual(static_cast<size_t>(1), storage.count());
+
+            // A failed archive puts the tasks back.
+            storage.patchTask(2, json{ {"status", "done"} });
+            std::vector<Task> again = { storage.getTask(2) };
+            Assert::AreEqual(static_cast<size_t>(0), storage.deleteExpired(again, [](std::vector<Task>&) { return false; }));
+            Assert::AreEqual(std::string("T"), storage.getTask(2).title);
+            Assert::AreEqual(static_cast<size_t>(1), storage.countByStatus(static_cast<int>(TaskStatus::Done)));
+        }
+
+        TEST_METHOD(TestSweepArchivesThenDeletes)
+        {
+            std::string dir = (std::filesystem::temp_directory_path() / "todo_api_archive_test").string();
+            std::filesystem::remove_all(dir);
+            TaskStorage storage(4);
+            for (int i = 0; i < 30; ++i) storage.createTask(Task(0, "Task " + std::to_string(i), "", i < 20 ? "done" : "todo"));
+            TaskArchiver archiver([&storage] {
+                return std::vector<std::pair<std::string, TaskStorage*>>{ { "_default", &storage } };
+                }, 60, 3, dir);
+
+            int64_t now = static_cast<int64_t>(std::time(nullptr));
+            Assert::AreEqual(static_cast<size_t>(0), archiver.sweep(now));
+            Assert::AreEqual(static_cast<size_t>(20), archiver.sweep(now + 120));
+            Assert::AreEqual(static_cast<size_t>(10), storage.count());
+            Assert::AreEqual(static_cast<size_t>(0), storage.countByStatus(static_cast<int>(TaskStatus::Done)));
+            Assert::AreEqual(static_cast<uint64_t>(20), archiver.expired());
+
+            std::ifstream in(archiver.archivePath("_default", now + 120), std::ios::binary);
+            std::string archived((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+#ifdef TODO_API_ZLIB_SUPPORT
+            std::string lines;
+            z_stream stream{};
+            inflateInit2(&stream, 15 + 16);
+            stream.next_in = reinterpret_cast<Bytef*>(&archived[0]);
+            stream.avail_in = static_cast<uInt>(archived.size());
+            char buffer[4096];
+            // One gzip member per batch.
+            while (stream.avail_in > 0) {
+                stream.next_out = reinterpret_cast<Bytef*>(buffer);
+                stream.avail_out = sizeof(buffer);
+                int result = inflate(&stream, Z_NO_FLUSH);
+                lines.append(buffer, sizeof(buffer) - stream.avail_out);
+                if (result == Z_STREAM_END) inflateReset(&stream);
+                else Assert::AreEqual(Z_OK, result);
+            }
+            inflateEnd(&stream);
+            archived = lines;
+#endif
+            Assert::AreEqual(static_cast<std::ptrdiff_t>(20), std::count(archived.begin(), archived.end(), '\n'));
+            Assert::AreEqual(static_cast<int>(TaskStatus::Done), static_cast<int>(statusFromString(
+                json::parse(archived.substr(0, archived.find('\n')))["status"].get<std::string>())));
+            std::filesystem::remove_all(dir);
+        }
+    };
+
+    TEST_CLASS(ReplicationTests)
+    {
+    public:
+
+        // Streams every change of `primary` after `since` into `follower`.
+        static uint64_t replay(TaskStorage& primary, TaskStorage& follower, uint64_t since)
+        {
+            std::vector<ChangeFeed::Event> events;
+            primary.changes().read(since, SIZE_MAX, events);
+            for (const auto& event : events) {
+                since = ReplicaFollower::applyRecord(follower, json::parse(ChangeFeed::toJson(event, true)));
+            }
+            return since;
+        }
+
+        TEST_METHOD(TestFollowerAppliesFeed)
+        {
+            TaskStorage primary(2);
+            TaskStorage follower(3, StorageBackend::Rcu);
+            int kept = primary.createTask(Task(0, "Kept", "Desc", "todo")).id;
+            int dropped = primary.createTask(Task(0, "Dropped", "", "todo")).id;
+            primary.patchTask(kept, json{ {"status", "done"} });
+            primary.deleteTask(dropped);
+            std::vector<BatchOperation> ops(1);
+            ops[0].task = Task(0, "Batched", "", "in_progress");
+            primary.applyBatch(ops);
+
+            uint64_t applied = replay(primary, follower, 0);
+            Assert::AreEqual(primary.changes().lastSequence(), applied);
+            Assert::AreEqual(primary.getAllTasksJson(), follower.getAllTasksJson());
+            Assert::AreEqual(primary.getTask(kept).update_time, follower.getTask(kept).update_time);
+            Assert::AreEqual(static_cast<uint64_t>(2), follower.getTask(kept).version);
+            Assert::AreEqual(primary.countByStatus(static_cast<int>(TaskStatus::Done)),
+                follower.countByStatus(static_cast<int>(TaskStatus::Done)));
+
+            std::vector<ChangeFeed::Event> republished;
+            follower.changes().read(0, SIZE_MAX, republished);
+            Assert::AreEqual(static_cast<size_t>(5), republished.size());
+        }
+
+        TEST_METHOD(TestResetFromSnapshot)
+        {
+            TaskStorage primary(2);
+            TaskStorage follower(2);
+            follower.createTask(Task(0, "Stale", "", "todo"));
+            follower.createTask(Task(0, "Stale too", "", "todo"));
+            primary.createTask(Task(0, "Fresh", "", "done"));
+            uint64_t seq = primary.changes().lastSequence();
+
+            std::vector<Task> tasks = primary.getAllTasks();
+            follower.resetReplicated(std::move(tasks));
+            Assert::AreEqual(primary.getAllTasksJson(), follower.getAllTasksJson());
+
+            primary.updateTask(1, Task(0, "Fresher", "", "in_progress"));
+            primary.createTask(Task(0, "Second", "", "todo"));
+            replay(primary, follower, seq);
+            Assert::AreEqual(primary.getAllTasksJson(), follower.getAllTasksJson());
+            Assert::AreEqual(primary.memoryBytes(), follower.memoryBytes());
+        }
+
+        // As /replication/snapshot does: a follower streams from `seq` on, so
+        // the tasks copied after reading it must hold every task created up to
+        // it. A feed subscriber must likewise find the task of the newest event.
+        TEST_METHOD(TestRcuSnapshotDuringCreates)
+        {
+            TaskStorage primary(2, StorageBackend::Rcu);
+            std::atomic<bool> stop{ false };
+            std::thread writer([&] {
+                for (int i = 0; i < 20000; ++i) {
+                    if (i % 2 == 0) {
+                        primary.createTask(Task(0, "Created", "", "todo"));
+                    }
+                    else {
+                        std::vector<BatchOperation> ops(1);
+                        ops[0].task = Task(0, "Batched", "", "todo");
+                        primary.applyBatch(ops);
+                    }
+                }
+                stop = true;
+                });
+
+            int missing = 0;
+            for (int round = 0; !stop.load(); ++round) {
+                uint64_t seq = primary.changes().lastSequence();
+                if (seq == 0) continue;
+                if (round % 64 == 0) {
+                    // Only creates so far: one task per event.
+                    if (primary.getAllTasks().size() < seq) ++missing;
+                    continue;
+                }
+                std::vector<ChangeFeed::Event> events;
+                primary.changes().read(seq - 1, 1, events);
+                if (primary.getTaskJson(events[0].id) == nullptr) ++missing;
+            }
+            writer.join();
+
+            Assert::AreEqual(0, missing);
+        }
+    };
+
+    TEST_CLASS(ValidationTests)
+    {
+    public:
+
+        TEST_METHOD(TestIsStatusValid)
+        {
+            Assert::IsTrue(isStatusValid("todo"));
+            Assert::IsTrue(isStatusValid("in_progress"));
+            Assert::IsTrue(isStatusValid("done"));
+
+            Assert::IsFalse(isStatusValid(""));
+            Assert::IsFalse(isStatusValid("invalid"));
+        }
+
+        TEST_METHOD(TestFormatTimeMatchesLocalTime)
+        {
+            int64_t now = static_cast<int64_t>(std::time(nullptr));
+            for (int64_t t = now - 7200; t < now + 7200; t += 61) {
+                std::tm tm;
+                toLocalTime(static_cast<std::time_t>(t), tm);
+                char expected[32];
+                std::strftime(expected, sizeof(expected), "%Y-%m-%d %H:%M:%S", &tm);
+                Assert::AreEqual(std::string(expected), formatTime(t));
+            }
+        }
+    };
+
+    TEST_CLASS(WireFormatTests)
+    {
+    public:
+
+        TEST_METHOD(TestNegotiateFormat)
+        {
+            Assert::IsTrue(wireFormatOf("application/json; charset=utf-8") == WireFormat::Json);
+            Assert::IsTrue(wireFormatOf("application/x-msgpack") == WireFormat::MsgPack);
+            Assert::IsTrue(wireFormatOf(" application/cbor ") == WireFormat::Cbor);
+            Assert::IsTrue(wireFormatOf("") == WireFormat::Json);
+            Assert::IsTrue(acceptedWireFormat("*/*") == WireFormat::Json);
+            Assert::IsTrue(acceptedWireFormat("application/json, application/msgpack") == WireFormat::MsgPack);
+            Assert::IsTrue(acceptedWireFormat("application/msgpack;q=0, application/cbor") == WireFormat::Cbor);
+        }
+
+        TEST_METHOD(TestRoundTripThroughTaskBody)
+        {
+            TaskStorage storage;
+            Task created = storage.createTask(Task(0, "Binary", "Desc", "done"));
+            json document = json::parse(*storage.getTaskJson(created.id));
+
+            for (WireFormat format : { WireFormat::MsgPack, WireFormat::Cbor }) {
+                std::string encoded = encodeWireFormat(format, document);
+                Assert::IsTrue(encoded.size() < storage.getTaskJson(created.id)->size());
+                json decoded;
+                std::string detail;
+                Assert::IsTrue(decodeWireFormat(format, encoded, decoded, detail));
+                Assert::AreEqual(document.dump(), decoded.dump());
+                Assert::IsFalse(decodeWireFormat(format, encoded.substr(0, encoded.size() / 2), decoded, detail));
+            }
+
+            std::string invalidUtf8 = "\x81\xa5title\xa2\xc3\x28";
+            json decoded;
+            std::string detail;
+            Assert::IsFalse(decodeWireFormat(WireFormat::MsgPack, invalidUtf8, decoded, detail));
+        }
+    };
+
+    TEST_CLASS(CompressionTests)
+    {
+    public:
+
+        TEST_METHOD(TestNegotiateEncoding)
+        {
+            Assert::IsTrue(negotiateEncoding("") == ContentEncoding::Identity);
+            Assert::IsTrue(negotiateEncoding("gzip;q=0, zstd;q=0, identity") == ContentEncoding::Identity);
+            Assert::IsTrue(negotiateEncoding("br, deflate") == ContentEncoding::Identity);
+#ifdef TODO_API_ZLIB_SUPPORT
+            Assert::IsTrue(negotiateEncoding("deflate, GZIP") == ContentEncoding::Gzip);
+            Assert::IsTrue(negotiateEncoding("zstd;q=0.2, gzip;q=0.8") == ContentEncoding::Gzip);
+#endif
+#ifdef TODO_API_ZSTD_SUPPORT
+            Assert::IsTrue(negotiateEncoding("gzip, zstd") == ContentEncoding::Zstd);
+            Assert::IsTrue(negotiateEncoding("*") == ContentEncoding::Zstd);
+#endif
+        }
+
+#ifdef TODO_API_ZLIB_SUPPORT
+        TEST_METHOD(TestCacheCompressesOnce)
+        {
+            TaskStorage storage;
+            for (int i = 0; i < 50; ++i) storage.createTask(Task(0, "Compressible", "Same text", "todo"));
+            auto body = std::make_shared<const std::string>(storage.getAllTasksJson());
+            CompressionCache cache(1024 * 1024);
+
+            CompressionCache::Body first = cache.get(body, ContentEncoding::Gzip);
+            CompressionCache::Body second = cache.get(body, ContentEncoding::Gzip);
+            Assert::IsTrue(first != nullptr);
+            Assert::IsTrue(first == second);
+            Assert::IsTrue(first->size() < body->size() / 4);
+            Assert::AreEqual(static_cast<uint64_t>(1), cache.hits());
+            Assert::AreEqual(static_cast<uint64_t>(1), cache.misses());
+
+            std::string inflated(body->size(), '\0');
+            z_stream stream{};
+            inflateInit2(&stream, 15 + 16);
+            stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(first->data()));
+            stream.avail_in = static_cast<uInt>(first->size());
+            stream.next_out = reinterpret_cast<Bytef*>(&inflated[0]);
+            stream.avail_out = static_cast<uInt>(inflated.size());
+            Assert::IsTrue(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+            inflateEnd(&stream);
+            Assert::AreEqual(*body, inflated);
+
+            body = std::make_shared<const std::string>(storage.getAllTasksJson());
+            cache.get(body, ContentEncoding::Gzip);
+            Assert::AreEqual(static_cast<uint64_t>(2), cache.misses());
+        }
+#endif
+    };
+
+    TEST_CLASS(IdempotencyCacheTests)
+    {
+    public:
+
+        TEST_METHOD(TestReplayAfterComplete)
+        {
+            IdempotencyCache cache(1024 * 1024);
+            IdempotencyCache::Stored stored;
+            Assert::IsTrue(cache.claim("/tasks\nkey", 1, stored) == IdempotencyCache::Claim::Reserved);
+            Assert::IsTrue(cache.claim("/tasks\nkey", 1, stored) == IdempotencyCache::Claim::InFlight);
+
+            auto body = std::make_shared<const std::string>("{\"id\":1}");
+            cache.complete("/tasks\nkey", { 201, "\"e-1-1\"", body });
+            Assert::IsTrue(cache.claim("/tasks\nkey", 1, stored) == IdempotencyCache::Claim::Replay);
+            Assert::AreEqual(201, stored.status);
+            Assert::AreEqual(std::string("\"e-1-1\""), stored.etag);
+            Assert::IsTrue(stored.body == body);
+            Assert::IsTrue(cache.claim("/tasks\nkey", 2, stored) == IdempotencyCache::Claim::Mismatch);
+            Assert::AreEqual(static_cast<uint64_t>(1), cache.replays());
+        }
+
+        TEST_METHOD(TestFailedRequestReleasesKey)
+        {
+            IdempotencyCache cache(1024 * 1024);
+            IdempotencyCache::Stored stored;
+            {
+                IdempotencyCache::Reservation reservation(cache);
+                Assert::IsTrue(cache.claim("key", 1, stored) == IdempotencyCache::Claim::Reserved);
+                reservation.reserve("key");
+            }
+            Assert::IsTrue(cache.claim("key", 2, stored) == IdempotencyCache::Claim::Reserved);
+        }
+
+        TEST_METHOD(TestEvictsLeastRecentlyUsed)
+        {
+            IdempotencyCache cache(IdempotencyCache::STRIPES * 4096);
+            auto body = std::make_shared<const std::string>(std::string(1000, 'x'));
+            IdempotencyCache::Stored stored;
+            for (int i = 0; i < 1000; ++i) {
+                std::string key = "key" + std::to_string(i);
+                cache.claim(key, 1, stored);
+                cache.complete(key, { 201, "", body });
+            }
+            Assert::IsTrue(cache.claim("key999", 1, stored) == IdempotencyCache::Claim::Replay);
+            Assert::IsTrue(cache.claim("key0", 1, stored) == IdempotencyCache::Claim::Reserved);
+        }
+    };
+
+    TEST_CLASS(HttpParserTests)
+    {
+    public:
+
+        TEST_METHOD(TestPipelinedRequests)
+        {
+            std::string in = "GET /tasks/7?fields=id%2Ctitle&q=a+b HTTP/1.1\r\nHost: x\r\nAccept:  application/json \r\n\r\n"
+                "POST /tasks HTTP/1.1\r\nContent-Length: 13\r\n\r\n{\"title\":\"a\"}";
+            Request req;
+            size_t consumed = 0;
+            int status = 0;
+            Assert::IsTrue(parseHttpRequest(in, 1024, req, consumed, status) == HttpParse::Complete);
+            Assert::AreEqual(std::string("GET"), req.method);
+            Assert::AreEqual(std::string("/tasks/7"), req.path);
+            Assert::AreEqual(std::string("id,title"), req.get_param_value("fields"));
+            Assert::AreEqual(std::string("a b"), req.get_param_value("q"));
+            Assert::AreEqual(std::string("application/json"), req.get_header_value("Accept"));
+
+            std::string_view rest = std::string_view(in).substr(consumed);
+            Assert::IsTrue(parseHttpRequest(rest.substr(0, rest.size() - 3), 1024, req, consumed, status) == HttpParse::AwaitingBody);
+            Assert::AreEqual(rest.size(), consumed);
+            Assert::IsTrue(parseHttpRequest(rest, 1024, req, consumed, status) == HttpParse::Complete);
+            Assert::AreEqual(std::string("{\"title\":\"a\"}"), req.body);
+            Assert::AreEqual(rest.size(), consumed);
+        }
+
+        TEST_METHOD(TestChunkedBody)
+        {
+            std::string in = "POST /tasks HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                "5\r\n{\"tit\r\n8;ext=1\r\nle\":\"c\"}\r\n0\r\n\r\nGET";
+            Request req;
+            size_t consumed = 0;
+            int status = 0;
+            Assert::IsTrue(parseHttpRequest(in.substr(0, in.size() - 8), 1024, req, consumed, status) == HttpParse::AwaitingBody);
+            Assert::IsTrue(parseHttpRequest(in, 1024, req, consumed, status) == HttpParse::Complete);
+            Assert::AreEqual(std::string("{\"title\":\"c\"}"), req.body);
+            Assert::AreEqual(in.size() - 3, consumed);
+        }
+
+        TEST_METHOD(TestRejectsInvalidRequests)
+        {
+            Request req;
+            size_t consumed = 0;
+            int status = 0;
+            Assert::IsTrue(parseHttpRequest("GET /tasks HTTP/1.1\r\nHost", 1024, req, consumed, status) == HttpParse::Incomplete);
+            Assert::IsTrue(parseHttpRequest("GET tasks HTTP/1.1\r\n\r\n", 1024, req, consumed, status) == HttpParse::Invalid);
+            Assert::AreEqual(400, status);
+            Assert::IsTrue(parseHttpRequest("GET / HTTP/2.0\r\n\r\n", 1024, req, consumed, status) == HttpParse::Invalid);
+            Assert::AreEqual(505, status);
+            Assert::IsTrue(parseHttpRequest("POST / HTTP/1.1\r\nContent-Length: 2048\r\n\r\n", 1024, req, consumed, status) == HttpParse::Invalid);
+            Assert::AreEqual(413, status);
+            Assert::IsTrue(parseHttpRequest("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", 1024, req, consumed, status) == HttpParse::Invalid);
+            Assert::AreEqual(400, status);
+            std::string huge = "GET / HTTP/1.1\r\nX: " + std::string(HTTP_MAX_HEADER_BYTES, 'x');
+            Assert::IsTrue(parseHttpRequest(huge, 1024, req, consumed, status) == HttpParse::Invalid);
+            Assert::AreEqual(431, status);
+        }
+
+        TEST_METHOD(TestRoutesDispatchLikeHttplib)
+        {
+            HttpRoutes routes;
+            std::vector<std::string> seen;
+            routes.set_pre_routing_handler([&](const Request&, Response&) {
+                seen.push_back("pre");
+                return Server::HandlerResponse::Unhandled;
+                });
+            routes.set_post_routing_handler([&](const Request&, Response& res) { seen.push_back("post " + std::to_string(res.status)); });
+            routes.Get("/tasks/(\\d+)", [&](const Request& req, Response&) { seen.push_back("get " + req.matches[1].str()); });
+            routes.Post("/tasks", [](const Request&, Response&) { throw std::runtime_error("boom"); });
+
+            Request req;
+            req.method = "HEAD";
+            req.path = "/tasks/12";
+            Response res;
+            routes.dispatch(req, res);
+            req.method = "POST";
+            req.path = "/tasks";
+            Response failed;
+            routes.dispatch(req, failed);
+            req.path = "/tasks/12/x";
+            Response missing;
+            routes.dispatch(req, missing);
+
+            std::vector<std::string> expected = { "pre", "get 12", "post 200", "pre", "post 500", "pre", "post 404" };
+            Assert::IsTrue(seen == expected);
+        }
+
+#ifdef __linux__
+        // One thread per job, so a worker can block in push() while the
+        // reactor keeps running.
+        class ThreadQueue : public httplib::TaskQueue {
+        public:
+            bool enqueue(std::function<void()> fn) override {
+                std::lock_guard<std::mutex> lock(mtx);
+                threads.emplace_back(std::move(fn));
+                return true;
+            }
+
+            void shutdown() override {
+                std::lock_guard<std::mutex> lock(mtx);
+                for (auto& thread : threads) thread.join();
+                threads.clear();
+            }
+
+        private:
+            std::mutex mtx;
+            std::vector<std::thread> threads;
+        };
+
+        TEST_METHOD(TestReactorDropsClientThatStopsReading)
+        {
+            HttpRoutes routes;
+            routes.Get("/big", [](const Request&, Response& res) { res.set_content(std::string(8 << 20, 'x'), "text/plain"); });
+            ServerConfig config;
+            config.writeTimeoutSeconds = 1;
+            config.reactorThreads = 1;
+            ReactorServer server(routes, config);
+            server.new_task_queue = [] { return new ThreadQueue(); };
+            int port = server.bindToAnyPort("127.0.0.1");
+            Assert::IsTrue(port > 0);
+            std::thread serving([&] { server.listenAfterBind(); });
+            server.waitUntilReady();
+
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            int small = 4096;
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(port));
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            Assert::AreEqual(0, ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+            std::string pipelined;
+            for (int i = 0; i < 4; ++i) pipelined += "GET /big HTTP/1.1\r\nHost: test\r\n\r\n";
+            Assert::IsTrue(::send(fd, pipelined.data(), pipelined.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(pipelined.size()));
+
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (server.connectionCount() == 0 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            while (server.connectionCount() > 0 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            size_t open = server.connectionCount();
+            ::close(fd);
+            server.stop();
+            serving.join();
+
+            Assert::AreEqual(static_cast<size_t>(0), open);
+        }
+#endif
+    };
+
+    TEST_CLASS(MetricsTests)
+    {
+    public:
+
+        TEST_METHOD(TestHistogramBucketBounds)
+        {
+            for (uint64_t value : { 0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, 1ull << 39 }) {
+                size_t bucket = LatencyHistogram::bucketOf(value);
+                Assert::IsTrue(value <= LatencyHistogram::upperBound(bucket));
+                if (bucket > 0) {
+                    Assert::IsTrue(value > LatencyHistogram::upperBound(bucket - 1));
+                }
+            }
+            Assert::AreEqual(LatencyHistogram::BUCKETS - 1, LatencyHistogram::bucketOf(UINT64_MAX));
+        }
+
+        TEST_METHOD(TestRenderRequestAndLockSeries)
+        {
+            TaskStorage storage(2);
+            storage.getTask(storage.createTask(Task(0, "Metered", "", "todo")).id);
+            Metrics::instance().recordRequest(0, 201, 42000);
+
+            std::string text = Metrics::instance().render({ {"POST", "/tasks"} });
+            Assert::IsTrue(text.find("todo_http_request_duration_seconds_count{method=\"POST\",route=\"/tasks\",code=\"201\"}") != std::string::npos);
+            Assert::IsTrue(text.find("todo_storage_lock_wait_seconds_count{mode=\"read\"}") != std::string::npos);
+            Assert::IsTrue(text.find("todo_storage_lock_hold_seconds_count{mode=\"write\"}") != std::string::npos);
+        }
+    };
+
+    TEST_CLASS(TaskBodyParserTests)
+    {
+    public:
+
+        TEST_METHOD(TestParsesFieldsInOnePass)
+        {
+            TaskPatch patch;
+            std::string detail;
+            std::string body = "{\"id\": 7, \"title\": \"Caf\\u00e9 \\\"run\\\"\", \"tags\": [1, {\"a\": null}],"
+                " \"description\": \"line\\nnext \\ud83d\\ude00\", \"status\": \"in_progress\"}";
+            Assert::IsTrue(TaskBodyParser::parse(body, patch, detail) == TaskBodyParser::Result::Ok);
+            Assert::AreEqual(std::string("Caf\xc3\xa9 \"run\""), *patch.title);
+            Assert::AreEqual(std::string("line\nnext \xf0\x9f\x98\x80"), *patch.description);
+            Assert::IsTrue(*patch.status == TaskStatus::InProgress);
+
+            TaskPatch empty;
+            Assert::IsTrue(TaskBodyParser::parse(" {} ", empty, detail) == TaskBodyParser::Result::Ok);
+            Assert::IsTrue(empty.empty());
+        }
+
+        TEST_METHOD(TestRejectsInvalidBodies)
+        {
+            std::string detail;
+            for (const char* body : { "", "{", "{\"title\": \"a\",}", "{\"title\": \"a\"} x",
+                "{\"title\": \"\\ud800\"}", "{\"title\": \"\xc3\"}", "{\"n\": 01}" }) {
+                TaskPatch patch;
+                Assert::IsTrue(TaskBodyParser::parse(body, patch, detail) == TaskBodyParser::Result::Syntax);
+            }
+
+            TaskPatch patch;
+            Assert::IsTrue(TaskBodyParser::parse("{\"title\": 5}", patch, detail) == TaskBodyParser::Result::FieldType);
+            Assert::AreEqual(std::string("title"), detail);
+            Assert::IsTrue(TaskBodyParser::parse("{\"status\": \"later\"}", patch, detail) == TaskBodyParser::Result::InvalidStatus);
+        }
+    };
+
+    TEST_CLASS(ServerConfigTests)
+    {
+    public:
+
+        TEST_METHOD(TestFileThenCommandLine)
+        {
+            auto path = std::filesystem::temp_directory_path() / "todo_api_config_test.json";
+            {
+                std::ofstream out(path);
+                out << "{\"port\": 9090, \"threads\": 4, \"pin_workers\": true, \"log_level\": \"warn\"}";
+            }
+            std::string file = path.string();
+            std::vector<std::string> args = { "To_Do_API", "--config", file, "--threads", "12", "--keep-alive-timeout", "30",
+                "--storage-backend", "rcu" };
+            std::vector<char*> argv;
+            for (auto& arg : args) argv.push_back(&arg[0]);
+
+            ServerConfig config = ServerConfig::load(static_cast<int>(argv.size()), argv.data());
+            Assert::AreEqual(9090, config.port);
+            Assert::AreEqual(static_cast<size_t>(12), config.threads);
+            Assert::IsTrue(config.pinWorkers);
+            Assert::IsTrue(config.logLevel == LogLevel::Warn);
+            Assert::IsTrue(config.keepAliveTimeoutSeconds == 30);
+            Assert::IsTrue(config.storageBackend == StorageBackend::Rcu);
+        }
+
+        TEST_METHOD(TestRejectsInvalidValues)
+        {
+            for (std::vector<std::string> args : {
+                std::vector<std::string>{ "To_Do_API", "--port", "70000" },
+                std::vector<std::string>{ "To_Do_API", "--threads", "4x" },
+                std::vector<std::string>{ "To_Do_API", "--unknown", "1" },
+                std::vector<std::string>{ "To_Do_API", "--storage-backend", "btree" },
+                std::vector<std::string>{ "To_Do_API", "--port" } }) {
+                std::vector<char*> argv;
+                for (auto& arg : args) argv.push_back(&arg[0]);
+                Assert::ExpectException<std::invalid_argument>([&] {
+                    ServerConfig::load(static_cast<int>(argv.size()), argv.data());
+                    });
+            }
+        }
+    };
+
+    TEST_CLASS(LoggerTests)
+    {
+    public:
+
+        TEST_METHOD(TestLevelsAndOutput)
+        {
+            auto path = std::filesystem::temp_directory_path() / "todo_api_logger_test.log";
+            std::filesystem::remove(path);
+            Logger& logger = Logger::instance();
+            LogLevel previous = logger.level();
+            Assert::IsTrue(logger.setOutput(path.string()));
+
+            logger.setLevel(LogLevel::Warn);
+            logInfo("hidden line");
+            logWarn("visible id=", 42, " ok=", true);
+            logger.flush();
+            logger.setOutput("");
+            logger.setLevel(previous);
+
+            std::ifstream in(path);
+            std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            Assert::IsTrue(contents.find("warn visible id=42 ok=true\n") != std::string::npos);
+            Assert::IsTrue(contents.find("hidden line") == std::string::npos);
+        }
+
+        TEST_METHOD(TestParseLogLevel)
+        {
+            LogLevel level = LogLevel::Info;
+            Assert::IsTrue(parseLogLevel("debug", level));
+            Assert::IsTrue(level == LogLevel::Debug);
+            Assert::IsFalse(parseLogLevel("verbose", level));
+            Assert::IsTrue(level == LogLevel::Debug);
+        }
+    };
+}